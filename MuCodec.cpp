@@ -0,0 +1,494 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuCodec.cpp
+ *
+ * @brief Compact encoding for MIDI messages and notes
+ *
+ * @author Carlos Eduardo Mello
+ * @date 10/18/2026
+ *
+ **/
+
+#include "MuCodec.h"
+#include "MuUtil.h"
+#include <stdint.h>
+#include <string.h>
+
+// Block layouts:
+//
+// MIDI messages: count, then columns for time (float bit deltas),
+// stamp (deltas of deltas), status (runs of [length, status byte]),
+// data1 (deltas), data2 (deltas).
+//
+// Notes: count, then columns for instr (deltas), start, dur (float bit
+// deltas), pitch (deltas), amp (float bit deltas), number of params
+// per note, and every param value (float bit deltas)
+//
+// Every number is written as a varint (7 bits per byte, lowest bits
+// first, high bit set on every byte except the last one). Deltas are
+// zig-zag encoded first, so small negative values stay small.
+
+const char MIDI_FILE_TAG[4] = {'M','u','M','B'};
+const unsigned char MIDI_FILE_VERSION = 1;
+const long MIDI_FILE_HEADER_SIZE = 5;
+
+// longest varint for a 64 bit value...
+const long MAX_VARINT_SIZE = 10;
+
+// shortest encoding of a MIDI message: one byte each for time,
+// stamp, data1 and data2 (status runs may cover many messages)...
+const long MIN_ENCODED_MIDI_SIZE = 4;
+
+static void PutVarint(unsigned char * & p, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        *p++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+}
+
+static bool GetVarint(const unsigned char * & p, const unsigned char * end, uint64_t & value)
+{
+    int shift = 0;
+    value = 0;
+    while(p < end && shift < 64)
+    {
+        unsigned char byte = *p++;
+        value |= ((uint64_t)(byte & 0x7F) << shift);
+        if((byte & 0x80) == 0)
+            return true;
+        shift += 7;
+    }
+    return false;
+}
+
+static uint64_t ZigZag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t UnZigZag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// writes the difference between an integer value and the previous
+// value in the same column...
+static void PutDelta(unsigned char * & p, int64_t value, int64_t & prev)
+{
+    PutVarint(p, ZigZag(value - prev));
+    prev = value;
+}
+
+static bool GetDelta(const unsigned char * & p, const unsigned char * end, int64_t & prev)
+{
+    uint64_t value;
+    if(!GetVarint(p, end, value))
+        return false;
+    prev += UnZigZag(value);
+    return true;
+}
+
+static int64_t FloatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (int64_t)bits;
+}
+
+static float BitsFloat(int64_t bits)
+{
+    uint32_t temp = (uint32_t)bits;
+    float value;
+    memcpy(&value, &temp, sizeof(value));
+    return value;
+}
+
+long MaxEncodedMIDISize(long n)
+{
+    // time (5) + stamp (10) + status run (2) + data1 (2) + data2 (2)...
+    return MAX_VARINT_SIZE + (n * 21);
+}
+
+long EncodeMIDIMessages(const MuMIDIMessage * msgs, long n, unsigned char * out)
+{
+    unsigned char * p = out;
+    int64_t prev, step;
+    long i, run;
+
+    if(n < 0)
+        n = 0;
+    PutVarint(p, n);
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+        PutDelta(p, FloatBits(msgs[i].time), prev);
+
+    // stamps grow steadily, so we store the change in the
+    // interval between messages, which is usually small
+    // (unsigned arithmetic lets any value wrap safely)...
+    prev = 0;
+    step = 0;
+    for(i = 0; i < n; i++)
+    {
+        uint64_t interval = (uint64_t)msgs[i].stamp - (uint64_t)prev;
+        PutVarint(p, ZigZag((int64_t)(interval - (uint64_t)step)));
+        step = (int64_t)interval;
+        prev = msgs[i].stamp;
+    }
+
+    // status bytes are stored as runs...
+    i = 0;
+    while(i < n)
+    {
+        run = 1;
+        while((i + run < n) && (msgs[i + run].status == msgs[i].status))
+            run++;
+        PutVarint(p, run);
+        *p++ = msgs[i].status;
+        i += run;
+    }
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+        PutDelta(p, msgs[i].data1, prev);
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+        PutDelta(p, msgs[i].data2, prev);
+
+    return (long)(p - out);
+}
+
+long DecodeMIDIMessages(const unsigned char * in, long size, MuMIDIMessage * msgs, long max)
+{
+    const unsigned char * p = in;
+    const unsigned char * end = in + size;
+    uint64_t count, run;
+    int64_t prev, step;
+    long i, j, n;
+
+    if(!GetVarint(p, end, count) || ((long)count > max) || ((long)count < 0))
+        return -1;
+    n = (long)count;
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+    {
+        if(!GetDelta(p, end, prev))
+            return -1;
+        msgs[i].time = BitsFloat(prev);
+    }
+
+    prev = 0;
+    step = 0;
+    for(i = 0; i < n; i++)
+    {
+        if(!GetVarint(p, end, run))
+            return -1;
+        step = (int64_t)((uint64_t)step + (uint64_t)UnZigZag(run));
+        prev = (int64_t)((uint64_t)prev + (uint64_t)step);
+        msgs[i].stamp = prev;
+    }
+
+    i = 0;
+    while(i < n)
+    {
+        if(!GetVarint(p, end, run) || (p >= end) || (run == 0) || ((long)run > (n - i)))
+            return -1;
+        for(j = 0; j < (long)run; j++)
+            msgs[i + j].status = *p;
+        p++;
+        i += (long)run;
+    }
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+    {
+        if(!GetDelta(p, end, prev))
+            return -1;
+        msgs[i].data1 = (unsigned char)prev;
+    }
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+    {
+        if(!GetDelta(p, end, prev))
+            return -1;
+        msgs[i].data2 = (unsigned char)prev;
+    }
+
+    return n;
+}
+
+long MaxEncodedNoteSize(long n, long numParams)
+{
+    // instr (3) + start (5) + dur (5) + pitch (3) + amp (5) + param count (3)...
+    return MAX_VARINT_SIZE + (n * 24) + (numParams * 5);
+}
+
+long EncodeNotes(MuNote * notes, long n, unsigned char * out)
+{
+    unsigned char * p = out;
+    MuParamBlock params;
+    int64_t prev;
+    float val;
+    long i;
+    uShort k;
+
+    if(n < 0)
+        n = 0;
+    PutVarint(p, n);
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+        PutDelta(p, notes[i].Instr(), prev);
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+        PutDelta(p, FloatBits(notes[i].Start()), prev);
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+        PutDelta(p, FloatBits(notes[i].Dur()), prev);
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+        PutDelta(p, notes[i].Pitch(), prev);
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+        PutDelta(p, FloatBits(notes[i].Amp()), prev);
+
+    for(i = 0; i < n; i++)
+        PutVarint(p, notes[i].Params().Num());
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+    {
+        params = notes[i].Params();
+        for(k = 0; k < params.Num(); k++)
+        {
+            params.Val(k, &val);
+            PutDelta(p, FloatBits(val), prev);
+        }
+    }
+
+    return (long)(p - out);
+}
+
+long DecodeNotes(const unsigned char * in, long size, MuNote * notes, long max)
+{
+    const unsigned char * p = in;
+    const unsigned char * end = in + size;
+    const unsigned char * counts;
+    uint64_t count, num;
+    int64_t prev;
+    long i, n;
+    uShort k;
+
+    if(!GetVarint(p, end, count) || ((long)count > max) || ((long)count < 0))
+        return -1;
+    n = (long)count;
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+    {
+        if(!GetDelta(p, end, prev))
+            return -1;
+        notes[i].SetInstr((uShort)prev);
+    }
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+    {
+        if(!GetDelta(p, end, prev))
+            return -1;
+        notes[i].SetStart(BitsFloat(prev));
+    }
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+    {
+        if(!GetDelta(p, end, prev))
+            return -1;
+        notes[i].SetDur(BitsFloat(prev));
+    }
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+    {
+        if(!GetDelta(p, end, prev))
+            return -1;
+        notes[i].SetPitch((short)prev);
+    }
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+    {
+        if(!GetDelta(p, end, prev))
+            return -1;
+        notes[i].SetAmp(BitsFloat(prev));
+    }
+
+    // parameter values come right after the parameter counts,
+    // so we need to skip the counts before reading them...
+    counts = p;
+    for(i = 0; i < n; i++)
+    {
+        if(!GetVarint(p, end, num) || (num > 0xFFFF))
+            return -1;
+    }
+
+    prev = 0;
+    for(i = 0; i < n; i++)
+    {
+        MuParamBlock params;
+        GetVarint(counts, end, num);
+        if(num > 0)
+        {
+            params.Init((uShort)num);
+            for(k = 0; k < (uShort)num; k++)
+            {
+                if(!GetDelta(p, end, prev))
+                    return -1;
+                params.SetVal(k, BitsFloat(prev));
+            }
+        }
+        notes[i].SetParams(params);
+    }
+
+    return n;
+}
+
+long EncodedCount(const unsigned char * in, long size)
+{
+    const unsigned char * p = in;
+    uint64_t count;
+
+    if(!GetVarint(p, in + size, count) || ((long)count < 0))
+        return -1;
+    return (long)count;
+}
+
+MuByteBuffer EncodeMIDIBuffer(MuMIDIBuffer buffer)
+{
+    MuByteBuffer block;
+    long n = (buffer.data != NULL) ? buffer.count : 0;
+
+    block.max = MaxEncodedMIDISize(n);
+    block.count = 0;
+    block.data = new unsigned char[block.max];
+    if(block.data)
+        block.count = EncodeMIDIMessages(buffer.data, n, block.data);
+    else
+        block.max = 0;
+
+    return block;
+}
+
+MuMIDIBuffer DecodeMIDIBuffer(MuByteBuffer block)
+{
+    MuMIDIBuffer buffer;
+    buffer.data = NULL;
+    buffer.max = 0;
+    buffer.count = 0;
+
+    // the count comes from the block, so it can't claim
+    // more messages than the block has room for...
+    long n = EncodedCount(block.data, block.count);
+    if((n > 0) && (n <= block.count / MIN_ENCODED_MIDI_SIZE))
+    {
+        buffer.data = new MuMIDIMessage[n];
+        if(buffer.data)
+        {
+            buffer.max = n;
+            if(DecodeMIDIMessages(block.data, block.count, buffer.data, n) == n)
+            {
+                buffer.count = n;
+            }
+            else
+            {
+                delete [] buffer.data;
+                buffer.data = NULL;
+                buffer.max = 0;
+            }
+        }
+    }
+
+    return buffer;
+}
+
+bool WriteMIDIBufferFile(string fileName, MuMIDIBuffer buffer)
+{
+    bool res = false;
+    long n = (buffer.data != NULL) ? buffer.count : 0;
+    long size = MIDI_FILE_HEADER_SIZE + MaxEncodedMIDISize(n);
+    unsigned char * data = new unsigned char[size];
+
+    if(data)
+    {
+        // header and encoded block go in the same
+        // buffer, so we only need to write once...
+        memcpy(data, MIDI_FILE_TAG, 4);
+        data[4] = MIDI_FILE_VERSION;
+        size = MIDI_FILE_HEADER_SIZE + EncodeMIDIMessages(buffer.data, n, data + MIDI_FILE_HEADER_SIZE);
+
+        ofstream output(fileName.c_str(), ios_base::out | ios_base::trunc | ios_base::binary);
+        if(output)
+        {
+            output.write((char *)data, size);
+            res = output.good();
+            output.close();
+        }
+        delete [] data;
+    }
+
+    return res;
+}
+
+MuMIDIBuffer ReadMIDIBufferFile(string fileName)
+{
+    MuMIDIBuffer buffer;
+    MuByteBuffer block;
+    buffer.data = NULL;
+    buffer.max = 0;
+    buffer.count = 0;
+
+    ifstream input(fileName.c_str(), ios_base::in | ios_base::binary);
+    if(input)
+    {
+        // read entire file at once...
+        input.seekg(0, ios_base::end);
+        long size = (long)input.tellg();
+        input.seekg(0, ios_base::beg);
+
+        if(size > MIDI_FILE_HEADER_SIZE)
+        {
+            unsigned char * data = new unsigned char[size];
+            if(data)
+            {
+                input.read((char *)data, size);
+                if(input && (memcmp(data, MIDI_FILE_TAG, 4) == 0) && (data[4] == MIDI_FILE_VERSION))
+                {
+                    block.data = data + MIDI_FILE_HEADER_SIZE;
+                    block.max = size - MIDI_FILE_HEADER_SIZE;
+                    block.count = block.max;
+                    buffer = DecodeMIDIBuffer(block);
+                }
+                delete [] data;
+            }
+        }
+    }
+
+    return buffer;
+}
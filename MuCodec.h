@@ -0,0 +1,252 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuCodec.h
+ *
+ * @brief Compact encoding for MIDI messages and notes
+ *
+ * @author Carlos Eduardo Mello
+ * @date 10/18/2026
+ *
+ * @details
+ * This file declares the functions used by MuM to store sequences of
+ * MIDI messages (MuMIDIMessage) and notes (MuNote) in a compact binary
+ * form. Recorded sessions and generated materials are dominated by
+ * very redundant data: timestamps that grow slowly, pitches that move
+ * by small intervals, the same status byte or duration repeated over
+ * and over. The codec takes advantage of this by storing every field
+ * in its own column, as the difference to the previous value in that
+ * column, written as a zig-zag variable length integer (varint). Small
+ * differences, positive or negative, take a single byte. Repeated
+ * status bytes are stored as runs.
+ *
+ * Floating point fields (times, durations, amplitudes and parameters)
+ * are encoded through the difference between the bit patterns of
+ * consecutive values, so the encoding is lossless: decoded data is
+ * identical to the original. Nanosecond stamps (MuMIDIMessage::stamp)
+ * are stored as the change in the interval between consecutive
+ * messages, so evenly spaced events cost a single byte each.
+ *
+ * Encoded data is organized in blocks. Each block contains a number
+ * of messages or notes and can be decoded independently of any other
+ * block. Block functions work on memory provided by calling code, so
+ * they never allocate memory themselves; Max...Size() functions can be
+ * used to find out how much memory an encoded block may need.
+ *
+ **/
+
+#ifndef MuCodec_H
+#define MuCodec_H
+
+#include "MuNote.h"
+
+/**
+ * @brief Byte Buffer structure
+ *
+ * @details
+ * MuByteBuffer is the encoded counterpart of MuMIDIBuffer. It
+ * contains a pointer to a dynamically allocated array of bytes
+ * ('data'), the size of that array ('max') and the number of bytes
+ * in use ('count'). As with MIDI buffers, code receiving one of these
+ * buffers is responsible for releasing its memory.
+ **/
+struct MuByteBuffer
+{
+    //! @brief pointer to the first byte in the buffer
+    unsigned char * data;
+    //! @brief maximum number of bytes allowed in the buffer
+    long max;
+    //! @brief number of used/valid bytes in the buffer
+    long count;
+};
+typedef struct MuByteBuffer MuByteBuffer;
+
+/**
+ * @brief returns the maximum size of an encoded block of MIDI messages
+ *
+ * @details
+ * MaxEncodedMIDISize() returns the largest number of bytes
+ * EncodeMIDIMessages() may need to encode 'n' messages. The actual
+ * size is usually much smaller.
+ *
+ * @param n (long) - number of messages
+ *
+ * @return
+ * long - size in bytes
+ **/
+long MaxEncodedMIDISize(long n);
+
+/**
+ * @brief encodes a block of MIDI messages
+ *
+ * @details
+ * EncodeMIDIMessages() writes 'n' messages from 'msgs' to 'out' in
+ * compact form. 'out' must point to an array with at least
+ * MaxEncodedMIDISize(n) bytes.
+ *
+ * @param msgs (const MuMIDIMessage *) - messages to be encoded
+ * @param n (long) - number of messages
+ * @param out (unsigned char *) - destination for encoded data
+ *
+ * @return
+ * long - number of bytes written to 'out'
+ **/
+long EncodeMIDIMessages(const MuMIDIMessage * msgs, long n, unsigned char * out);
+
+/**
+ * @brief decodes a block of MIDI messages
+ *
+ * @details
+ * DecodeMIDIMessages() reads a block created by EncodeMIDIMessages()
+ * and writes its messages to 'msgs'. If the block contains more than
+ * 'max' messages or is incomplete, DecodeMIDIMessages() returns -1.
+ * The number of messages in a block can be checked in advance with
+ * EncodedCount().
+ *
+ * @param in (const unsigned char *) - encoded block
+ * @param size (long) - number of bytes in block
+ * @param msgs (MuMIDIMessage *) - destination array
+ * @param max (long) - number of messages available in 'msgs'
+ *
+ * @return
+ * long - number of decoded messages, or -1 if block is invalid
+ **/
+long DecodeMIDIMessages(const unsigned char * in, long size, MuMIDIMessage * msgs, long max);
+
+/**
+ * @brief returns the maximum size of an encoded block of notes
+ *
+ * @details
+ * MaxEncodedNoteSize() returns the largest number of bytes
+ * EncodeNotes() may need to encode 'n' notes containing a total of
+ * 'numParams' extra parameters.
+ *
+ * @param n (long) - number of notes
+ * @param numParams (long) - total number of parameters in all notes
+ *
+ * @return
+ * long - size in bytes
+ **/
+long MaxEncodedNoteSize(long n, long numParams);
+
+/**
+ * @brief encodes a block of notes
+ *
+ * @details
+ * EncodeNotes() writes 'n' notes from 'notes' to 'out' in compact
+ * form. Every note field is preserved, including the parameter block.
+ * 'out' must point to an array with at least MaxEncodedNoteSize() bytes.
+ *
+ * @param notes (MuNote *) - notes to be encoded
+ * @param n (long) - number of notes
+ * @param out (unsigned char *) - destination for encoded data
+ *
+ * @return
+ * long - number of bytes written to 'out'
+ **/
+long EncodeNotes(MuNote * notes, long n, unsigned char * out);
+
+/**
+ * @brief decodes a block of notes
+ *
+ * @details
+ * DecodeNotes() reads a block created by EncodeNotes() and writes its
+ * notes to 'notes'. If the block contains more than 'max' notes or is
+ * incomplete, DecodeNotes() returns -1.
+ *
+ * @param in (const unsigned char *) - encoded block
+ * @param size (long) - number of bytes in block
+ * @param notes (MuNote *) - destination array
+ * @param max (long) - number of notes available in 'notes'
+ *
+ * @return
+ * long - number of decoded notes, or -1 if block is invalid
+ **/
+long DecodeNotes(const unsigned char * in, long size, MuNote * notes, long max);
+
+/**
+ * @brief returns the number of items in an encoded block
+ *
+ * @details
+ * EncodedCount() reads the number of messages or notes stored in a
+ * block, so calling code can allocate the right amount of memory
+ * before decoding it.
+ *
+ * @param in (const unsigned char *) - encoded block
+ * @param size (long) - number of bytes in block
+ *
+ * @return
+ * long - number of items in block, or -1 if block is invalid
+ **/
+long EncodedCount(const unsigned char * in, long size);
+
+/**
+ * @brief encodes a MIDI buffer
+ *
+ * @details
+ * EncodeMIDIBuffer() encodes the valid messages in 'buffer' as a
+ * single block and returns the result in a newly allocated byte
+ * buffer, which must be released by calling code.
+ *
+ * @param buffer (MuMIDIBuffer) - messages to be encoded
+ *
+ * @return
+ * MuByteBuffer - encoded block; 'data' is NULL if allocation fails
+ **/
+MuByteBuffer EncodeMIDIBuffer(MuMIDIBuffer buffer);
+
+/**
+ * @brief decodes a MIDI buffer
+ *
+ * @details
+ * DecodeMIDIBuffer() decodes a block created by EncodeMIDIBuffer()
+ * and returns its messages in a newly allocated MIDI buffer, which
+ * must be released by calling code. If the block is invalid, the
+ * returned buffer is empty ('data' == NULL, 'count' == 0).
+ *
+ * @param block (MuByteBuffer) - encoded block
+ *
+ * @return
+ * MuMIDIBuffer - decoded messages
+ **/
+MuMIDIBuffer DecodeMIDIBuffer(MuByteBuffer block);
+
+/**
+ * @brief saves a MIDI buffer to an encoded file
+ *
+ * @details
+ * WriteMIDIBufferFile() encodes 'buffer' and writes it to 'fileName'
+ * with a single write operation. This is the preferred way to keep
+ * MuRecorder sessions on disk. Message stamps are preserved.
+ *
+ * @param fileName (string) - path to file
+ * @param buffer (MuMIDIBuffer) - messages to be saved
+ *
+ * @return
+ * bool - false if the file cannot be written
+ **/
+bool WriteMIDIBufferFile(string fileName, MuMIDIBuffer buffer);
+
+/**
+ * @brief reads a MIDI buffer from an encoded file
+ *
+ * @details
+ * ReadMIDIBufferFile() loads a file created by WriteMIDIBufferFile()
+ * and returns its messages in a newly allocated MIDI buffer, which
+ * must be released by calling code. If the file cannot be read or
+ * is not valid, the returned buffer is empty.
+ *
+ * @param fileName (string) - path to file
+ *
+ * @return
+ * MuMIDIBuffer - messages stored in the file
+ **/
+MuMIDIBuffer ReadMIDIBufferFile(string fileName);
+
+#endif /* MuCodec_H */
@@ -103,6 +103,10 @@ string MuError::Message(void)
 			message = "Invalid note range!";
 			break;
 			
+		case MuERROR_INVALID_FILE_FORMAT:
+			message = "Input file format is not supported!";
+			break;
+			
 	}
 	
 	return message;
@@ -63,6 +63,8 @@ const short MuERROR_INVALID_SCALE_DEGREE = 13;
 const short MuERROR_INVALID_NOTE_RANGE = 14;
 //!@brief Voice contains no data!
 const short MuERROR_VOICE_IS_EMPTY = 15;
+//!@brief Input file format is not supported!
+const short MuERROR_INVALID_FILE_FORMAT = 16;
 
 /**
 * @brief Error Class
@@ -41,6 +41,15 @@
  * sequencing. See MuNote::MIDIOn() and  MuNote::MIDIOff()
  * for more details. This structure is also used by MuPlayer
  * in output queues and by MuRecorder in input ring buffers
+ *
+ * Every message carries its time twice: 'time', in seconds, and
+ * 'stamp', in nanoseconds, as a 64 bit integer. MuM code fills both
+ * fields. 'stamp' is the precise value and is the one used by MuPlayer
+ * for scheduling; 'time' is kept for convenience and compatibility, but
+ * loses resolution as it grows (a float only resolves about one
+ * millisecond after three hours). Buffers handed to
+ * MuPlayer::SendEvents() are usually built by calling code, which may
+ * not fill 'stamp', so their stamps are always rebuilt from 'time'.
  **/
 struct MuMIDIMessage
 {
@@ -52,6 +61,8 @@ struct MuMIDIMessage
     unsigned char data2;
     //! @brief time stamp in seconds
     float time;
+    //! @brief time stamp in nanoseconds
+    long long stamp;
 };
 typedef struct MuMIDIMessage MuMIDIMessage;
 
@@ -122,4 +133,15 @@ const unsigned char MU_PROGRAM_CHANGE = 0xC0;
 const unsigned char MU_MONO_AFTERTOUCH = 0xD0;
 const unsigned char MU_PITCH_BEND = 0xE0;
 
+// MIDI voice message type flags, one bit per message type, for
+// functions which take a set of types (see MuRecorder filters).
+// A message's flag is (1 << ((status >> 4) & 0x07))...
+const unsigned char MU_NOTE_OFF_FLAG = 0x01;
+const unsigned char MU_NOTE_ON_FLAG = 0x02;
+const unsigned char MU_POLY_AFTERTOUCH_FLAG = 0x04;
+const unsigned char MU_CONTROL_FLAG = 0x08;
+const unsigned char MU_PROGRAM_CHANGE_FLAG = 0x10;
+const unsigned char MU_MONO_AFTERTOUCH_FLAG = 0x20;
+const unsigned char MU_PITCH_BEND_FLAG = 0x40;
+
 #endif /* MuMIDI_H */
@@ -0,0 +1,492 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuMIDIFile.cpp
+ *
+ * @brief Standard MIDI File support
+ *
+ * @author Carlos Eduardo Mello
+ * @date 10/18/2026
+ *
+ **/
+
+#include "MuMIDIFile.h"
+#include "MuUtil.h"
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// default tempo for MIDI files (120 bpm), in microseconds per quarter note...
+const unsigned long MIDI_FILE_DEFAULT_TEMPO = 500000;
+
+// time division and tempo used when writing MIDI files...
+const unsigned long MIDI_FILE_DIVISION = 480;
+const double MIDI_FILE_TICKS_PER_SECOND = MIDI_FILE_DIVISION * (1e6 / MIDI_FILE_DEFAULT_TEMPO);
+
+// meta events...
+const unsigned char MIDI_META_EVENT = 0xFF;
+const unsigned char MIDI_META_TRACK_NAME = 0x03;
+const unsigned char MIDI_META_END_OF_TRACK = 0x2F;
+const unsigned char MIDI_META_TEMPO = 0x51;
+
+// system exclusive...
+const unsigned char MIDI_SYSEX = 0xF0;
+const unsigned char MIDI_SYSEX_ESCAPE = 0xF7;
+
+struct MuTempoChange
+{
+    uint64_t tick;
+    unsigned long tempo; // microseconds per quarter note
+};
+
+static unsigned long GetBigEndian(const unsigned char * p, int n)
+{
+    unsigned long value = 0;
+    for(int i = 0; i < n; i++)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+// reads a variable length quantity (at most 4 bytes)...
+static bool GetVarLength(const unsigned char * & p, const unsigned char * end, unsigned long & value)
+{
+    value = 0;
+    for(int i = 0; (i < 4) && (p < end); i++)
+    {
+        unsigned char byte = *p++;
+        value = (value << 7) | (byte & 0x7F);
+        if((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void PutBigEndian(unsigned char * & p, unsigned long value, int n)
+{
+    for(int i = n - 1; i >= 0; i--)
+        *p++ = (unsigned char)((value >> (8 * i)) & 0xFF);
+}
+
+// writes a variable length quantity; values longer than
+// 28 bits are not allowed by the SMF specification...
+static void PutVarLength(unsigned char * & p, unsigned long value)
+{
+    unsigned char bytes[4];
+    int n = 0;
+
+    if(value > 0x0FFFFFFF)
+        value = 0x0FFFFFFF;
+    do
+    {
+        bytes[n++] = value & 0x7F;
+        value >>= 7;
+    }
+    while(value > 0);
+
+    while(n > 1)
+        *p++ = bytes[--n] | 0x80;
+    *p++ = bytes[0];
+}
+
+// Parses the events in a track chunk. Channel messages go to 'track', with
+// their absolute tick positions stored in 'ticks'; tempo changes go to 'tempoMap'.
+// 'track.buffer' must have room for every message in the chunk...
+static bool ParseMIDITrack(const unsigned char * p, const unsigned char * end, MuMIDITrack & track,
+                           uint64_t * ticks, vector<MuTempoChange> & tempoMap)
+{
+    unsigned char status, running = 0;
+    unsigned long delta, len;
+    uint64_t tick = 0;
+
+    while(p < end)
+    {
+        if(!GetVarLength(p, end, delta) || (p >= end))
+            return false;
+        tick += delta;
+
+        // status byte may be omitted (running status)...
+        if(*p & 0x80)
+            status = *p++;
+        else
+            status = running;
+
+        if(status == MIDI_META_EVENT)
+        {
+            if(p >= end)
+                return false;
+            unsigned char type = *p++;
+            if(!GetVarLength(p, end, len) || (len > (unsigned long)(end - p)))
+                return false;
+
+            if((type == MIDI_META_TEMPO) && (len >= 3))
+            {
+                MuTempoChange change;
+                change.tick = tick;
+                change.tempo = GetBigEndian(p, 3);
+                tempoMap.push_back(change);
+            }
+            else if((type == MIDI_META_TRACK_NAME) && track.name.empty())
+            {
+                track.name.assign((const char *)p, len);
+            }
+            else if(type == MIDI_META_END_OF_TRACK)
+            {
+                break;
+            }
+
+            p += len;
+            running = 0;
+        }
+        else if((status == MIDI_SYSEX) || (status == MIDI_SYSEX_ESCAPE))
+        {
+            if(!GetVarLength(p, end, len) || (len > (unsigned long)(end - p)))
+                return false;
+            p += len;
+            running = 0;
+        }
+        else if((status & 0x80) && (status < 0xF0))
+        {
+            // program change and channel aftertouch
+            // have a single data byte...
+            int n = 2;
+            if(((status & 0xF0) == MU_PROGRAM_CHANGE) || ((status & 0xF0) == MU_MONO_AFTERTOUCH))
+                n = 1;
+            if((end - p) < n)
+                return false;
+
+            MuMIDIMessage & msg = track.buffer.data[track.buffer.count];
+            msg.status = status;
+            msg.data1 = p[0] & 0x7F;
+            msg.data2 = (n == 2) ? (p[1] & 0x7F) : 0;
+            msg.time = 0;
+            msg.stamp = 0;
+            ticks[track.buffer.count] = tick;
+            track.buffer.count++;
+
+            p += n;
+            running = status;
+        }
+        else
+        {
+            // no running status or invalid status byte...
+            return false;
+        }
+    }
+
+    return true;
+}
+
+MuError ReadMIDIFile(string fileName, MuMIDITrack * & tracks, long & numTracks)
+{
+    MuError err(MuERROR_NONE);
+    unsigned char * data = NULL;
+    const unsigned char * p;
+    const unsigned char * end;
+    vector<const unsigned char *> chunks;
+    vector<unsigned long> chunkSizes;
+    vector<MuTempoChange> tempoMap;
+    unsigned long headerSize, format, division, size;
+    double secondsPerTick = 0;
+    long i, j, n;
+
+    tracks = NULL;
+    numTracks = 0;
+
+    // read the entire file at once...
+    ifstream input(fileName.c_str(), ios_base::in | ios_base::binary);
+    if(!input)
+    {
+        err.Set(MuERROR_COULDNT_OPEN_INPUT_FILE);
+        return err;
+    }
+    input.seekg(0, ios_base::end);
+    long fileSize = (long)input.tellg();
+    input.seekg(0, ios_base::beg);
+
+    if(fileSize < 14)
+    {
+        err.Set(MuERROR_INVALID_FILE_FORMAT);
+        return err;
+    }
+
+    data = new unsigned char[fileSize];
+    if(!data)
+    {
+        err.Set(MuERROR_INSUF_MEM);
+        return err;
+    }
+    input.read((char *)data, fileSize);
+    input.close();
+
+    // header chunk...
+    headerSize = GetBigEndian(data + 4, 4);
+    format = GetBigEndian(data + 8, 2);
+    n = (long)GetBigEndian(data + 10, 2);
+    division = GetBigEndian(data + 12, 2);
+    if( (memcmp(data, "MThd", 4) != 0) || (headerSize < 6) || (format > 1) ||
+        (division == 0) || ((unsigned long)fileSize < 8 + headerSize) )
+    {
+        delete [] data;
+        err.Set(MuERROR_INVALID_FILE_FORMAT);
+        return err;
+    }
+
+    // SMPTE divisions have a fixed tick length: the upper byte contains
+    // frames per second (negative) and the lower byte ticks per frame...
+    if(division & 0x8000)
+    {
+        int fps = -(signed char)(division >> 8);
+        double frameRate = (fps == 29) ? 29.97 : fps;
+        if(fps <= 0 || (division & 0xFF) == 0)
+        {
+            delete [] data;
+            err.Set(MuERROR_INVALID_FILE_FORMAT);
+            return err;
+        }
+        secondsPerTick = 1.0 / (frameRate * (division & 0xFF));
+    }
+
+    // find track chunks, skipping any unknown chunk types...
+    p = data + 8 + headerSize;
+    end = data + fileSize;
+    while(((long)chunks.size() < n) && ((end - p) >= 8))
+    {
+        size = GetBigEndian(p + 4, 4);
+        if(size > (unsigned long)(end - p - 8))
+            break;
+        if(memcmp(p, "MTrk", 4) == 0)
+        {
+            chunks.push_back(p + 8);
+            chunkSizes.push_back(size);
+        }
+        p += 8 + size;
+    }
+
+    if((long)chunks.size() < n)
+    {
+        delete [] data;
+        err.Set(MuERROR_INVALID_FILE_FORMAT);
+        return err;
+    }
+
+    tracks = new MuMIDITrack[n];
+    uint64_t ** ticks = new uint64_t * [n];
+    for(i = 0; i < n; i++)
+    {
+        // every channel message takes at least two bytes (delta time
+        // and data byte), so this is enough for the whole track...
+        size = (chunkSizes[i] / 2) + 1;
+        tracks[i].buffer.data = new MuMIDIMessage[size];
+        tracks[i].buffer.max = size;
+        tracks[i].buffer.count = 0;
+        ticks[i] = new uint64_t[size];
+
+        if(!ParseMIDITrack(chunks[i], chunks[i] + chunkSizes[i], tracks[i], ticks[i], tempoMap))
+            err.Set(MuERROR_INVALID_FILE_FORMAT);
+    }
+
+    if(err.Get() == MuERROR_NONE)
+    {
+        // tempo changes may come from any track, so they need to be
+        // sorted; tempo maps are small and usually already in order...
+        for(i = 1; i < (long)tempoMap.size(); i++)
+        {
+            MuTempoChange change = tempoMap[i];
+            for(j = i - 1; (j >= 0) && (tempoMap[j].tick > change.tick); j--)
+                tempoMap[j+1] = tempoMap[j];
+            tempoMap[j+1] = change;
+        }
+
+        // convert ticks to seconds, walking the tempo map along each track...
+        for(i = 0; i < n; i++)
+        {
+            double seconds = 0;
+            uint64_t lastTick = 0;
+            unsigned long next = 0;
+            double spt = secondsPerTick;
+
+            if(!(division & 0x8000))
+                spt = (MIDI_FILE_DEFAULT_TEMPO * 1e-6) / division;
+
+            for(j = 0; j < tracks[i].buffer.count; j++)
+            {
+                uint64_t tick = ticks[i][j];
+                if(!(division & 0x8000))
+                {
+                    while((next < tempoMap.size()) && (tempoMap[next].tick <= tick))
+                    {
+                        seconds += (tempoMap[next].tick - lastTick) * spt;
+                        lastTick = tempoMap[next].tick;
+                        spt = (tempoMap[next].tempo * 1e-6) / division;
+                        next++;
+                    }
+                }
+                double t = seconds + ((tick - lastTick) * spt);
+                tracks[i].buffer.data[j].time = (float)t;
+                tracks[i].buffer.data[j].stamp = TimeToNanoStamp(t);
+            }
+        }
+    }
+
+    for(i = 0; i < n; i++)
+        delete [] ticks[i];
+    delete [] ticks;
+    delete [] data;
+
+    if(err.Get() != MuERROR_NONE)
+    {
+        ReleaseMIDITracks(tracks, n);
+        tracks = NULL;
+        n = 0;
+    }
+
+    numTracks = n;
+    return err;
+}
+
+void ReleaseMIDITracks(MuMIDITrack * tracks, long numTracks)
+{
+    if(tracks)
+    {
+        for(long i = 0; i < numTracks; i++)
+        {
+            if(tracks[i].buffer.data)
+                delete [] tracks[i].buffer.data;
+        }
+        delete [] tracks;
+    }
+}
+
+MuError WriteMIDIFile(string fileName, MuMIDITrack * tracks, long numTracks)
+{
+    MuError err(MuERROR_NONE);
+    unsigned char * data;
+    unsigned char * p;
+    unsigned char * trackStart;
+    unsigned long size;
+    long i, j;
+
+    // find the largest size the file may have: header, conductor track
+    // (tempo and end of track) and every other track, where each message
+    // takes at most 4 bytes of delta time and 3 bytes of data...
+    size = 14 + (8 + 7 + 4);
+    for(i = 0; i < numTracks; i++)
+    {
+        size += 8 + 4;
+        if(!tracks[i].name.empty())
+            size += 7 + tracks[i].name.size();
+        if(tracks[i].buffer.data)
+            size += tracks[i].buffer.count * 7;
+    }
+
+    data = new unsigned char[size];
+    if(!data)
+    {
+        err.Set(MuERROR_INSUF_MEM);
+        return err;
+    }
+
+    // header chunk...
+    p = data;
+    memcpy(p, "MThd", 4);
+    p += 4;
+    PutBigEndian(p, 6, 4);
+    PutBigEndian(p, 1, 2);
+    PutBigEndian(p, numTracks + 1, 2);
+    PutBigEndian(p, MIDI_FILE_DIVISION, 2);
+
+    // conductor track...
+    memcpy(p, "MTrk", 4);
+    p += 4;
+    PutBigEndian(p, 11, 4);
+    *p++ = 0;
+    *p++ = MIDI_META_EVENT;
+    *p++ = MIDI_META_TEMPO;
+    *p++ = 3;
+    PutBigEndian(p, MIDI_FILE_DEFAULT_TEMPO, 3);
+    *p++ = 0;
+    *p++ = MIDI_META_EVENT;
+    *p++ = MIDI_META_END_OF_TRACK;
+    *p++ = 0;
+
+    for(i = 0; i < numTracks; i++)
+    {
+        MuMIDIBuffer & buffer = tracks[i].buffer;
+        unsigned char running = 0;
+        uint64_t lastTick = 0;
+
+        // track length is filled in after the events...
+        trackStart = p;
+        memcpy(p, "MTrk", 4);
+        p += 8;
+
+        if(!tracks[i].name.empty())
+        {
+            unsigned long len = tracks[i].name.size();
+            if(len > 0xFFFF)
+                len = 0xFFFF;
+            *p++ = 0;
+            *p++ = MIDI_META_EVENT;
+            *p++ = MIDI_META_TRACK_NAME;
+            PutVarLength(p, len);
+            memcpy(p, tracks[i].name.c_str(), len);
+            p += len;
+        }
+
+        for(j = 0; (buffer.data != NULL) && (j < buffer.count); j++)
+        {
+            const MuMIDIMessage & msg = buffer.data[j];
+            uint64_t tick = 0;
+
+            // skip anything which is not a channel message...
+            if(((msg.status & 0x80) == 0) || (msg.status >= 0xF0))
+                continue;
+
+            if(msg.time > 0)
+                tick = (uint64_t)((msg.time * MIDI_FILE_TICKS_PER_SECOND) + 0.5);
+            if(tick < lastTick)
+                tick = lastTick;
+            PutVarLength(p, (unsigned long)(tick - lastTick));
+            lastTick = tick;
+
+            if(msg.status != running)
+            {
+                *p++ = msg.status;
+                running = msg.status;
+            }
+            *p++ = msg.data1 & 0x7F;
+            if(((msg.status & 0xF0) != MU_PROGRAM_CHANGE) && ((msg.status & 0xF0) != MU_MONO_AFTERTOUCH))
+                *p++ = msg.data2 & 0x7F;
+        }
+
+        *p++ = 0;
+        *p++ = MIDI_META_EVENT;
+        *p++ = MIDI_META_END_OF_TRACK;
+        *p++ = 0;
+
+        unsigned char * lenField = trackStart + 4;
+        PutBigEndian(lenField, (unsigned long)(p - trackStart - 8), 4);
+    }
+
+    ofstream output(fileName.c_str(), ios_base::out | ios_base::trunc | ios_base::binary);
+    if(output)
+    {
+        output.write((char *)data, p - data);
+        if(!output)
+            err.Set(MuERROR_COULDNT_OPEN_OUTPUT_FILE);
+        output.close();
+    }
+    else
+    {
+        err.Set(MuERROR_COULDNT_OPEN_OUTPUT_FILE);
+    }
+
+    delete [] data;
+    return err;
+}
@@ -0,0 +1,124 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuMIDIFile.h
+ *
+ * @brief Standard MIDI File support
+ *
+ * @author Carlos Eduardo Mello
+ * @date 10/18/2026
+ *
+ * @details
+ * This file declares the functions used by MuM to read and write
+ * Standard MIDI Files (SMF). A MIDI file is read entirely into memory and each of its
+ * tracks is parsed into a MIDI buffer (see MuMIDI.h), with delta times
+ * already converted to seconds according to the file's time division
+ * and tempo map. Only channel messages are kept in the buffers; meta
+ * events and system exclusive messages are used during parsing (tempo,
+ * track names) and then discarded.
+ *
+ * MIDI files are written as type 1 files, at a fixed tempo of 120 bpm
+ * and 480 ticks per quarter note, with a conductor track containing the
+ * tempo, followed by one track for each MIDI buffer provided by calling
+ * code. The whole file is built in a single pre-sized memory block and
+ * written at once. Channel messages are written with running status.
+ *
+ * These functions work at the MIDI message level. In order to turn a
+ * MIDI file into notes, or notes into a MIDI file, see
+ * MuMaterial::LoadMIDIFile() and MuMaterial::SaveMIDIFile().
+ *
+ **/
+
+#ifndef MuMIDIFile_H
+#define MuMIDIFile_H
+
+#include "MuError.h"
+#include "MuMIDI.h"
+
+using namespace std;
+
+/**
+ * @brief MIDI Track structure
+ *
+ * @details
+ * MuMIDITrack holds the contents of one track from a MIDI file: a MIDI
+ * buffer containing the track's channel messages, in time order, with
+ * time stamps in seconds, and the track name, if the file contains one.
+ * The buffer is dynamically allocated and must be released by calling
+ * code (see ReleaseMIDITracks()).
+ **/
+struct MuMIDITrack
+{
+    //! @brief channel messages in this track
+    MuMIDIBuffer buffer;
+    //! @brief track name (empty if the track has no name)
+    string name;
+};
+typedef struct MuMIDITrack MuMIDITrack;
+
+/**
+ * @brief reads a Standard MIDI File
+ *
+ * @details
+ * ReadMIDIFile() reads MIDI file 'fileName', of type 0 or 1, and
+ * returns its tracks in a newly allocated array. Tempo changes found
+ * in any track apply to every track, as required by the SMF
+ * specification, and both metrical (ticks per quarter note) and SMPTE
+ * time divisions are supported.
+ *
+ * If the file cannot be opened, ReadMIDIFile() returns
+ * MuERROR_COULDNT_OPEN_INPUT_FILE; if it is not a valid MIDI file, or
+ * if it is a type 2 file, it returns MuERROR_INVALID_FILE_FORMAT. In
+ * both cases 'tracks' is set to NULL and 'numTracks' to zero.
+ *
+ * @param fileName (string) - path to MIDI file
+ * @param tracks (MuMIDITrack * &) - receives the array of tracks
+ * @param numTracks (long &) - receives the number of tracks
+ *
+ * @return
+ * MuError - error code
+ **/
+MuError ReadMIDIFile(string fileName, MuMIDITrack * & tracks, long & numTracks);
+
+/**
+ * @brief releases an array of MIDI tracks
+ *
+ * @details
+ * ReleaseMIDITracks() frees the MIDI buffer in every track and then
+ * the array itself.
+ *
+ * @param tracks (MuMIDITrack *) - track array
+ * @param numTracks (long) - number of tracks in array
+ *
+ **/
+void ReleaseMIDITracks(MuMIDITrack * tracks, long numTracks);
+
+/**
+ * @brief writes a Standard MIDI File
+ *
+ * @details
+ * WriteMIDIFile() creates a type 1 MIDI file containing a conductor
+ * track and the 'numTracks' tracks in 'tracks'. Each track's buffer must
+ * contain channel messages in time order, with time stamps in seconds;
+ * messages with negative time stamps are written at time zero. Track
+ * names, when present, are written as track name meta events.
+ *
+ * If the file cannot be written, WriteMIDIFile() returns
+ * MuERROR_COULDNT_OPEN_OUTPUT_FILE.
+ *
+ * @param fileName (string) - path to MIDI file
+ * @param tracks (MuMIDITrack *) - tracks to be written
+ * @param numTracks (long) - number of tracks
+ *
+ * @return
+ * MuError - error code
+ **/
+MuError WriteMIDIFile(string fileName, MuMIDITrack * tracks, long numTracks);
+
+#endif /* MuMIDIFile_H */
@@ -0,0 +1,171 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuMIDISink.cpp
+ *
+ * @brief MIDI Sink Classes Implementation
+ *
+ * @author Carlos Eduardo Mello
+ * @date 10/18/2026
+ *
+ **/
+
+#include "MuMIDISink.h"
+
+// initial number of events in a memory sink...
+const long INITIAL_SINK_EVENTS = 1024;
+
+MuMIDISink::~MuMIDISink(void)
+{
+}
+
+void MuMIDISink::Flush(void)
+{
+}
+
+int MuMIDISink::MessageLength(unsigned char status)
+{
+    // program change and channel pressure have a single data byte...
+    unsigned char type = status & 0xF0;
+    if((type == MU_PROGRAM_CHANGE) || (type == MU_MONO_AFTERTOUCH))
+        return 2;
+    return 3;
+}
+
+MuMemorySink::MuMemorySink(void)
+{
+    events = NULL;
+    numEvents = 0;
+    maxEvents = 0;
+    pthread_mutex_init(&lock, NULL);
+}
+
+MuMemorySink::~MuMemorySink(void)
+{
+    delete [] events;
+    pthread_mutex_destroy(&lock);
+}
+
+bool MuMemorySink::Grow(long newMax)
+{
+    long i;
+
+    // called with the lock held...
+    MuSinkEvent * temp = new MuSinkEvent[newMax];
+    if(temp == NULL)
+        return false;
+    for(i = 0; i < numEvents; i++)
+        temp[i] = events[i];
+    delete [] events;
+    events = temp;
+    maxEvents = newMax;
+    return true;
+}
+
+void MuMemorySink::Send(const MuMIDIMessage & msg, long long due)
+{
+    long long now = NanoClockStamp();
+
+    pthread_mutex_lock(&lock);
+    if((numEvents < maxEvents) || Grow((maxEvents > 0) ? (maxEvents * 2) : INITIAL_SINK_EVENTS))
+    {
+        MuSinkEvent & event = events[numEvents++];
+        event.msg = msg;
+        event.due = due;
+        event.sent = now;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+bool MuMemorySink::Reserve(long numEvents)
+{
+    bool ok = true;
+
+    pthread_mutex_lock(&lock);
+    if(numEvents > maxEvents)
+        ok = Grow(numEvents);
+    pthread_mutex_unlock(&lock);
+
+    return ok;
+}
+
+long MuMemorySink::NumberOfEvents(void)
+{
+    long n;
+
+    pthread_mutex_lock(&lock);
+    n = numEvents;
+    pthread_mutex_unlock(&lock);
+
+    return n;
+}
+
+bool MuMemorySink::GetEvent(long num, MuSinkEvent & event)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&lock);
+    if((num >= 0) && (num < numEvents))
+    {
+        event = events[num];
+        found = true;
+    }
+    pthread_mutex_unlock(&lock);
+
+    return found;
+}
+
+void MuMemorySink::Clear(void)
+{
+    pthread_mutex_lock(&lock);
+    numEvents = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+MuFileSink::MuFileSink(void)
+{
+}
+
+MuFileSink::~MuFileSink(void)
+{
+    Close();
+}
+
+bool MuFileSink::Open(string fileName)
+{
+    Close();
+    output.open(fileName.c_str(), ios_base::out | ios_base::trunc | ios_base::binary);
+    return output.is_open();
+}
+
+void MuFileSink::Close(void)
+{
+    if(output.is_open())
+        output.close();
+    output.clear();
+}
+
+void MuFileSink::Send(const MuMIDIMessage & msg, long long /*due*/)
+{
+    char bytes[3];
+
+    if(output.is_open())
+    {
+        bytes[0] = (char)msg.status;
+        bytes[1] = (char)msg.data1;
+        bytes[2] = (char)msg.data2;
+        output.write(bytes, MessageLength(msg.status));
+    }
+}
+
+void MuFileSink::Flush(void)
+{
+    if(output.is_open())
+        output.flush();
+}
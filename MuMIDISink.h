@@ -0,0 +1,353 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuMIDISink.h
+ *
+ * @brief MIDI Sink Classes Interface
+ *
+ * @author Carlos Eduardo Mello
+ * @date 10/18/2026
+ *
+ * @details
+ * This file declares MuMIDISink, the interface through which MuPlayer
+ * can deliver MIDI messages to destinations other than the system's
+ * MIDI ports, and two sinks which come with MuM: MuMemorySink, which
+ * captures every message with its times, and MuFileSink, which writes
+ * raw MIDI bytes to a file.
+ *
+ **/
+
+#ifndef MU_MIDI_SINK_H
+#define MU_MIDI_SINK_H
+
+#include <pthread.h>
+#include <fstream>
+#include <string>
+#include "MuUtil.h"
+#include "MuMIDI.h"
+
+using namespace std;
+
+/**
+ * @class MuMIDISink
+ *
+ * @brief MIDI Output Interface
+ *
+ * @details
+ *
+ * MuMIDISink is the base class for objects which receive the MIDI
+ * messages sent by MuPlayer's scheduler (see MuPlayer::SetOutputSink()
+ * and MuPlayer::Init(MuMIDISink *)). Normally the player sends its
+ * messages to a MIDI port, through CoreMIDI or RtMidi; when a sink is
+ * installed, every message goes to the sink instead. This allows
+ * playback to be captured, written to disk or measured on machines
+ * which have no MIDI ports at all.
+ *
+ * Derived classes implement Send(), which is called by the scheduler
+ * thread for every message at the moment it is due, and may implement
+ * Flush(), which is called after each group of messages sent together.
+ * Both run in the scheduler's time-critical path, so they should return
+ * quickly and avoid allocating memory.
+ *
+ * Sinks are owned by calling code and must outlive their use by the
+ * player.
+ *
+ **/
+class MuMIDISink
+{
+    public:
+
+    /**
+     * @brief Destructor
+     *
+     **/
+    virtual ~MuMIDISink(void);
+
+    /**
+     * @brief delivers a MIDI message
+     *
+     * @details
+     * Send() is called by the scheduler thread for each message it
+     * plays. 'msg' holds the message as stored in its queue (so its
+     * time stamp is relative to the start of the queue); 'due' is the
+     * moment it was scheduled for, on the clock used by NanoClockStamp().
+     *
+     * @param
+     * msg (const MuMIDIMessage &) - message to be delivered
+     *
+     * @param
+     * due (long long) - scheduled time, in nanoseconds
+     *
+     * @return
+     * void
+     *
+     **/
+    virtual void Send(const MuMIDIMessage & msg, long long due) = 0;
+
+    /**
+     * @brief completes delivery of the messages sent so far
+     *
+     * @details
+     * Flush() is called by the scheduler after each group of messages
+     * which were due at the same time. The default implementation does
+     * nothing.
+     *
+     * @return
+     * void
+     *
+     **/
+    virtual void Flush(void);
+
+    /**
+     * @brief returns the number of bytes in a MIDI message
+     *
+     * @details
+     * MessageLength() returns 2 for program changes and channel
+     * pressure messages, and 3 for every other channel message.
+     *
+     * @param
+     * status (unsigned char) - message's status byte
+     *
+     * @return
+     * int - number of bytes
+     *
+     **/
+    static int MessageLength(unsigned char status);
+};
+
+/**
+ * @brief Captured Event structure
+ *
+ * @details
+ * MuSinkEvent holds a message captured by MuMemorySink, the time it
+ * was scheduled for and the time it was actually delivered, both in
+ * nanoseconds on the clock used by NanoClockStamp().
+ **/
+struct MuSinkEvent
+{
+    //! @brief captured message (its stamp is relative to the start of its queue)
+    MuMIDIMessage msg;
+    //! @brief scheduled time
+    long long due;
+    //! @brief time of delivery
+    long long sent;
+};
+typedef struct MuSinkEvent MuSinkEvent;
+
+/**
+ * @class MuMemorySink
+ *
+ * @brief In-Memory MIDI Sink
+ *
+ * @details
+ *
+ * MuMemorySink stores every message it receives, along with the time
+ * it was scheduled for and the time it was received (see MuSinkEvent).
+ * It is meant for tests and benchmarks: after playing materials into
+ * a memory sink, calling code can check exactly which messages were
+ * sent, in which order, and how late each of them was.
+ *
+ * The captured events may be read while the player is still sending
+ * messages. Storage doubles in size when it is full; Reserve() may be
+ * called beforehand so that no memory is allocated during playback,
+ * which would disturb the timing being measured.
+ *
+ **/
+class MuMemorySink : public MuMIDISink
+{
+    private:
+
+    MuSinkEvent * events;
+    long numEvents;
+    long maxEvents;
+    pthread_mutex_t lock;
+
+    bool Grow(long newMax);
+
+    public:
+
+    /**
+     * @brief Default Constructor
+     *
+     * @details
+     * Creates an empty sink.
+     *
+     **/
+    MuMemorySink(void);
+
+    /**
+     * @brief Destructor
+     *
+     * @details
+     * Releases the captured events.
+     *
+     **/
+    ~MuMemorySink(void);
+
+    /**
+     * @brief captures a MIDI message
+     *
+     * @details
+     * Send() stores 'msg' with its scheduled time and the current
+     * time. If memory cannot be allocated, the message is dropped.
+     *
+     * @param
+     * msg (const MuMIDIMessage &) - message to be captured
+     *
+     * @param
+     * due (long long) - scheduled time, in nanoseconds
+     *
+     * @return
+     * void
+     *
+     **/
+    void Send(const MuMIDIMessage & msg, long long due);
+
+    /**
+     * @brief preallocates room for events
+     *
+     * @param
+     * numEvents (long) - number of events the sink should hold
+     * without allocating memory
+     *
+     * @return
+     * bool - false if memory could not be allocated
+     *
+     **/
+    bool Reserve(long numEvents);
+
+    /**
+     * @brief returns the number of captured events
+     *
+     * @return
+     * long - number of events
+     *
+     **/
+    long NumberOfEvents(void);
+
+    /**
+     * @brief returns a captured event
+     *
+     * @param
+     * num (long) - index of the event, in order of arrival
+     *
+     * @param
+     * event (MuSinkEvent &) - receives the event
+     *
+     * @return
+     * bool - false if 'num' is out of range
+     *
+     **/
+    bool GetEvent(long num, MuSinkEvent & event);
+
+    /**
+     * @brief discards the captured events
+     *
+     * @details
+     * Clear() empties the sink. Its storage is kept for reuse.
+     *
+     * @return
+     * void
+     *
+     **/
+    void Clear(void);
+};
+
+/**
+ * @class MuFileSink
+ *
+ * @brief Raw File MIDI Sink
+ *
+ * @details
+ *
+ * MuFileSink writes the bytes of every message it receives to a file,
+ * in order of arrival, without time information, as they would travel
+ * on a MIDI cable. It can record the output of a session for later
+ * comparison, or send it to a raw MIDI device which can be opened as a
+ * file. Output is flushed after each group of messages sent together.
+ *
+ **/
+class MuFileSink : public MuMIDISink
+{
+    private:
+
+    ofstream output;
+
+    public:
+
+    /**
+     * @brief Default Constructor
+     *
+     * @details
+     * Creates a sink with no file. Messages are discarded until a file
+     * is opened.
+     *
+     **/
+    MuFileSink(void);
+
+    /**
+     * @brief Destructor
+     *
+     * @details
+     * Closes the file, if open.
+     *
+     **/
+    ~MuFileSink(void);
+
+    /**
+     * @brief opens the output file
+     *
+     * @details
+     * Open() creates (or truncates) the file named 'fileName' and
+     * directs every message to it, closing any file opened before.
+     *
+     * @param
+     * fileName (string) - path to the output file
+     *
+     * @return
+     * bool - false if the file could not be opened
+     *
+     **/
+    bool Open(string fileName);
+
+    /**
+     * @brief closes the output file
+     *
+     * @return
+     * void
+     *
+     **/
+    void Close(void);
+
+    /**
+     * @brief writes a MIDI message to the file
+     *
+     * @param
+     * msg (const MuMIDIMessage &) - message to be written
+     *
+     * @param
+     * due (long long) - scheduled time (not used)
+     *
+     * @return
+     * void
+     *
+     **/
+    void Send(const MuMIDIMessage & msg, long long due);
+
+    /**
+     * @brief flushes the output file
+     *
+     * @return
+     * void
+     *
+     **/
+    void Flush(void);
+};
+
+#endif /* MU_MIDI_SINK_H */
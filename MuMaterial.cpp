@@ -20,6 +20,10 @@
 
 
 #include "MuMaterial.h"
+#include "MuCodec.h"
+#include "MuMIDIFile.h"
+#include <stdint.h>
+#include <string.h>
 
 // Constructors
 string MuMaterial::orchestra;
@@ -1047,6 +1051,21 @@ MuNote MuMaterial::GetNote(int voiceNumber, long noteNumber)	// [PUBLIC]
     return theNote;
 }
 
+void MuMaterial::CopyNotes(int voiceNumber, MuNote * outNotes, long n)	// [PUBLIC]
+{
+	lastError.Set(MuERROR_NONE);
+
+	if(voices != NULL)
+	{
+		if((voiceNumber < numOfVoices) && (voiceNumber >= 0))
+			lastError.Set( voices[voiceNumber].CopyNotes(outNotes, n) );
+		else
+			lastError.Set(MuERROR_INVALID_VOICE_NUMBER);
+	}
+	else
+		lastError.Set(MuERROR_MATERIAL_IS_EMPTY);
+}
+
 MuNote MuMaterial::GetFirstNote( void )
 {
 	lastError.Set(MuERROR_NONE);
@@ -1396,6 +1415,54 @@ void MuMaterial::AddNote(int voiceNumber, MuNote inNote)	// [PUBLIC]
 	}
 }
 
+void MuMaterial::AddNotes(int voiceNumber, MuNote * inNotes, long n)	// [PUBLIC]
+{
+    // no mark: the voice decides where merging starts...
+    MuNoteMark none;
+    none.note = NULL;
+    none.version = 0;
+    AddNotes(voiceNumber, inNotes, n, none);
+}
+
+void MuMaterial::AddNotes(int voiceNumber, MuNote * inNotes, long n, MuNoteMark from)	// [PUBLIC]
+{
+    lastError.Set(MuERROR_NONE);
+    
+    if(voiceNumber < 0)
+    {
+        lastError.Set(MuERROR_INVALID_VOICE_NUMBER);
+        return;
+    }
+    
+    if((inNotes == NULL) || (n <= 0))
+        return;
+    
+    // add necessary voices...
+    if(voiceNumber >= numOfVoices)
+    {
+        AddVoices(voiceNumber - numOfVoices + 1);
+        if(lastError.Get() != MuERROR_NONE)
+            return;
+    }
+    
+    lastError.Set( voices[voiceNumber].AddNotes(inNotes, n, from) );
+}
+
+MuNoteMark MuMaterial::MarkVoiceEnd(int voiceNumber)	// [PUBLIC]
+{
+    MuNoteMark mark;
+    mark.note = NULL;
+    mark.version = 0;
+    lastError.Set(MuERROR_NONE);
+    
+    if((voiceNumber >= 0) && (voiceNumber < numOfVoices))
+        mark = voices[voiceNumber].Mark();
+    else
+        lastError.Set(MuERROR_INVALID_VOICE_NUMBER);
+    
+    return mark;
+}
+
 
 void MuMaterial::RemoveNote(long noteNumber)	// [PUBLIC]
 {
@@ -3364,124 +3431,938 @@ void MuMaterial::LoadScore(string fileName, short mode)    // [PUBLIC]
 }
 
 
+// MIDI NOTE PAIRING ==============================
+
+// Notes found in a stream of MIDI messages, grouped by channel. All notes
+// share one array: notes for channel 'c' are found at data[first[c]], in
+// the order of their noteOn events. 'instr' contains the instrument
+// selected by the first program change found for each channel (program + 1),
+// or 0 if the channel had no program changes...
+struct MuMIDINoteSet
+{
+    MuNote * data;
+    long first[16];
+    long count[16];
+    uShort instr[16];
+};
+
+// Pairs noteOns and noteOffs in a stream of MIDI messages (in time order)
+// with a single pass, keeping a queue of open notes for every channel and
+// pitch, so each noteOff terminates the oldest open note with the same
+// channel and pitch. Unterminated notes are treated according to 'mode'
+// (see MuMaterial::LoadMIDIBuffer()). Calling code must release 'set.data'...
+static MuError PairMIDINotes(const MuMIDIMessage * msgs, long n, short mode, MuMIDINoteSet & set)
+{
+    MuError err(MuERROR_NONE);
+    long head[16][128];
+    long tail[16][128];
+    long filled[16];
+    uShort program[16];
+    long * nextOpen;
+    bool * closed;
+    long i, c, k, total = 0;
+    float lastEnd = 0;
+
+    set.data = NULL;
+    for(c = 0; c < 16; c++)
+    {
+        set.first[c] = 0;
+        set.count[c] = 0;
+        set.instr[c] = 0;
+        program[c] = 0;
+        filled[c] = 0;
+    }
+
+    // count noteOns so every channel gets its slice of the note array...
+    for(i = 0; i < n; i++)
+        if(((msgs[i].status & 0xF0) == MU_NOTE_ON) && (msgs[i].data2 != 0))
+            set.count[msgs[i].status & 0x0F]++;
+    for(c = 0; c < 16; c++)
+    {
+        set.first[c] = total;
+        total += set.count[c];
+    }
+    if(total == 0)
+        return err;
+
+    set.data = new MuNote[total];
+    nextOpen = new long[total];
+    closed = new bool[total];
+    if(!set.data || !nextOpen || !closed)
+    {
+        delete [] set.data;
+        delete [] nextOpen;
+        delete [] closed;
+        set.data = NULL;
+        err.Set(MuERROR_INSUF_MEM);
+        return err;
+    }
+
+    for(c = 0; c < 16; c++)
+        for(k = 0; k < 128; k++)
+            head[c][k] = tail[c][k] = -1;
+
+    for(i = 0; i < n; i++)
+    {
+        const MuMIDIMessage & msg = msgs[i];
+        unsigned char type = msg.status & 0xF0;
+        c = msg.status & 0x0F;
+        k = msg.data1 & 0x7F;
+
+        if((type == MU_NOTE_ON) && (msg.data2 != 0))
+        {
+            // start a new note and place it at the end of the open queue...
+            long slot = set.first[c] + filled[c]++;
+            MuNote & note = set.data[slot];
+            note.SetStart(msg.time);
+            note.SetPitch(msg.data1);
+            note.SetAmp(msg.data2/128.0);
+            note.SetInstr((program[c] != 0) ? program[c] : (c + 1));
+            note.SetDur(0);
+            closed[slot] = false;
+            nextOpen[slot] = -1;
+            if(tail[c][k] >= 0)
+                nextOpen[tail[c][k]] = slot;
+            else
+                head[c][k] = slot;
+            tail[c][k] = slot;
+        }
+        else if((type == MU_NOTE_OFF) || (type == MU_NOTE_ON))
+        {
+            // terminate the oldest open note for this pitch, if any...
+            long slot = head[c][k];
+            if(slot >= 0)
+            {
+                set.data[slot].SetDur(msg.time - set.data[slot].Start());
+                closed[slot] = true;
+                head[c][k] = nextOpen[slot];
+                if(head[c][k] < 0)
+                    tail[c][k] = -1;
+                if(msg.time > lastEnd)
+                    lastEnd = msg.time;
+            }
+        }
+        else if(type == MU_PROGRAM_CHANGE)
+        {
+            program[c] = msg.data1 + 1;
+            if(set.instr[c] == 0)
+                set.instr[c] = program[c];
+        }
+    }
+
+    // unterminated notes also count for the end of the material...
+    for(i = 0; i < total; i++)
+        if(!closed[i] && (set.data[i].Start() > lastEnd))
+            lastEnd = set.data[i].Start();
+
+    for(c = 0; c < 16; c++)
+    {
+        MuNote * notes = set.data + set.first[c];
+        long num = set.count[c];
+        bool * done = closed + set.first[c];
+        float nextStart = 0;
+        bool hasNext = false;
+
+        // in melodic mode, unterminated notes last until the next
+        // note (in the same channel) which starts after them...
+        if(mode == MIDI_BUFFER_MODE_MELODIC)
+        {
+            for(i = num - 1; i >= 0; i--)
+            {
+                float start = notes[i].Start();
+                if(!done[i] && hasNext)
+                {
+                    notes[i].SetDur(nextStart - start);
+                    done[i] = true;
+                }
+                if((i > 0) && (notes[i-1].Start() < start))
+                {
+                    nextStart = start;
+                    hasNext = true;
+                }
+            }
+        }
+
+        // in extend mode, they last until the end of the material...
+        if(mode == MIDI_BUFFER_MODE_EXTEND)
+        {
+            for(i = 0; i < num; i++)
+            {
+                if(!done[i] && (lastEnd > notes[i].Start()))
+                {
+                    notes[i].SetDur(lastEnd - notes[i].Start());
+                    done[i] = true;
+                }
+            }
+        }
+
+        // anything still unterminated is purged...
+        k = 0;
+        for(i = 0; i < num; i++)
+        {
+            if(done[i])
+            {
+                if(k != i)
+                    notes[k] = notes[i];
+                k++;
+            }
+        }
+        set.count[c] = k;
+    }
+
+    delete [] nextOpen;
+    delete [] closed;
+    return err;
+}
+
 // populates the receiving material with data from a MIDI buffer...
 void MuMaterial::LoadMIDIBuffer(MuMIDIBuffer inBuffer, short mode)
 {
     lastError.Set(MuERROR_NONE);
-    long i,j,n;
-    MuNote note;
-    MuMIDIMessage firstEvent,secondEvent;
-    bool foundNote = false;
+    MuError err(MuERROR_NONE);
+    MuMIDINoteSet set;
+    int c, v, numVoices = 0;
     
-    // Go through every noteOn event, comparing it to the remaining
-    // events, until we find a suitable note termination...
-    n = inBuffer.count;
-    for(i = 0; i < n; i++)
+    if((inBuffer.data == NULL) || (inBuffer.count <= 0))
+        return;
+    
+    // pair noteOns and noteOffs in a single pass...
+    err = PairMIDINotes(inBuffer.data, inBuffer.count, mode, set);
+    if(err.Get() != MuERROR_NONE)
     {
-        firstEvent = inBuffer.data[i];
-        foundNote = false;
-        
-        // if this is a noteOn event and key velocity is not zero...
-        if( ( (firstEvent.status & 0xF0) == 0x90) && (firstEvent.data2 != 0) )
+        lastError.Set(err);
+        return;
+    }
+    
+    // then add one voice for each channel found in the buffer
+    // and place the channel's notes there all at once...
+    for(c = 0; c < 16; c++)
+        if(set.count[c] > 0)
+            numVoices++;
+    
+    if(numVoices > 0)
+    {
+        v = NumberOfVoices();
+        AddVoices(numVoices);
+        for(c = 0; (c < 16) && (lastError.Get() == MuERROR_NONE); c++)
+        {
+            if(set.count[c] == 0)
+                continue;
+            
+            voices[v].SetChannelNumber(c + 1);
+            err = voices[v].AddNotes(set.data + set.first[c], set.count[c]);
+            if(err.Get() != MuERROR_NONE)
+                lastError.Set(err);
+            v++;
+        }
+    }
+    
+    delete [] set.data;
+}
+
+void MuMaterial::LoadMIDIFile(string fileName, short mode)
+{
+    lastError.Set(MuERROR_NONE);
+    MuError err(MuERROR_NONE);
+    MuMIDITrack * tracks;
+    MuMIDINoteSet * sets;
+    long numTracks, i;
+    int c, v, numVoices = 0;
+    
+    Clear();
+    
+    err = ReadMIDIFile(fileName, tracks, numTracks);
+    if(err.Get() != MuERROR_NONE)
+    {
+        lastError.Set(err);
+        return;
+    }
+    
+    // pair notes in every track first, so we know
+    // how many voices will be needed...
+    sets = new MuMIDINoteSet[numTracks];
+    for(i = 0; i < numTracks; i++)
+    {
+        err = PairMIDINotes(tracks[i].buffer.data, tracks[i].buffer.count, mode, sets[i]);
+        if(err.Get() != MuERROR_NONE)
+            lastError.Set(err);
+        for(c = 0; c < 16; c++)
+            if(sets[i].count[c] > 0)
+                numVoices++;
+    }
+    
+    // one voice for each channel used in each track...
+    if((numVoices > 0) && (lastError.Get() == MuERROR_NONE))
+    {
+        AddVoices(numVoices);
+        v = 0;
+        for(i = 0; (i < numTracks) && (lastError.Get() == MuERROR_NONE); i++)
         {
-            // we look ahead for its corresponding noteOff event...
-            for(j = i+1; j < n; j++)
+            for(c = 0; c < 16; c++)
             {
-                secondEvent = inBuffer.data[j];
+                if(sets[i].count[c] == 0)
+                    continue;
                 
-                // if next event is for the same channel and same pitch...
-                if(((firstEvent.status & 0x0F) == (secondEvent.status & 0x0F)) &&
-                   (firstEvent.data1 == secondEvent.data1) )
+                voices[v].SetChannelNumber(c + 1);
+                if(sets[i].instr[c] != 0)
+                    voices[v].SetInstrumentNumber(sets[i].instr[c]);
+                voices[v].SetVoiceName(tracks[i].name);
+                err = voices[v].AddNotes(sets[i].data + sets[i].first[c], sets[i].count[c]);
+                if(err.Get() != MuERROR_NONE)
                 {
-                    // if this is a noteOff for the same pitch...
-                    if( ((secondEvent.status & 0xF0) == 0x80) ||
-                       // or if it is a noteOn and key velocity is 0...
-                       (((secondEvent.status & 0xF0) == 0x90) && (secondEvent.data2 == 0))
-                       )
-                    {
-                        // we store the complete note...
-                        note.SetFromMIDI(firstEvent, secondEvent);
-                        AddNote(note);
-                        note.Clear();
-                        // if we found a complete note, we skip the inner loop
-                        // and move on to the next noteOn...
-                        foundNote = true;
-                        break;
-                    }
+                    lastError.Set(err);
+                    break;
                 }
+                v++;
+            }
+        }
+    }
+    
+    for(i = 0; i < numTracks; i++)
+        delete [] sets[i].data;
+    delete [] sets;
+    ReleaseMIDITracks(tracks, numTracks);
+}
+
+// Pushes a noteOff message into a min-heap ordered by time...
+static void PushNoteOff(MuMIDIMessage * heap, long & n, MuMIDIMessage msg)
+{
+    long i = n++;
+    while(i > 0)
+    {
+        long parent = (i - 1) / 2;
+        if(heap[parent].time <= msg.time)
+            break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = msg;
+}
+
+// Removes the earliest noteOff message from the heap...
+static MuMIDIMessage PopNoteOff(MuMIDIMessage * heap, long & n)
+{
+    MuMIDIMessage top = heap[0];
+    MuMIDIMessage last = heap[--n];
+    long i = 0;
+    while(true)
+    {
+        long child = (2 * i) + 1;
+        if(child >= n)
+            break;
+        if((child + 1 < n) && (heap[child + 1].time < heap[child].time))
+            child++;
+        if(last.time <= heap[child].time)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if(n > 0)
+        heap[i] = last;
+    return top;
+}
+
+// Converts notes (in start order) into time ordered MIDI messages on 'channel'
+// (zero based). Pending noteOffs are kept in a heap, so each message is placed
+// in order as it is generated; noteOffs go before noteOns at the same time, so
+// repeated notes are not cut short. noteOffs are written as noteOns with
+// velocity 0, which lets running status cover every note message in a track.
+// Notes with pitches outside the MIDI range are skipped. Returns the number of
+// messages in 'out', which must have room for 2 * n messages...
+static long NotesToMIDI(MuNote * notes, long n, unsigned char channel, MuMIDIMessage * out)
+{
+    MuMIDIMessage * heap;
+    long i, count = 0, pending = 0;
+
+    heap = new MuMIDIMessage[n + 1];
+    if(!heap)
+        return 0;
+
+    for(i = 0; i < n; i++)
+    {
+        MuNote & note = notes[i];
+        if((note.Pitch() < 0) || (note.Pitch() > 127))
+            continue;
+
+        while((pending > 0) && (heap[0].time <= note.Start()))
+            out[count++] = PopNoteOff(heap, pending);
+
+        MuMIDIMessage noteOn = note.MIDIOn();
+        int velocity = (int)(note.Amp() * 127);
+        if(velocity < 1)
+            velocity = 1;
+        if(velocity > 127)
+            velocity = 127;
+        noteOn.status = MU_NOTE_ON | channel;
+        noteOn.data2 = velocity;
+        out[count++] = noteOn;
+
+        MuMIDIMessage noteOff = note.MIDIOff();
+        noteOff.status = MU_NOTE_ON | channel;
+        noteOff.data2 = 0;
+        PushNoteOff(heap, pending, noteOff);
+    }
+
+    while(pending > 0)
+        out[count++] = PopNoteOff(heap, pending);
+
+    delete [] heap;
+    return count;
+}
+
+void MuMaterial::SaveMIDIFile(string fileName)
+{
+    lastError.Set(MuERROR_NONE);
+    MuError err(MuERROR_NONE);
+    MuMIDITrack * tracks;
+    unsigned char channel;
+    long i, n;
+    
+    if( (voices == NULL) || (numOfVoices == 0) )
+    {
+        lastError.Set(MuERROR_MATERIAL_IS_EMPTY);
+        return;
+    }
+    
+    // one track for each voice...
+    tracks = new MuMIDITrack[numOfVoices];
+    for(i = 0; i < numOfVoices; i++)
+    {
+        tracks[i].buffer.data = NULL;
+        tracks[i].buffer.max = 0;
+        tracks[i].buffer.count = 0;
+    }
+    
+    for(i = 0; (i < numOfVoices) && (err.Get() == MuERROR_NONE); i++)
+    {
+        MuMIDIBuffer & buffer = tracks[i].buffer;
+        
+        tracks[i].name = voices[i].VoiceName();
+        channel = voices[i].ChannelNumber();
+        if(channel > 0)
+            channel--;
+        
+        n = voices[i].NumberOfNotes();
+        buffer.max = (2 * n) + 1;
+        buffer.data = new MuMIDIMessage[buffer.max];
+        
+        // instrument number selects the voice's program...
+        if(voices[i].InstrumentNumber() > 0)
+        {
+            buffer.data[0].status = MU_PROGRAM_CHANGE | channel;
+            buffer.data[0].data1 = (voices[i].InstrumentNumber() - 1) & 0x7F;
+            buffer.data[0].data2 = 0;
+            buffer.data[0].time = 0;
+            buffer.data[0].stamp = 0;
+            buffer.count = 1;
+        }
+        
+        if(n > 0)
+        {
+            MuNote * notes = new MuNote[n];
+            err = voices[i].CopyNotes(notes, n);
+            if(err.Get() == MuERROR_NONE)
+                buffer.count += NotesToMIDI(notes, n, channel, buffer.data + buffer.count);
+            delete [] notes;
+        }
+    }
+    
+    if(err.Get() == MuERROR_NONE)
+        err = WriteMIDIFile(fileName, tracks, numOfVoices);
+    lastError.Set(err);
+    
+    ReleaseMIDITracks(tracks, numOfVoices);
+}
+
+// ARCHIVE FILES ==================================
+//
+// Archive layout (every value is stored in little endian order):
+//
+// [header] "MuMA", version (u16), number of voices (u16),
+//          chunk length (f32), index offset (u64)
+// [chunks] note data for every chunk of every voice, encoded with
+//          EncodeNotes() (see MuCodec.h)
+// [index]  for each voice: instrument (u16), channel (u8), name length (u16),
+//          name, number of chunks (u32), and for each chunk: start (f32),
+//          end (f32), number of notes (u32), data size (u32), data offset (u64)
+
+const char ARCHIVE_TAG[4] = {'M','u','M','A'};
+const uShort ARCHIVE_VERSION = 1;
+const long ARCHIVE_HEADER_SIZE = 20;
+const long ARCHIVE_CHUNK_ENTRY_SIZE = 24;
+const long ARCHIVE_VOICE_ENTRY_SIZE = 9; // index entry of a voice, without its name and chunks
+const long ARCHIVE_MIN_ENCODED_NOTE_SIZE = 6; // one byte per column, params not included
+
+struct MuArchiveChunk
+{
+    float start;
+    float end;
+    unsigned long count;
+    unsigned long size;
+    uint64_t offset;
+};
+
+struct MuArchiveVoice
+{
+    uShort instr;
+    unsigned char channel;
+    string name;
+    unsigned long numChunks;
+    MuArchiveChunk * chunks;
+};
+
+static void PutBytes(unsigned char * & p, uint64_t value, int n)
+{
+    for(int i = 0; i < n; i++)
+        *p++ = (unsigned char)((value >> (8 * i)) & 0xFF);
+}
+
+static uint64_t GetBytes(const unsigned char * & p, int n)
+{
+    uint64_t value = 0;
+    for(int i = 0; i < n; i++)
+        value |= ((uint64_t)(*p++) << (8 * i));
+    return value;
+}
+
+static void PutFloat(unsigned char * & p, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    PutBytes(p, bits, 4);
+}
+
+static float GetFloat(const unsigned char * & p)
+{
+    uint32_t bits = (uint32_t)GetBytes(p, 4);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Reads header and index from an archive file. Returns the number of
+// voices found and an array of voice descriptors which must be released by
+// calling code (along with each voice's chunk array). Returns -1 if file
+// is not a valid archive...
+static long ReadArchiveIndex(ifstream & input, MuArchiveVoice * & outVoices)
+{
+    unsigned char header[ARCHIVE_HEADER_SIZE];
+    unsigned char entry[ARCHIVE_CHUNK_ENTRY_SIZE];
+    const unsigned char * p;
+    long numVoices, i;
+    unsigned long j, len;
+    uint64_t indexOffset, fileSize, remaining;
+    uShort version;
+    
+    outVoices = NULL;
+    
+    // every count in the index is checked against the
+    // size of the file before anything is allocated...
+    input.seekg(0, ios_base::end);
+    fileSize = (uint64_t)input.tellg();
+    input.seekg(0, ios_base::beg);
+    
+    input.read((char *)header, ARCHIVE_HEADER_SIZE);
+    if(!input || memcmp(header, ARCHIVE_TAG, 4) != 0)
+        return -1;
+    
+    p = header + 4;
+    version = (uShort)GetBytes(p, 2);
+    if(version != ARCHIVE_VERSION)
+        return -1;
+    numVoices = (long)GetBytes(p, 2);
+    GetFloat(p); // chunk length is only informative
+    indexOffset = GetBytes(p, 8);
+    
+    if((indexOffset < (uint64_t)ARCHIVE_HEADER_SIZE) || (indexOffset > fileSize))
+        return -1;
+    remaining = fileSize - indexOffset;
+    if((uint64_t)numVoices * ARCHIVE_VOICE_ENTRY_SIZE > remaining)
+        return -1;
+    
+    input.seekg((streamoff)indexOffset);
+    if(!input)
+        return -1;
+    
+    outVoices = new MuArchiveVoice[numVoices];
+    for(i = 0; i < numVoices; i++)
+        outVoices[i].chunks = NULL;
+    
+    for(i = 0; i < numVoices; i++)
+    {
+        input.read((char *)header, 5);
+        if(!input)
+            break;
+        p = header;
+        outVoices[i].instr = (uShort)GetBytes(p, 2);
+        outVoices[i].channel = (unsigned char)GetBytes(p, 1);
+        len = (unsigned long)GetBytes(p, 2);
+        
+        outVoices[i].name.resize(len);
+        if(len > 0)
+            input.read(&(outVoices[i].name[0]), len);
+        
+        input.read((char *)header, 4);
+        p = header;
+        outVoices[i].numChunks = (unsigned long)GetBytes(p, 4);
+        if(!input)
+            break;
+        
+        // the chunk entries must fit in what is left of the index...
+        if((uint64_t)outVoices[i].numChunks * ARCHIVE_CHUNK_ENTRY_SIZE > remaining)
+        {
+            input.setstate(ios_base::failbit);
+            break;
+        }
+        
+        outVoices[i].chunks = new MuArchiveChunk[outVoices[i].numChunks];
+        for(j = 0; j < outVoices[i].numChunks; j++)
+        {
+            MuArchiveChunk & chunk = outVoices[i].chunks[j];
+            input.read((char *)entry, ARCHIVE_CHUNK_ENTRY_SIZE);
+            p = entry;
+            chunk.start = GetFloat(p);
+            chunk.end = GetFloat(p);
+            chunk.count = (unsigned long)GetBytes(p, 4);
+            chunk.size = (unsigned long)GetBytes(p, 4);
+            chunk.offset = GetBytes(p, 8);
+            
+            // chunk data lies between the header and the index, and
+            // can't hold more notes than its size allows...
+            if((chunk.offset < (uint64_t)ARCHIVE_HEADER_SIZE) || (chunk.offset > indexOffset) ||
+               (chunk.size > indexOffset - chunk.offset) || ((uint64_t)chunk.count * ARCHIVE_MIN_ENCODED_NOTE_SIZE > chunk.size))
+            {
+                input.setstate(ios_base::failbit);
+                break;
             }
+        }
+        if(!input)
+            break;
+        remaining = fileSize - (uint64_t)input.tellg();
+    }
+    
+    // if the index is truncated, the file is no good...
+    if(!input)
+    {
+        for(i = 0; i < numVoices; i++)
+            delete [] outVoices[i].chunks;
+        delete [] outVoices;
+        outVoices = NULL;
+        return -1;
+    }
+    
+    return numVoices;
+}
+
+// Reads the notes of a chunk from an archive file.
+// returns false if data can't be read...
+static bool ReadArchiveChunk(ifstream & input, MuArchiveChunk & chunk, MuNote * notes)
+{
+    bool res = false;
+    unsigned char * data = new unsigned char[chunk.size];
+    if(data)
+    {
+        input.seekg((streamoff)chunk.offset);
+        input.read((char *)data, chunk.size);
+        if(input)
+            res = (DecodeNotes(data, chunk.size, notes, chunk.count) == (long)chunk.count);
+        delete [] data;
+    }
+    return res;
+}
+
+void MuMaterial::SaveArchive(string fileName, float chunkLength)
+{
+    lastError.Set(MuERROR_NONE);
+    MuError err(MuERROR_NONE);
+    MuArchiveVoice * index;
+    unsigned char header[ARCHIVE_HEADER_SIZE];
+    unsigned char entry[ARCHIVE_CHUNK_ENTRY_SIZE];
+    unsigned char * p;
+    uint64_t offset;
+    int i;
+    long j, k, n, first;
+    
+    if( (voices == NULL) || (numOfVoices == 0) )
+    {
+        lastError.Set(MuERROR_MATERIAL_IS_EMPTY);
+        return;
+    }
+    
+    if(chunkLength <= 0)
+        chunkLength = ARCHIVE_CHUNK_LENGTH;
+    
+    ofstream output(fileName.c_str(), ios_base::out | ios_base::trunc | ios_base::binary);
+    if(!output)
+    {
+        lastError.Set(MuERROR_COULDNT_OPEN_OUTPUT_FILE);
+        return;
+    }
+    
+    // header goes first; index offset is updated at the end...
+    p = header;
+    memcpy(p, ARCHIVE_TAG, 4);
+    p += 4;
+    PutBytes(p, ARCHIVE_VERSION, 2);
+    PutBytes(p, numOfVoices, 2);
+    PutFloat(p, chunkLength);
+    PutBytes(p, 0, 8);
+    output.write((char *)header, ARCHIVE_HEADER_SIZE);
+    offset = ARCHIVE_HEADER_SIZE;
+    
+    index = new MuArchiveVoice[numOfVoices];
+    for(i = 0; i < numOfVoices; i++)
+    {
+        index[i].instr = voices[i].InstrumentNumber();
+        index[i].channel = voices[i].ChannelNumber();
+        index[i].name = voices[i].VoiceName();
+        index[i].numChunks = 0;
+        index[i].chunks = NULL;
+    }
+    
+    for(i = 0; (i < numOfVoices) && (lastError.Get() == MuERROR_NONE); i++)
+    {
+        n = voices[i].NumberOfNotes();
+        if(n == 0)
+            continue;
+        
+        MuNote * notes = new MuNote[n];
+        err = voices[i].CopyNotes(notes, n);
+        if(err.Get() != MuERROR_NONE)
+        {
+            lastError.Set(err);
+            delete [] notes;
+            break;
+        }
+        
+        // there can't be more chunks than notes...
+        index[i].chunks = new MuArchiveChunk[n];
+        
+        // split voice into chunks, according to note starts...
+        first = 0;
+        while(first < n)
+        {
+            MuArchiveChunk & chunk = index[i].chunks[index[i].numChunks];
+            float limit = notes[first].Start() + chunkLength;
+            unsigned long numParams = 0;
             
-            // after comparing to all remaining events, if we couldn't find
-            // a note termination, we store the event without duration...
-            if (!foundNote)
+            chunk.start = notes[first].Start();
+            chunk.end = notes[first].End();
+            for(j = first; (j < n) && (notes[j].Start() < limit); j++)
             {
-                note.SetStart(firstEvent.time);
-                note.SetPitch(firstEvent.data1);
-                note.SetAmp(firstEvent.data2/128.0);
-                note.SetInstr((firstEvent.status & 0x0F) + 1);
-                note.SetDur(0);
-                AddNote(note);
-                note.Clear();
+                if(notes[j].End() > chunk.end)
+                    chunk.end = notes[j].End();
+                numParams += notes[j].Params().Num();
+            }
+            chunk.count = j - first;
+            chunk.offset = offset;
+            
+            unsigned char * data = new unsigned char[MaxEncodedNoteSize(chunk.count, numParams)];
+            chunk.size = EncodeNotes(notes + first, chunk.count, data);
+            output.write((char *)data, chunk.size);
+            delete [] data;
+            
+            offset += chunk.size;
+            index[i].numChunks++;
+            first = j;
+        }
+        
+        delete [] notes;
+    }
+    
+    // write index...
+    for(i = 0; i < numOfVoices; i++)
+    {
+        p = entry;
+        PutBytes(p, index[i].instr, 2);
+        PutBytes(p, index[i].channel, 1);
+        PutBytes(p, index[i].name.size(), 2);
+        output.write((char *)entry, 5);
+        output.write(index[i].name.c_str(), index[i].name.size());
+        p = entry;
+        PutBytes(p, index[i].numChunks, 4);
+        output.write((char *)entry, 4);
+        
+        for(k = 0; k < (long)index[i].numChunks; k++)
+        {
+            p = entry;
+            PutFloat(p, index[i].chunks[k].start);
+            PutFloat(p, index[i].chunks[k].end);
+            PutBytes(p, index[i].chunks[k].count, 4);
+            PutBytes(p, index[i].chunks[k].size, 4);
+            PutBytes(p, index[i].chunks[k].offset, 8);
+            output.write((char *)entry, ARCHIVE_CHUNK_ENTRY_SIZE);
+        }
+        delete [] index[i].chunks;
+    }
+    delete [] index;
+    
+    // ... and tell the header where to find it
+    p = header;
+    PutBytes(p, offset, 8);
+    output.seekp(ARCHIVE_HEADER_SIZE - 8);
+    output.write((char *)header, 8);
+    
+    if(!output && lastError.Get() == MuERROR_NONE)
+        lastError.Set(MuERROR_COULDNT_OPEN_OUTPUT_FILE);
+    output.close();
+}
 
+void MuMaterial::LoadArchive(string fileName)
+{
+    lastError.Set(MuERROR_NONE);
+    MuArchiveVoice * index;
+    long numVoices, i;
+    unsigned long j, n, count;
+    
+    Clear();
+    
+    ifstream input(fileName.c_str(), ios_base::in | ios_base::binary);
+    if(!input)
+    {
+        lastError.Set(MuERROR_COULDNT_OPEN_INPUT_FILE);
+        return;
+    }
+    
+    numVoices = ReadArchiveIndex(input, index);
+    if(numVoices < 0)
+    {
+        lastError.Set(MuERROR_INVALID_FILE_FORMAT);
+        return;
+    }
+    
+    if(numVoices > 0)
+        AddVoices(numVoices);
+    
+    for(i = 0; (i < numVoices) && (lastError.Get() == MuERROR_NONE); i++)
+    {
+        if(index[i].instr != 0)
+            voices[i].SetInstrumentNumber(index[i].instr);
+        if(index[i].channel != 0)
+            voices[i].SetChannelNumber(index[i].channel);
+        voices[i].SetVoiceName(index[i].name);
+        
+        n = 0;
+        for(j = 0; j < index[i].numChunks; j++)
+            n += index[i].chunks[j].count;
+        if(n == 0)
+            continue;
+        
+        // read every chunk of this voice...
+        MuNote * notes = new MuNote[n];
+        count = 0;
+        for(j = 0; j < index[i].numChunks; j++)
+        {
+            if(!ReadArchiveChunk(input, index[i].chunks[j], notes + count))
+            {
+                lastError.Set(MuERROR_INVALID_FILE_FORMAT);
+                break;
             }
+            count += index[i].chunks[j].count;
         }
+        
+        if(lastError.Get() == MuERROR_NONE)
+            lastError.Set(voices[i].AddNotes(notes, count));
+        delete [] notes;
     }
     
-    // After checking the entire buffer for notes,
-    // decide what to do with the notes that have duration 0.
-    n = NumberOfNotes();
-    for(i = 0; i < n; i++)
+    for(i = 0; i < numVoices; i++)
+        delete [] index[i].chunks;
+    delete [] index;
+}
+
+void MuMaterial::LoadArchive(string fileName, int voiceNumber, float beg, float end)
+{
+    lastError.Set(MuERROR_NONE);
+    MuArchiveVoice * index;
+    long numVoices, i;
+    unsigned long j, k, n, count;
+    
+    Clear();
+    
+    ifstream input(fileName.c_str(), ios_base::in | ios_base::binary);
+    if(!input)
     {
-        note = GetNote(i);
-        if(note.Dur() == 0)
+        lastError.Set(MuERROR_COULDNT_OPEN_INPUT_FILE);
+        return;
+    }
+    
+    numVoices = ReadArchiveIndex(input, index);
+    if(numVoices < 0)
+    {
+        lastError.Set(MuERROR_INVALID_FILE_FORMAT);
+        return;
+    }
+    
+    if((voiceNumber >= 0) && (voiceNumber < numVoices))
+    {
+        MuArchiveVoice & voice = index[voiceNumber];
+        
+        AddVoices(1);
+        if(voice.instr != 0)
+            voices[0].SetInstrumentNumber(voice.instr);
+        if(voice.channel != 0)
+            voices[0].SetChannelNumber(voice.channel);
+        voices[0].SetVoiceName(voice.name);
+        
+        // find the largest chunk overlapping the time window...
+        n = 0;
+        for(j = 0; j < voice.numChunks; j++)
         {
-            switch(mode)
+            if((voice.chunks[j].start < end) && (voice.chunks[j].end > beg))
             {
-                // in purge mode, remove all incomplete notes...
-                case MIDI_BUFFER_MODE_PURGE:
-                {
-                    RemoveNote(i);
-                    i--;
-                    n--;
-                    break;
-                }
-                    
-                // in extend mode, incomplete notes last until the end
-                // of material. if note starts beyond the duration of
-                // all other notes, it gets purged.
-                case MIDI_BUFFER_MODE_EXTEND:
-                {
-                    float dur = Dur()-note.Start();
-                    if (dur != 0)
-                    {
-                        note.SetDur(dur);
-                        SetNote(i, note);
-                    }
-                    else
-                    {
-                        RemoveNote(i);
-                    }
-                    break;
-                }
-                // in melodic mode, incomlete notes last until
-                // the begining of next note. if note is the last
-                case MIDI_BUFFER_MODE_MELODIC:
+                if(voice.chunks[j].count > n)
+                    n = voice.chunks[j].count;
+            }
+        }
+        
+        MuNote * chunkNotes = new MuNote[n];
+        MuNote clipped;
+        
+        // then read only those chunks...
+        for(j = 0; (j < voice.numChunks) && (lastError.Get() == MuERROR_NONE); j++)
+        {
+            MuArchiveChunk & chunk = voice.chunks[j];
+            if(!((chunk.start < end) && (chunk.end > beg)))
+                continue;
+            
+            if(!ReadArchiveChunk(input, chunk, chunkNotes))
+            {
+                lastError.Set(MuERROR_INVALID_FILE_FORMAT);
+                break;
+            }
+            
+            // keep notes within window, clipping them
+            // like MuVoice::Extract() does...
+            count = 0;
+            for(k = 0; k < chunk.count; k++)
+            {
+                clipped = chunkNotes[k];
+                if((clipped.Start() < end) && (clipped.End() > beg))
                 {
-                    if(i == n-1)
-                    {
-                        RemoveNote(i);
-                    }
-                    else
+                    if(clipped.End() > end)
+                        clipped.SetDur(end - clipped.Start());
+                    if(clipped.Start() < beg)
                     {
-                        MuNote nextNote = GetNote(i+1);
-                        note.SetDur(nextNote.Start() - note.Start());
-                        SetNote(i, note);
+                        clipped.SetDur(clipped.End() - beg);
+                        clipped.SetStart(beg);
                     }
-                    break;
+                    chunkNotes[count++] = clipped;
                 }
             }
+            lastError.Set(voices[0].AddNotes(chunkNotes, count));
         }
+        
+        delete [] chunkNotes;
     }
+    else
+    {
+        lastError.Set(MuERROR_INVALID_VOICE_NUMBER);
+    }
+    
+    for(i = 0; i < numVoices; i++)
+        delete [] index[i].chunks;
+    delete [] index;
 }
 
 // Generates Orchestra Definitions...
@@ -124,6 +124,10 @@ const short MIDI_BUFFER_MODE_PURGE = 0;
 const short MIDI_BUFFER_MODE_EXTEND = 1;
 const short MIDI_BUFFER_MODE_MELODIC = 2;
 
+// ARCHIVE FILES:
+//! @brief default time span (in seconds) covered by each chunk in archive files
+const float ARCHIVE_CHUNK_LENGTH = 10.0;
+
 /**
  * @class MuMaterial
  *
@@ -955,6 +959,26 @@ class MuMaterial
 	 **/
     MuNote GetNote(int voiceNumber, long noteNumber);
 	
+	/**
+	 * @brief Copies the first 'n' notes of voice 'voiceNumber'
+	 *
+	 * @details
+	 * CopyNotes() copies the first 'n' notes of voice 'voiceNumber', in the order
+	 * in which they are kept in the voice, to 'outNotes', walking the voice only
+	 * once. It is much faster than calling GetNote() for each note in a loop. If
+	 * material is empty, or voiceNumber is not a valid voice index, or the voice
+	 * has less than 'n' notes, an error is issued and 'outNotes' is left unchanged.
+	 *
+	 * @param
+	 * voiceNumber (int) - voice index
+	 * @param
+	 * outNotes (MuNote *) - array with room for 'n' notes
+	 * @param
+	 * n (long) - number of notes to copy
+	 *
+	 **/
+    void CopyNotes(int voiceNumber, MuNote * outNotes, long n);
+	
 	/**
 	 * @brief Returns a copy of the first note in the material
 	 *
@@ -1131,6 +1155,71 @@ class MuMaterial
 	 **/
     void AddNote(int voiceNumber, MuNote inNote);
 	
+	/**
+	 * @brief Adds an array of notes to voice 'voiceNumber'
+	 *
+	 * @details
+	 * AddNotes() adds 'n' notes from 'inNotes' to voice 'voiceNumber', with the
+	 * same results as calling AddNote() for each one of them. If 'voiceNumber' is
+	 * beyond the last voice, the necessary voices are created. When the notes are
+	 * in time order, they are merged with the voice in a single pass; when they
+	 * also start at or after the end of the voice, as happens when notes are
+	 * appended to a material as they are played, the cost is proportional to 'n'
+	 * only (see MuVoice::AddNotes()).
+	 *
+	 * @param
+	 * voiceNumber (int) - voice index
+	 * @param
+	 * inNotes (MuNote *) - array of notes to be added
+	 * @param
+	 * n (long) - number of notes in array
+	 *
+	 **/
+    void AddNotes(int voiceNumber, MuNote * inNotes, long n);
+	
+	/**
+	 * @brief Adds an array of notes to voice 'voiceNumber', from a mark
+	 *
+	 * @details
+	 * This version of AddNotes() starts looking for the place of the new notes
+	 * at 'from', a mark taken earlier with MarkVoiceEnd(), when the notes don't
+	 * start before the marked note and no notes were removed from the voice
+	 * since then. It is meant for notes which belong a little before the end of
+	 * a long voice, such as a long note which ends after shorter notes started
+	 * later were added: the cost is proportional to 'n' plus the number of notes
+	 * added after the mark. The results are the same as those of AddNotes()
+	 * without a mark (see MuVoice::AddNotes()).
+	 *
+	 * @param
+	 * voiceNumber (int) - voice index
+	 * @param
+	 * inNotes (MuNote *) - array of notes to be added
+	 * @param
+	 * n (long) - number of notes in array
+	 * @param
+	 * from (MuNoteMark) - mark returned by MarkVoiceEnd()
+	 *
+	 **/
+    void AddNotes(int voiceNumber, MuNote * inNotes, long n, MuNoteMark from);
+	
+	/**
+	 * @brief Marks the end of voice 'voiceNumber'
+	 *
+	 * @details
+	 * MarkVoiceEnd() returns a mark for the current end of voice 'voiceNumber',
+	 * to be given later to AddNotes() (see MuVoice::Mark()). If 'voiceNumber'
+	 * is not a valid voice index, MarkVoiceEnd() issues an error and returns a
+	 * mark which AddNotes() ignores.
+	 *
+	 * @param
+	 * voiceNumber (int) - voice index
+	 *
+	 * @return
+	 * MuNoteMark - mark for the end of the voice
+	 *
+	 **/
+    MuNoteMark MarkVoiceEnd(int voiceNumber);
+	
 	/**
 	 * @brief Removes note 'noteNumber' of voice '0'
 	 *
@@ -2663,16 +2752,26 @@ class MuMaterial
      * independently if there is any need to deal with music in MIDI format for some specific
      * application. All related definitions are found in MuMIDI.h.
      * 
-     * LoadMIDIBuffer can be used in one of two modes. If MIDI_BUFFER_MODE_PURGE (the default)
+     * Notes are built in a single pass through the buffer: each noteOff (or noteOn with
+     * velocity 0) terminates the oldest open note with the same channel and pitch. The
+     * buffer's messages should be in time order. LoadMIDIBuffer() adds one new voice to the
+     * material for each MIDI channel found in the buffer, in channel order, after any
+     * existing voices; each voice gets its channel number from the MIDI channel and all its
+     * notes at once. Note instrument numbers are channel + 1, unless a program change is
+     * found for the channel, in which case they are program + 1.
+     *
+     * LoadMIDIBuffer can be used in one of three modes. If MIDI_BUFFER_MODE_PURGE (the default)
      * is selected and the method finds noteOn events with no corresponding noteOffs by the end
      * of the buffer, these starting events are disarded to avoid MIDI panic situations. if
      * instead the buffer was loaded in EXTEND mode (MIDI_BUFFER_MODE_EXTEND), the unpaired
      * note starts will all be terminated with the last noteOff found in the buffer. In other
-     * words, the notes will be sustained or extended.
+     * words, the notes will be sustained or extended. In MELODIC mode (MIDI_BUFFER_MODE_MELODIC),
+     * unpaired notes last until the next note in the same channel; if there is no such note,
+     * they are discarded.
      *
      * @note
-     * If inBufer contains a valid MIDI buffer, LoadMIDIBuffer will release the associated memory
-     * after extracting its contents as notes.
+     * LoadMIDIBuffer does not release the memory associated with inBuffer; calling code
+     * should do so after loading.
      *
      * @param
      * inBuffer (MuMIDIBuffer) - a structure containing a buffer of MIDI messages
@@ -2680,13 +2779,143 @@ class MuMaterial
      * @param
      * mode (short) - defines how incomplete notes are treated. MIDI_BUFFER_MODE_PURGE means
      * unterminated notes are discarded; MIDI_BUFFER_MODE_EXTEND means all unterminated
-     * notes will be endend with the last noteOff.
+     * notes will be endend with the last noteOff; MIDI_BUFFER_MODE_MELODIC means they
+     * last until the next note.
      *
      * @return
      * void - LoadMIDIBuffer returns void. If an error is found it is stored as the last error
      * in the receiving material
      **/
     void LoadMIDIBuffer(MuMIDIBuffer inBuffer, short mode = MIDI_BUFFER_MODE_PURGE);
+    
+    /**
+     * @brief
+     * Loads a Standard MIDI File into material
+     *
+     * @details
+     * LoadMIDIFile() replaces the contents of the material with the notes found in a
+     * Standard MIDI File (type 0 or 1). The file is read with ReadMIDIFile() (see
+     * MuMIDIFile.h), so event times are converted to seconds according to the file's tempo
+     * map. The material receives one voice for each MIDI channel used in each track of
+     * the file, in track order and then channel order. Each voice takes its channel
+     * number from the MIDI channel, its name from the track name and, if the track
+     * contains a program change for that channel, its instrument number from the first
+     * program found (program + 1). Notes are built by pairing noteOn and noteOff events in
+     * a single pass through each track.
+     *
+     * Notes which are never terminated are treated as in LoadMIDIBuffer(), according to
+     * 'mode'. If the file cannot be opened, LoadMIDIFile() sets
+     * MuERROR_COULDNT_OPEN_INPUT_FILE; if it is not a valid MIDI file, or if it is a
+     * type 2 file, it sets MuERROR_INVALID_FILE_FORMAT.
+     *
+     * @param
+     * fileName (string) - path to file as a string object
+     *
+     * @param
+     * mode (short) - defines how incomplete notes are treated: MIDI_BUFFER_MODE_PURGE,
+     * MIDI_BUFFER_MODE_EXTEND or MIDI_BUFFER_MODE_MELODIC
+     *
+     **/
+    void LoadMIDIFile(string fileName, short mode = MIDI_BUFFER_MODE_PURGE);
+    
+    /**
+     * @brief
+     * Writes material to a Standard MIDI File
+     *
+     * @details
+     * SaveMIDIFile() creates a type 1 MIDI file (see WriteMIDIFile() in MuMIDIFile.h)
+     * with one track for each voice in the material. Each track uses the voice's channel
+     * number and name and, if the voice has an instrument number, starts with a program
+     * change selecting program (instrument number - 1). Note amplitudes become key
+     * velocities; notes whose pitches fall outside the MIDI range (0-127) are left out.
+     * Times are written at 120 bpm with 480 ticks per quarter note, so every note keeps its
+     * start time and duration in seconds.
+     *
+     * If the material is empty, SaveMIDIFile() sets MuERROR_MATERIAL_IS_EMPTY; if the file
+     * cannot be written, it sets MuERROR_COULDNT_OPEN_OUTPUT_FILE.
+     *
+     * @param
+     * fileName (string) - path to file as a string object
+     *
+     **/
+    void SaveMIDIFile(string fileName);
+    
+    /**
+     * @brief
+     * Writes material to an archive file
+     *
+     * @details
+     * SaveArchive() stores every voice of the material in a binary archive file, which
+     * can later be read back, entirely or partially, with LoadArchive(). Inside the archive
+     * each voice is split into chunks of consecutive notes, in time order, so that each
+     * chunk covers at most 'chunkLength' seconds of note starts. The notes within a
+     * chunk are stored in columns (all instrument numbers, then all start times, then all
+     * durations, etc.), compressed with the delta encoding described in MuCodec.h. The
+     * archive also contains an index, with the start time, end time
+     * (the end of the longest note) and number of notes in every chunk, which allows
+     * LoadArchive() to find and read only the chunks it needs.
+     *
+     * Archive files are meant for very long materials (multi-hour pieces, generative
+     * performances, etc.), where loading or parsing the entire score just to get a few
+     * minutes of one voice would be too slow. Voice instrument number, MIDI channel and
+     * name are preserved, as well as every note parameter.
+     *
+     * @param
+     * fileName (string) - path to file as a string object
+     * @param
+     * chunkLength (float) - time span of each chunk, in seconds
+     *
+     **/
+    void SaveArchive(string fileName, float chunkLength = ARCHIVE_CHUNK_LENGTH);
+    
+    /**
+     * @brief
+     * Reads an archive file into material
+     *
+     * @details
+     * LoadArchive() replaces the contents of the material with every voice stored in
+     * an archive file created by SaveArchive(). If the file cannot be opened,
+     * LoadArchive() sets MuERROR_COULDNT_OPEN_INPUT_FILE; if the file is not a valid MuM
+     * archive, it sets MuERROR_INVALID_FILE_FORMAT.
+     *
+     * @param
+     * fileName (string) - path to file as a string object
+     *
+     **/
+    void LoadArchive(string fileName);
+    
+    /**
+     * @brief
+     * Reads a time window of one voice from an archive file into material
+     *
+     * @details
+     * This version of LoadArchive() reads from the archive only the chunks of voice
+     * 'voiceNumber' which overlap the time window between 'beg' and 'end', and places
+     * the notes found there in voice 0 of the material, replacing any previous content.
+     * The time window has the same meaning as in MuVoice::Extract(): every note which
+     * is sounding inside the window is included and notes which start before 'beg' or
+     * terminate after 'end' are clipped to fit the window. Note times are kept in the
+     * original time line (they are not moved to zero). The voice's instrument number,
+     * channel and name are copied from the archive.
+     *
+     * Example: reading voice 12, from minute 40 to minute 42:
+     *
+     * @code {.cpp}
+     * MuMaterial excerpt;
+     * excerpt.LoadArchive("performance.mua", 12, 40 * 60.0, 42 * 60.0);
+     * @endcode
+     *
+     * @param
+     * fileName (string) - path to file as a string object
+     * @param
+     * voiceNumber (int) - index of the desired voice in the archive
+     * @param
+     * beg (float) - start of the time window, in seconds
+     * @param
+     * end (float) - end of the time window, in seconds
+     *
+     **/
+    void LoadArchive(string fileName, int voiceNumber, float beg, float end);
 	
     /**
      * @brief
@@ -314,6 +314,7 @@ MuMIDIMessage MuNote::MIDIOn(void)
 	noteOn.data1 = pitch;
 	noteOn.data2 = amp * 127;
 	noteOn.time = start;
+	noteOn.stamp = TimeToNanoStamp(start);
 	return noteOn;
 }
 
@@ -324,6 +325,7 @@ MuMIDIMessage MuNote::MIDIOff(void)
 	noteOff.data1 = pitch;
 	noteOff.data2 = 0;
 	noteOff.time = ( start + dur );
+	noteOff.stamp = TimeToNanoStamp((double)start + dur);
 	return noteOff;
 }
 
@@ -527,7 +527,7 @@ class MuNote
 	 * MIDIOn() converts the note's data to MIDI format and returns the
 	 * note-on event for the note. Note data is assigned as follows:
 	 * <ul>
-	 * <li>Start - becomes time stamp in seconds (time field)
+	 * <li>Start - becomes time stamp in seconds (time field) and in nanoseconds (stamp field)
 	 * <li>Instr - becomes channel choice in range 0-F (status field - bits 0 through 3)
 	 * <li>Pitch - becomes data1 field
 	 * <li>Amp - becomes data2 field (range 0 through 127)
@@ -545,7 +545,7 @@ class MuNote
 	 * MIDIOff()  converts the note's data to MIDI format and returns the
 	 * note-off event for the note. Note data is assigned as follows:
 	 * <ul>
-	 * <li>::End() - becomes time stamp in seconds (time field)
+	 * <li>::End() - becomes time stamp in seconds (time field) and in nanoseconds (stamp field)
 	 * <li>Instr - becomes channel choice in range 0-F (status field - bits 0 through 3)
 	 * <li>Pitch - becomes data1 field
 	 * <li>data2 field receives 0 (zero)
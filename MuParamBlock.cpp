@@ -66,7 +66,9 @@ MuParamBlock & MuParamBlock::operator=(const MuParamBlock & inBlock)
         // memory, we get rid of it...
         if(values)
             delete [] values;
-        
+        values = NULL;
+        numValues = 0;
+
 		n = inBlock.numValues;
 		if(n > 0)
 		{
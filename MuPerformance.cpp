@@ -0,0 +1,329 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuPerformance.cpp
+ *
+ * @brief Performance Class Implementation
+ *
+ * @author Carlos Eduardo Mello
+ * @date 10/18/2026
+ *
+ **/
+
+#include "MuPerformance.h"
+
+MuPerformance::MuPerformance(void)
+{
+    data = NULL;
+    lastError.Set(MuERROR_NONE);
+}
+
+MuPerformance::MuPerformance(MuMaterial & inMat)
+{
+    data = NULL;
+    Compile(inMat);
+}
+
+MuPerformance::MuPerformance(const MuPerformance & inPerf)
+{
+    data = inPerf.Acquire();
+    lastError.Set(MuERROR_NONE);
+}
+
+MuPerformance::~MuPerformance(void)
+{
+    Release(data);
+}
+
+MuPerformance & MuPerformance::operator=(const MuPerformance & inPerf)
+{
+    // acquire first, in case both share the same data...
+    MuPerformanceData * temp = inPerf.Acquire();
+    Release(data);
+    data = temp;
+    lastError.Set(MuERROR_NONE);
+    return *this;
+}
+
+MuPerformanceData * MuPerformance::Acquire(void) const
+{
+    if(data != NULL)
+        data->refs.fetch_add(1, memory_order_relaxed);
+    return data;
+}
+
+void MuPerformance::Release(MuPerformanceData * perfData)
+{
+    // the last reference frees the events (the release/acquire pair
+    // makes every use of the data happen before it is deleted)...
+    if((perfData != NULL) && (perfData->refs.fetch_sub(1, memory_order_acq_rel) == 1))
+    {
+        delete [] perfData->events;
+        delete perfData;
+    }
+}
+
+void MuPerformance::Compile(MuMaterial & inMat)
+{
+    lastError.Set(MuERROR_NONE);
+    long numEvents = inMat.NumberOfNotes() * 2;
+
+    Clear();
+    if(numEvents <= 0)
+        return;
+
+    MuPerformanceData * temp = new MuPerformanceData;
+    if(temp == NULL)
+    {
+        lastError.Set(MuERROR_INSUF_MEM);
+        return;
+    }
+    temp->events = new MuMIDIMessage[numEvents];
+    temp->count = (temp->events != NULL) ? CompileMaterial(inMat, temp->events) : -1;
+    if(temp->count < 0)
+    {
+        delete [] temp->events;
+        delete temp;
+        lastError.Set(MuERROR_INSUF_MEM);
+        return;
+    }
+    temp->refs.store(1, memory_order_relaxed);
+    data = temp;
+}
+
+void MuPerformance::Clear(void)
+{
+    Release(data);
+    data = NULL;
+}
+
+long MuPerformance::NumberOfEvents(void) const
+{
+    return (data != NULL) ? data->count : 0;
+}
+
+double MuPerformance::Dur(void) const
+{
+    if((data == NULL) || (data->count == 0))
+        return 0;
+    return (double)data->events[data->count - 1].stamp / ONE_SECOND_NS;
+}
+
+MuError MuPerformance::LastError(void)
+{
+    return lastError;
+}
+
+long MuPerformance::CompileMaterial(MuMaterial & mat, MuMIDIMessage * out)
+{
+    MuEventCompiler compiler;
+    
+    if(!compiler.Start(mat))
+        return -1;
+    return compiler.Compile(out, compiler.NumberOfEvents());
+}
+
+// EVENT COMPILER ==================================
+//
+// noteOns and noteOffs are extracted from the material, voice by voice.
+// noteOns are read as runs of ascending stamps (normally one run per
+// voice), merged through a heap of runs, while noteOffs wait in another
+// heap until their time comes. Both heaps hold indexes...
+
+MuEventCompiler::MuEventCompiler(void)
+{
+    ons = NULL;
+    offs = NULL;
+    runNext = NULL;
+    runEnd = NULL;
+    runHeap = NULL;
+    offHeap = NULL;
+    Clear();
+}
+
+MuEventCompiler::~MuEventCompiler(void)
+{
+    Clear();
+}
+
+void MuEventCompiler::Clear(void)
+{
+    delete [] ons;
+    delete [] offs;
+    delete [] runNext;
+    delete [] runEnd;
+    delete [] runHeap;
+    delete [] offHeap;
+    ons = offs = NULL;
+    runNext = runEnd = runHeap = offHeap = NULL;
+    numRuns = pendingRuns = pendingOffs = 0;
+    numEvents = compiled = 0;
+}
+
+// true if run 'a' has its next noteOn before run 'b'
+// (on equal times, the run from an earlier voice goes first)...
+bool MuEventCompiler::RunBefore(long a, long b) const
+{
+    long long ta = ons[runNext[a]].stamp;
+    long long tb = ons[runNext[b]].stamp;
+    if(ta != tb)
+        return ta < tb;
+    return a < b;
+}
+
+// true if noteOff 'a' goes before noteOff 'b'
+// (on equal times, they keep the order of their notes)...
+bool MuEventCompiler::OffBefore(long a, long b) const
+{
+    if(offs[a].stamp != offs[b].stamp)
+        return offs[a].stamp < offs[b].stamp;
+    return a < b;
+}
+
+void MuEventCompiler::PushEvent(long * heap, long & n, long item, Order before)
+{
+    long i = n++;
+    while(i > 0)
+    {
+        long parent = (i - 1) / 2;
+        if(!(this->*before)(item, heap[parent]))
+            break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = item;
+}
+
+void MuEventCompiler::SiftEvent(long * heap, long n, long i, Order before)
+{
+    long item = heap[i];
+    while(true)
+    {
+        long child = (2 * i) + 1;
+        if(child >= n)
+            break;
+        if((child + 1 < n) && (this->*before)(heap[child + 1], heap[child]))
+            child++;
+        if(!(this->*before)(heap[child], item))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = item;
+}
+
+bool MuEventCompiler::Start(MuMaterial & mat)
+{
+    MuNote * notes;
+    long numNotes, maxVoiceNotes = 0;
+    long i, j, k, n;
+    int numVoices = mat.NumberOfVoices();
+    unsigned char channel;
+    
+    Clear();
+    
+    numNotes = mat.NumberOfNotes();
+    for(i = 0; i < numVoices; i++)
+    {
+        n = mat.NumberOfNotes(i);
+        if(n > maxVoiceNotes)
+            maxVoiceNotes = n;
+    }
+    
+    ons = new MuMIDIMessage[numNotes];
+    offs = new MuMIDIMessage[numNotes];
+    runNext = new long[numNotes];
+    runEnd = new long[numNotes];
+    runHeap = new long[numNotes];
+    offHeap = new long[numNotes];
+    notes = new MuNote[maxVoiceNotes];
+    if(!(ons && offs && runNext && runEnd && runHeap && offHeap && notes))
+    {
+        delete [] notes;
+        Clear();
+        return false;
+    }
+    
+    // extract noteOn/noteOff pairs, voice by voice,
+    // and find where each ascending run starts...
+    k = 0;
+    for(i = 0; i < numVoices; i++)
+    {
+        channel = mat.Channel(i);
+        channel--; // adjust to zero-based counting
+        n = mat.NumberOfNotes(i);
+        mat.CopyNotes(i, notes, n);
+        for(j = 0; j < n; j++, k++)
+        {
+            ons[k] = notes[j].MIDIOn();
+            ons[k].status += channel;
+            offs[k] = notes[j].MIDIOff();
+            offs[k].status += channel;
+            
+            if((j == 0) || (ons[k].stamp < ons[k-1].stamp))
+            {
+                if(numRuns > 0)
+                    runEnd[numRuns - 1] = k;
+                runNext[numRuns++] = k;
+            }
+        }
+    }
+    if(numRuns > 0)
+        runEnd[numRuns - 1] = k;
+    delete [] notes;
+    
+    // every run starts out in the heap...
+    for(i = 0; i < numRuns; i++)
+        PushEvent(runHeap, pendingRuns, i, &MuEventCompiler::RunBefore);
+    
+    numEvents = 2 * k;
+    return true;
+}
+
+long MuEventCompiler::Compile(MuMIDIMessage * out, long max)
+{
+    long count = 0;
+    long k;
+    
+    // take the earliest event from the runs or from the noteOffs...
+    while((count < max) && ((pendingRuns > 0) || (pendingOffs > 0)))
+    {
+        if((pendingOffs > 0) &&
+           ((pendingRuns == 0) ||
+            (offs[offHeap[0]].stamp <= ons[runNext[runHeap[0]]].stamp)))
+        {
+            out[count++] = offs[offHeap[0]];
+            offHeap[0] = offHeap[--pendingOffs];
+            SiftEvent(offHeap, pendingOffs, 0, &MuEventCompiler::OffBefore);
+        }
+        else
+        {
+            long run = runHeap[0];
+            k = runNext[run]++;
+            out[count++] = ons[k];
+            PushEvent(offHeap, pendingOffs, k, &MuEventCompiler::OffBefore);
+            if(runNext[run] >= runEnd[run])
+                runHeap[0] = runHeap[--pendingRuns];
+            SiftEvent(runHeap, pendingRuns, 0, &MuEventCompiler::RunBefore);
+        }
+    }
+    
+    compiled += count;
+    return count;
+}
+
+long MuEventCompiler::NumberOfEvents(void) const
+{
+    return numEvents;
+}
+
+long MuEventCompiler::Remaining(void) const
+{
+    return numEvents - compiled;
+}
@@ -0,0 +1,394 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuPerformance.h
+ *
+ * @brief Performance Class Interface
+ *
+ * @author Carlos Eduardo Mello
+ * @date 10/18/2026
+ *
+ * @details
+ * This file declares MuPerformance, the class used by MuM to keep
+ * materials compiled into MIDI events, ready to be played by MuPlayer
+ * as many times as needed, and MuEventCompiler, which does the
+ * conversion, a few events at a time.
+ *
+ **/
+
+#ifndef MU_PERFORMANCE_H
+#define MU_PERFORMANCE_H
+
+#include <atomic>
+#include "MuMaterial.h"
+
+using namespace std;
+
+/**
+ * @brief Performance Data structure
+ *
+ * @details
+ * MuPerformanceData holds the events of a compiled performance. It
+ * is never modified after it is created, so it can be read by any
+ * number of playback queues at the same time. It is shared by every
+ * copy of the performance and by every queue playing it, and it is
+ * released when the last one of them lets it go.
+ **/
+struct MuPerformanceData
+{
+    //! @brief MIDI events, in time order, with channels applied
+    MuMIDIMessage * events;
+    //! @brief number of events
+    long count;
+    //! @brief number of performances and queues using this data
+    atomic<long> refs;
+};
+typedef struct MuPerformanceData MuPerformanceData;
+
+/**
+ * @class MuEventCompiler
+ *
+ * @brief Incremental Material Compiler
+ *
+ * @details
+ *
+ * MuEventCompiler converts the notes of a material into time ordered
+ * MIDI events a few at a time, so that calling code can use the first
+ * events while the rest of the material is still being converted.
+ * Start() takes a snapshot of the material's notes (so the material
+ * may be changed or destroyed afterwards) and each call to Compile()
+ * produces the next events in order. MuPlayer uses it to stream long
+ * materials to its playback queues (see MuPlayer::SetStreamWindow()),
+ * and MuPerformance::CompileMaterial() uses it to compile whole
+ * materials at once.
+ *
+ * Every note becomes a noteOn/noteOff pair on its voice's channel.
+ * Each voice is read once, in order; the voices' noteOns are merged
+ * with each other while noteOffs are merged through a heap, so the
+ * whole conversion takes O(n log n) time for 'n' notes. noteOffs go
+ * before noteOns at the same time, so repeated notes are not cut short.
+ * Voices which are not in time order (after being sorted by another
+ * field, for example) are read as several ascending runs, so the result
+ * is always in order.
+ *
+ **/
+class MuEventCompiler
+{
+    private:
+
+    typedef bool (MuEventCompiler::*Order)(long a, long b) const;
+
+    MuMIDIMessage * ons;    // noteOns, voice by voice
+    MuMIDIMessage * offs;   // matching noteOffs
+    long * runNext;         // next noteOn in each ascending run
+    long * runEnd;          // end of each run
+    long * runHeap;         // runs with noteOns left, by time
+    long * offHeap;         // noteOffs waiting to be produced, by time
+    long numRuns;
+    long pendingRuns;
+    long pendingOffs;
+    long numEvents;
+    long compiled;
+
+    bool RunBefore(long a, long b) const;
+    bool OffBefore(long a, long b) const;
+    void PushEvent(long * heap, long & n, long item, Order before);
+    void SiftEvent(long * heap, long n, long i, Order before);
+
+    public:
+
+    /**
+     * @brief Default Constructor
+     *
+     * @details
+     * Creates an empty compiler.
+     *
+     **/
+    MuEventCompiler(void);
+
+    /**
+     * @brief Destructor
+     *
+     * @details
+     * Releases the memory used by the compiler.
+     *
+     **/
+    ~MuEventCompiler(void);
+
+    /**
+     * @brief prepares a material for compilation
+     *
+     * @details
+     * Start() discards any previous state and extracts the noteOn and
+     * noteOff events for every note in 'mat', in a single pass over each
+     * voice. The events are put in order by subsequent calls to Compile().
+     *
+     * @param
+     * mat (MuMaterial &) - material to be compiled
+     *
+     * @return
+     * bool - false if memory could not be allocated
+     *
+     **/
+    bool Start(MuMaterial & mat);
+
+    /**
+     * @brief produces the next events in time order
+     *
+     * @details
+     * Compile() writes up to 'max' events to 'out', continuing from
+     * where the previous call stopped. Each event costs O(log n).
+     *
+     * @param
+     * out (MuMIDIMessage *) - array with room for 'max' events
+     *
+     * @param
+     * max (long) - maximum number of events to produce
+     *
+     * @return
+     * long - number of events written to 'out' (zero when every
+     * event has been produced)
+     *
+     **/
+    long Compile(MuMIDIMessage * out, long max);
+
+    /**
+     * @brief returns the total number of events
+     *
+     * @details
+     * NumberOfEvents() returns the number of events in the material
+     * given to Start() (two per note).
+     *
+     * @return
+     * long - number of events
+     *
+     **/
+    long NumberOfEvents(void) const;
+
+    /**
+     * @brief returns the number of events not yet produced
+     *
+     * @return
+     * long - number of events left
+     *
+     **/
+    long Remaining(void) const;
+
+    /**
+     * @brief discards all state
+     *
+     * @details
+     * Clear() releases the events extracted by Start().
+     *
+     **/
+    void Clear(void);
+};
+
+/**
+ * @class MuPerformance
+ *
+ * @brief Compiled Performance
+ *
+ * @details
+ *
+ * MuPerformance holds a material already converted to the MIDI events
+ * MuPlayer sends during playback: every note becomes a noteOn/noteOff
+ * pair on its voice's channel, and the events are kept in time order.
+ * When a material is played with MuPlayer::Play(), this conversion
+ * happens on every call; when a performance is played instead (see
+ * MuPlayer::Play(const MuPerformance &)), the player simply starts a
+ * queue reading the performance's events, with no conversion, copy or
+ * allocation. This is useful for loops, motifs and other gestures which
+ * are played many times during an application.
+ *
+ * A performance's events are never modified after they are compiled,
+ * so the same performance can be started many times, even while
+ * previous starts are still playing. The events are shared by every
+ * copy of the performance and by every queue playing it; Compile()
+ * and Clear() only affect starts made afterwards, and the memory is
+ * released after the last copy is destroyed and the last queue is done
+ * with it. Therefore a performance may be destroyed while it is playing.
+ *
+ * @code {.cpp}
+ *
+ * MuPerformance motif(mat); // converted once...
+ * player.Play(motif);       // ...and played many times
+ * player.Play(motif);
+ *
+ * @endcode
+ *
+ * As with materials, calling code should check LastError() after
+ * compiling a performance.
+ *
+ **/
+class MuPerformance
+{
+    private:
+
+    MuPerformanceData * data;
+    MuError lastError;
+
+    MuPerformanceData * Acquire(void) const;
+    static void Release(MuPerformanceData * perfData);
+
+    friend class MuPlayer;
+
+    public:
+
+    /**
+     * @brief Default Constructor
+     *
+     * @details
+     * Creates an empty performance.
+     *
+     **/
+    MuPerformance(void);
+
+    /**
+     * @brief Material Constructor
+     *
+     * @details
+     * Creates a performance containing the events for 'inMat' (see
+     * Compile()).
+     *
+     * @param
+     * inMat (MuMaterial &) - material to be compiled
+     *
+     **/
+    MuPerformance(MuMaterial & inMat);
+
+    /**
+     * @brief Copy Constructor
+     *
+     * @details
+     * Creates a performance which shares the events of 'inPerf'. No
+     * events are copied.
+     *
+     * @param
+     * inPerf (const MuPerformance &) - performance to be copied
+     *
+     **/
+    MuPerformance(const MuPerformance & inPerf);
+
+    /**
+     * @brief Destructor
+     *
+     * @details
+     * Releases this performance's reference to its events. Queues which
+     * are playing the performance keep their own references, so they
+     * are not interrupted.
+     *
+     **/
+    ~MuPerformance(void);
+
+    /**
+     * @brief Assignment Operator
+     *
+     * @details
+     * Makes this performance share the events of 'inPerf'. No events are
+     * copied.
+     *
+     * @param
+     * inPerf (const MuPerformance &) - performance to be copied
+     *
+     * @return
+     * MuPerformance & - this performance
+     *
+     **/
+    MuPerformance & operator=(const MuPerformance & inPerf);
+
+    /**
+     * @brief compiles a material into MIDI events
+     *
+     * @details
+     * Compile() replaces the contents of this performance with the events
+     * for 'inMat' (see CompileMaterial()). Queues which are playing
+     * the previous contents keep playing them. If 'inMat' has no notes,
+     * the performance becomes empty. If memory cannot be allocated,
+     * LastError() returns MuERROR_INSUF_MEM and the performance becomes
+     * empty.
+     *
+     * @param
+     * inMat (MuMaterial &) - material to be compiled
+     *
+     **/
+    void Compile(MuMaterial & inMat);
+
+    /**
+     * @brief empties the performance
+     *
+     * @details
+     * Clear() releases this performance's reference to its events,
+     * leaving it empty. Queues which are playing it are not affected.
+     *
+     **/
+    void Clear(void);
+
+    /**
+     * @brief returns the number of events
+     *
+     * @details
+     * NumberOfEvents() returns the number of MIDI events in the
+     * performance (two for each note in the compiled material).
+     *
+     * @return
+     * long - number of events
+     *
+     **/
+    long NumberOfEvents(void) const;
+
+    /**
+     * @brief returns the duration of the performance
+     *
+     * @details
+     * Dur() returns the time of the last event in the performance, in
+     * seconds, which is the time a queue takes to play it.
+     *
+     * @return
+     * double - duration in seconds (0 if performance is empty)
+     *
+     **/
+    double Dur(void) const;
+
+    /**
+     * @brief returns last error
+     *
+     * @details
+     * LastError() returns the error generated by the last call to Compile().
+     *
+     * @return
+     * MuError - last error
+     *
+     **/
+    MuError LastError(void);
+
+    /**
+     * @brief compiles a material into an array of MIDI events
+     *
+     * @details
+     * CompileMaterial() converts every note in 'mat' into a noteOn/noteOff
+     * pair on its voice's channel and writes them to 'out' in time order,
+     * in O(n log n) time for 'n' notes (see MuEventCompiler). MuPlayer
+     * uses this function to compile materials for playback.
+     *
+     * @param
+     * mat (MuMaterial &) - material to be compiled
+     *
+     * @param
+     * out (MuMIDIMessage *) - array with room for two events per note
+     *
+     * @return
+     * long - number of events written to 'out', or -1 if memory could
+     * not be allocated
+     *
+     **/
+    static long CompileMaterial(MuMaterial & mat, MuMIDIMessage * out);
+};
+
+#endif /* MU_PERFORMANCE_H */
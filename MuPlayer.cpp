@@ -8,27 +8,246 @@
 
 #include "MuPlayer.h"
 
-bool MuPlayer::pause = false;
-bool MuPlayer::stop = false;
+atomic<bool> MuPlayer::pause(false);
+atomic<unsigned long> MuPlayer::stopCount(0);
 pthread_mutex_t MuPlayer::sendMIDIlock;
+pthread_mutex_t MuPlayer::scheduleLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t MuPlayer::scheduleWakeup;
+pthread_once_t MuPlayer::scheduleOnce = PTHREAD_ONCE_INIT;
+
+// releases a lock if a thread is cancelled while waiting...
+static void UnlockMutex(void * lock)
+{
+    pthread_mutex_unlock((pthread_mutex_t *)lock);
+}
+
+// number of events a streaming queue produces at a time...
+static long StreamChunk(long window)
+{
+    long chunk = window / 4;
+    return (chunk > 0) ? chunk : 1;
+}
+
+// returns message 'i' of a queue (streaming queues reuse their storage as a ring)...
+static inline const MuMIDIMessage & QueueEvent(EventQueue * queue, long i)
+{
+    return queue->events[i % queue->window];
+}
+
+// time when message 'i' of a queue is due, at the queue's tempo...
+static inline long long QueueDue(EventQueue * queue, long i)
+{
+    long long stamp = QueueEvent(queue, i).stamp;
+    if(queue->scale != NORMAL_TEMPO)
+        stamp = llround(stamp / queue->scale);
+    return queue->origin + stamp;
+}
+
+// message of a streaming queue whose release makes room in its ring for another chunk...
+static inline long StreamRoomEvent(EventQueue * queue)
+{
+    return queue->numEvents - queue->window + StreamChunk(queue->window) - 1;
+}
+
+// time when the scheduler has to look at a queue again: when its next message
+// is due, or, after its last one, when that one leaves the sequencer (for a
+// streaming queue waiting for room, when the message which makes room does)...
+static long long QueueWakeup(EventQueue * queue, long long ahead)
+{
+    if(queue->next < queue->numEvents)
+        return QueueDue(queue, queue->next);
+    if(queue->streaming && queue->waiting)
+        return QueueDue(queue, StreamRoomEvent(queue)) + ahead;
+    return QueueDue(queue, queue->next - 1) + ahead;
+}
+
+// compiles up to 'room' events of a streaming queue into the free slots of its
+// ring, which may wrap around its end (the scheduler only reads slots before
+// them); the compiler is let go with the last events...
+static long FillRing(EventQueue * queue, long room)
+{
+    long window = queue->window;
+    long n = 0, first, length, count;
+    
+    while(n < room)
+    {
+        first = (queue->numEvents + n) % window;
+        length = room - n;
+        if(length > window - first)
+            length = window - first;
+        count = queue->compiler.Compile(queue->buffer.data + first, length);
+        n += count;
+        if(count < length)
+            break;
+    }
+    if(queue->compiler.Remaining() == 0)
+        queue->compiler.Clear();
+    
+    return n;
+}
+
+// point of a queue's time line (in time stamp units) reached at 'now'...
+static long long QueuePosition(EventQueue * queue, long long now)
+{
+    return llround((now - queue->origin) * queue->scale);
+}
+
+// waits on 'cond' until it is signalled or until 'deadline' (see
+// NanoClockStamp()); returns false if the deadline had already passed...
+static bool WaitUntil(pthread_cond_t * cond, pthread_mutex_t * lock, long long deadline)
+{
+#ifdef MUM_MACOSX
+    // CoreMIDI systems have no monotonic condition
+    // variables, so we wait for a relative interval...
+    long long interval = deadline - NanoClockStamp();
+    if(interval <= 0)
+        return false;
+    timespec rel;
+    rel.tv_sec = interval / ONE_SECOND_NS;
+    rel.tv_nsec = interval % ONE_SECOND_NS;
+    pthread_cond_timedwait_relative_np(cond, lock, &rel);
+#endif
+    
+#ifdef MUM_LINUX
+    timespec abs;
+    abs.tv_sec = deadline / ONE_SECOND_NS;
+    abs.tv_nsec = deadline % ONE_SECOND_NS;
+    pthread_cond_timedwait(cond, lock, &abs);
+#endif
+    return true;
+}
+
+// puts a queue back in its idle state (its event storage is kept)...
+static void ClearQueue(EventQueue * queue)
+{
+    queue->buffer.count = 0;
+    queue->input.data = NULL;
+    queue->input.count = 0;
+    queue->input.max = 0;
+    queue->events = NULL;
+    queue->numEvents = 0;
+    queue->window = 0;
+    queue->streaming = false;
+    queue->starved = false;
+    queue->waiting = false;
+    queue->performance = NULL;
+    queue->stopCount = 0;
+    queue->paused = false;
+    queue->next = 0;
+    queue->played = 0;
+    queue->material.Clear();
+    queue->compiler.Clear();
+    queue->loader = NULL;
+    queue->loadingTime = 0;
+    queue->nextTime = 0;
+    queue->tempo = NORMAL_TEMPO;
+    queue->scale = NORMAL_TEMPO;
+    queue->origin = 0;
+    queue->nextActivated = NULL;
+    queue->sentEvents = 0;
+    queue->lateEvents = 0;
+    queue->maxLatency = 0;
+    queue->state.store(QUEUE_FREE, memory_order_release);
+}
+
+// locks a queue and its event storage in memory, when the
+// whole process could not be locked (see LockMemory())...
+static bool LockQueue(EventQueue * queue)
+{
+    bool ok = (mlock(queue, sizeof(EventQueue)) == 0);
+    if((queue->buffer.data != NULL) && (mlock(queue->buffer.data, queue->buffer.max * sizeof(MuMIDIMessage)) != 0))
+        ok = false;
+    return ok;
+}
+
+// true if, once the process is locked, its locked memory limit
+// still has room for the stacks of the threads Init() starts, and
+// for the process to grow to twice its size...
+static bool FutureLocksFit(void)
+{
+    rlimit limit;
+    pthread_attr_t attr;
+    size_t stack = 0;
+    long long locked = 0;
+    
+    if((getrlimit(RLIMIT_MEMLOCK, &limit) != 0) || (limit.rlim_cur == RLIM_INFINITY) || (geteuid() == 0))
+        return true;
+    
+    pthread_attr_init(&attr);
+    pthread_attr_getstacksize(&attr, &stack);
+    pthread_attr_destroy(&attr);
+    
+#ifdef MUM_LINUX
+    // the system tells how much is locked already...
+    char line[128];
+    FILE * status = fopen("/proc/self/status", "r");
+    if(status != NULL)
+    {
+        while(fgets(line, sizeof(line), status) != NULL)
+        {
+            if(sscanf(line, "VmLck: %lld", &locked) == 1)
+            {
+                locked *= 1024;
+                break;
+            }
+        }
+        fclose(status);
+    }
+#endif
+    
+    return (2 * locked + (long long)stack * (LOADER_THREADS + 1)) <= (long long)limit.rlim_cur;
+}
+
+// histogram bucket for a latency or jitter value (see MuPlaybackStats)...
+static int StatsBucket(long long nanoseconds)
+{
+    long long micro = nanoseconds / 1000;
+    int bucket = 0;
+    
+    while((micro > 0) && (bucket < STATS_BUCKETS - 1))
+    {
+        micro >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
 
 MuPlayer::MuPlayer(void)
 {
-    // initialize all fields of playback pool
-    // to default values...
-    for(int i = 0; i < MAX_QUEUES; i++)
-    {
-        eqPool[i].buffer.data = NULL;
-        eqPool[i].buffer.max = 0;
-        eqPool[i].buffer.max = 0;
-        eqPool[i].active = false;
-        eqPool[i].loading = false;
-        eqPool[i].paused = false;
-        eqPool[i].next = 0;
-        eqPool[i].material.Clear();
-        eqPool[i].queueThread = 0;
-        eqPool[i].loadingTime = 0;
+    // the playback pool starts out empty,
+    // and is created at its initial size...
+    eqPool = NULL;
+    dueQueues = NULL;
+    poolSize = 0;
+    poolMax = 0;
+    maxQueues = NO_QUEUE_LIMIT;
+    pthread_mutex_init(&poolLock, NULL);
+    streamWindow = NO_STREAMING;
+    
+    // the loader threads are started by Init(),
+    // but their job queue is ready from the start...
+    numLoaders = 0;
+    for(unsigned long j = 0; j < LOADER_JOBS; j++)
+    {
+        jobs[j].sequence.store(j, memory_order_relaxed);
+        jobs[j].queue = NULL;
     }
+    jobHead.store(0, memory_order_relaxed);
+    jobTail.store(0, memory_order_relaxed);
+    idleLoaders.store(0, memory_order_relaxed);
+    pthread_mutex_init(&loaderLock, NULL);
+    pthread_cond_init(&loaderWakeup, NULL);
+    numDueQueues = 0;
+    activatedQueues = NULL;
+    pthread_mutex_lock(&poolLock);
+    GrowPool(MAX_QUEUES);
+    pthread_mutex_unlock(&poolLock);
+    
+    // timing statistics...
+    lateThreshold.store(DEFAULT_LATE_THRESHOLD, memory_order_relaxed);
+    lastLatency = 0;
+    ResetStats();
+    
     // initialize MIDI objects...
     
 #ifdef MUM_MACOSX
@@ -41,230 +260,641 @@ MuPlayer::MuPlayer(void)
     // RTMidi
     midiout = NULL;
 #endif
+    sink = NULL;
+    batchCount = 0;
+    batchLength = 0;
+    batchOutput = true;
+    lookAhead = NO_LOOKAHEAD;
+    scheduledAhead = NO_LOOKAHEAD;
+    tempo = NORMAL_TEMPO;
     
     // clear scheduler thread variable...
     schedulerThread = 0;
+    
+    // no real-time settings until they are requested...
+    realtime.priority = NO_REALTIME_PRIORITY;
+    realtime.cpu = ANY_CPU;
+    realtime.lockMemory = false;
+    realtime.numQueues = 0;
+    realtime.numEvents = 0;
+    realtimeFlags = 0;
+    priorityError = 0;
+    affinityError = 0;
+    lockError = 0;
+    policySaved = false;
+#ifdef MUM_LINUX
+    cpusSaved = false;
+#endif
 }
 
 MuPlayer::~MuPlayer(void)
 {
     Reset();
+    
+    // release queue objects...
+    for(int i = 0; i < poolSize; i++)
+        delete eqPool[i];
+    delete [] eqPool;
+    delete [] dueQueues;
+    
+    pthread_mutex_destroy(&loaderLock);
+    pthread_mutex_destroy(&poolLock);
+    pthread_cond_destroy(&loaderWakeup);
 }
 
 void MuPlayer::CleanPlaybackPool(void)
 {
     // Clean Playback Pool
-    for(int i = 0; i < MAX_QUEUES; i++)
+    for(int i = 0; i < poolSize; i++)
     {
-        if(eqPool[i].buffer.data)
-            delete [] eqPool[i].buffer.data;
-        eqPool[i].buffer.data = NULL;
-        eqPool[i].buffer.max = 0;
-        eqPool[i].buffer.count = 0;
-        eqPool[i].active = false;
-        eqPool[i].loading = false;
-        eqPool[i].paused = false;
-        eqPool[i].next = 0;
-        eqPool[i].material.Clear();
-        if(eqPool[i].queueThread != 0)
-        {
-            pthread_cancel(eqPool[i].queueThread);
-            eqPool[i].queueThread = 0;
-        }
-        eqPool[i].loadingTime = 0;
+        EventQueue * queue = eqPool[i];
+        MuPerformance::Release(queue->performance);
+        if(queue->buffer.data)
+            delete [] queue->buffer.data;
+        queue->buffer.data = NULL;
+        queue->buffer.max = 0;
+        ClearQueue(queue);
     }
+    
+    // the scheduler is no longer running, so nothing is due...
+    numDueQueues = 0;
+    activatedQueues = NULL;
 }
 
-bool MuPlayer::Init(void)
+bool MuPlayer::GrowPool(int newSize)
 {
-#ifdef MUM_MACOSX
-     long n,i;
+    int i;
     
-    OSStatus err = noErr;
+    // called with poolLock held, so only one thread grows the pool
+    // at a time, and no requesting thread is scanning it...
+    if((maxQueues != NO_QUEUE_LIMIT) && (newSize > maxQueues))
+        newSize = maxQueues;
+    if(newSize <= poolSize)
+        return false;
     
-    // create Client...
-    if(midiClient == 0)
+    // make room in the pointer arrays...
+    if(newSize > poolMax)
     {
-        err = MIDIClientCreate(CFSTR("MuM Playback"), NULL, NULL, &midiClient);
-        if(err == noErr)
-        {
-            // Create Output Port...
-            err = MIDIOutputPortCreate(midiClient, CFSTR("MuM Output"), &midiOutPort);
-            if(err == noErr)
-            {
-                // List Possible Destinations...
-                n = MIDIGetNumberOfDestinations();
-                if(n != 0)
-                {
-                    CFStringRef name;
-                    char cname[64];
-                    MIDIEndpointRef dest;
-                    
-                    // List Possible MIDI Destinations...
-                    for(i = 0; i < n; i++)
-                    {
-                        dest = MIDIGetDestination(i);
-                        if (dest != 0)
-                        {
-                            MIDIObjectGetStringProperty(dest, kMIDIPropertyName, &name);
-                            CFStringGetCString(name, cname, sizeof(cname), 0);
-                            CFRelease(name);
-                            cout << "[Destination " << i << "]: " << cname << endl << endl;
-                        }
-                    }
-                    
-                    // Choose a MIDI destination for playback...
-                    midiDest = MIDIGetDestination(0);
-                    
-                    if(StartScheduler())
-                        return true;
-                }
-                else
-                {
-                    cout << "No MIDI destinations present!\n" << endl;
-                }
-            }
-            else
-            {
-                cout << "Failed to open output port!\n" << endl;
-            }
-        }
-        else
+        EventQueue ** newPool = new EventQueue * [newSize];
+        EventQueue ** newDue = new EventQueue * [newSize];
+        if((newPool == NULL) || (newDue == NULL))
         {
-            cout << "Failed to create MIDI client!\n" << endl;
+            delete [] newPool;
+            delete [] newDue;
+            return false;
         }
+        for(i = 0; i < poolSize; i++)
+            newPool[i] = eqPool[i];
+        if((realtimeFlags & REALTIME_BUFFERS_LOCKED) &&
+           ((mlock(newPool, newSize * sizeof(EventQueue *)) != 0) ||
+            (mlock(newDue, newSize * sizeof(EventQueue *)) != 0)))
+            realtimeFlags &= ~REALTIME_BUFFERS_LOCKED;
+        
+        // the scheduler may be using its priority queue
+        // (and walks the pool when playback is paused)...
+        pthread_mutex_lock(&scheduleLock);
+        delete [] eqPool;
+        eqPool = newPool;
+        for(i = 0; i < numDueQueues; i++)
+            newDue[i] = dueQueues[i];
+        delete [] dueQueues;
+        dueQueues = newDue;
+        pthread_mutex_unlock(&scheduleLock);
+        
+        poolMax = newSize;
     }
-    else
-    {
-        cout << "Client already initialized! (call reset MIDI)\n" << endl;
-    }
-    
-    return false;
-#endif
-    
-#ifdef MUM_LINUX
-    unsigned int nPorts;
-    string portName;
     
-    // RtMidiOut constructor
-    try
-    {
-        midiout = new RtMidiOut(RtMidiOut::LINUX_ALSA, MUM_CLIENT_NAME);
-    }
-    catch( RtMidiError &error )
+    // create new queues...
+    while(poolSize < newSize)
     {
-        error.printMessage();
-        exit( EXIT_FAILURE );
+        EventQueue * queue = new EventQueue;
+        if(queue == NULL)
+            break;
+        queue->buffer.data = NULL;
+        queue->buffer.max = 0;
+        queue->player = this;
+        ClearQueue(queue);
+        if((realtimeFlags & REALTIME_BUFFERS_LOCKED) && !LockQueue(queue))
+            realtimeFlags &= ~REALTIME_BUFFERS_LOCKED;
+        pthread_mutex_lock(&scheduleLock);
+        eqPool[poolSize++] = queue;
+        pthread_mutex_unlock(&scheduleLock);
     }
     
-    // Check outputs.
-    nPorts = midiout->getPortCount();
-    
-    cout << endl << "Available MIDI ports:" << endl;
+    return true;
+}
+
+int MuPlayer::SelectQueue(void)
+{
+    int i, selected = -1;
     
-    for( unsigned int i = 0; i < nPorts; i++ )
+    pthread_mutex_lock(&poolLock);
+    for(int tries = 0; (tries < 2) && (selected < 0); tries++)
     {
-        try
-        {
-            portName = midiout->getPortName(i);
-        }
-        catch (RtMidiError &error)
+        // at the end of this loop, if at
+        // least one queue is available,
+        // its index is returned...
+        for (i = 0; i < poolSize; i++)
         {
-            error.printMessage();
+            // if the current queue is not being played or filled,
+            // claim it (its reset by the scheduler is visible to us
+            // once we see it free)...
+            int expected = QUEUE_FREE;
+            if(eqPool[i]->state.compare_exchange_strong(expected, QUEUE_LOADING, memory_order_acquire, memory_order_relaxed))
+            {
+                // requests made before the next Stop() are cancelled by it...
+                eqPool[i]->stopCount = stopCount.load(memory_order_acquire);
+                selected = i;
+                break;
+            }
         }
-        cout << "\tport " << i << ": " << portName << endl;
+        
+        // every queue is busy: double the pool and look again
+        // (new queues are placed after the old ones)...
+        if((selected < 0) && !GrowPool((poolSize > 0) ? (poolSize * 2) : MAX_QUEUES))
+            break;
     }
+    pthread_mutex_unlock(&poolLock);
     
-    selectedPort = 0;
+    return selected;
+}
+
+EventQueue * MuPlayer::PoolQueue(int i)
+{
+    EventQueue * queue;
     
-    if(selectedPort >= 0)
-    {
-        // Connect to available port.
-        midiout->openPort( selectedPort, MUM_PORT_NAME );
-    }
-    else
+    // the pointer array may be replaced by a growing pool,
+    // but the queue objects themselves never move...
+    pthread_mutex_lock(&poolLock);
+    queue = eqPool[i];
+    pthread_mutex_unlock(&poolLock);
+    
+    return queue;
+}
+
+bool MuPlayer::ReserveEvents(EventQueue * queue, long numEvents)
+{
+    // a recycled queue keeps its storage if it is big enough...
+    if(queue->buffer.max >= numEvents)
+        return true;
+    
+    MuMIDIMessage * data = new MuMIDIMessage[numEvents];
+    if(data == NULL)
+        return false;
+    delete [] queue->buffer.data;
+    queue->buffer.data = data;
+    queue->buffer.max = numEvents;
+    
+    // storage allocated after memory was locked is locked too...
+    MuPlayer * player = queue->player;
+    if((player->realtimeFlags & REALTIME_BUFFERS_LOCKED) &&
+       (mlock(data, numEvents * sizeof(MuMIDIMessage)) != 0))
+        player->realtimeFlags &= ~REALTIME_BUFFERS_LOCKED;
+    return true;
+}
+
+void MuPlayer::SetMaxQueues(int limit)
+{
+    pthread_mutex_lock(&poolLock);
+    maxQueues = (limit > 0) ? limit : NO_QUEUE_LIMIT;
+    pthread_mutex_unlock(&poolLock);
+}
+
+int MuPlayer::MaxQueues(void)
+{
+    int limit;
+    
+    pthread_mutex_lock(&poolLock);
+    limit = maxQueues;
+    pthread_mutex_unlock(&poolLock);
+    
+    return limit;
+}
+
+int MuPlayer::PoolSize(void)
+{
+    int size;
+    
+    pthread_mutex_lock(&poolLock);
+    size = poolSize;
+    pthread_mutex_unlock(&poolLock);
+    
+    return size;
+}
+
+int MuPlayer::ActiveQueues(void)
+{
+    int i, busy = 0;
+    
+    pthread_mutex_lock(&poolLock);
+    for(i = 0; i < poolSize; i++)
     {
-        // create a virtual port.
-        midiout->openVirtualPort(MUM_PORT_NAME);
+        if(eqPool[i]->state.load(memory_order_relaxed) != QUEUE_FREE)
+            busy++;
     }
+    pthread_mutex_unlock(&poolLock);
     
-     if(StartScheduler())
-                        return true;
+    return busy;
+}
 
-    return false;
-    
-#endif
+void MuPlayer::GetStats(MuPlaybackStats & stats)
+{
+    stats.eventsSent = statSent.load(memory_order_relaxed);
+    stats.lateEvents = statLate.load(memory_order_relaxed);
+    stats.lateThreshold = lateThreshold.load(memory_order_relaxed);
+    stats.totalLatency = statLatency.load(memory_order_relaxed);
+    stats.maxLatency = statMaxLatency.load(memory_order_relaxed);
+    stats.wakeups = statWakeups.load(memory_order_relaxed);
+    stats.queuesPlayed = statQueues.load(memory_order_relaxed);
+    for(int b = 0; b < STATS_BUCKETS; b++)
+    {
+        stats.latency[b] = latencyHist[b].load(memory_order_relaxed);
+        stats.jitter[b] = jitterHist[b].load(memory_order_relaxed);
+    }
 }
 
-bool MuPlayer::SelectMIDIDestination(int destNumber)
+void MuPlayer::ResetStats(void)
 {
-#ifdef MUM_MACOSX
-    if(destNumber >= 0) // FIXED: was 'destNumber > 0' - check if it works...
+    statSent.store(0, memory_order_relaxed);
+    statLate.store(0, memory_order_relaxed);
+    statLatency.store(0, memory_order_relaxed);
+    statMaxLatency.store(0, memory_order_relaxed);
+    statWakeups.store(0, memory_order_relaxed);
+    statQueues.store(0, memory_order_relaxed);
+    for(int b = 0; b < STATS_BUCKETS; b++)
     {
-        midiDest = MIDIGetDestination(destNumber);
-        if (midiDest != 0)
-        {
-            return true;
-        }
+        latencyHist[b].store(0, memory_order_relaxed);
+        jitterHist[b].store(0, memory_order_relaxed);
     }
-#endif
+}
+
+void MuPlayer::SetLateThreshold(long long nanoseconds)
+{
+    lateThreshold.store((nanoseconds > 0) ? nanoseconds : 0, memory_order_relaxed);
+}
+
+int MuPlayer::GetQueueStats(MuQueueStats * stats, int max)
+{
+    int i, n = 0;
+    long long now = NanoClockStamp();
     
-#ifdef MUM_LINUX
-    if(destNumber >= 0)
+    if(stats == NULL)
+        return 0;
+    
+    // the counters of active queues are kept by the scheduler,
+    // which holds its lock while it works...
+    pthread_mutex_lock(&scheduleLock);
+    for(i = 0; (i < poolSize) && (n < max); i++)
     {
-        midiout->closePort();
-        midiout->openPort( destNumber, MUM_PORT_NAME );
-        selectedPort = destNumber;
-        return true;
+        EventQueue * queue = eqPool[i];
+        if(queue->state.load(memory_order_relaxed) != QUEUE_ACTIVE)
+            continue;
+        MuQueueStats & qs = stats[n++];
+        qs.queue = i;
+        qs.eventsSent = queue->sentEvents;
+        qs.numEvents = queue->numEvents;
+        qs.lateEvents = queue->lateEvents;
+        qs.maxLatency = queue->maxLatency;
+        qs.elapsed = now - queue->loadingTime;
+        qs.throughput = (qs.elapsed > 0) ? ((double)qs.eventsSent * ONE_SECOND_NS / qs.elapsed) : 0.0;
+        qs.position = QueuePosition(queue, now);
     }
-#endif
+    pthread_mutex_unlock(&scheduleLock);
     
-    return false;
+    return n;
 }
 
-string MuPlayer::ListDestinations(void)
+void MuPlayer::SetStreamWindow(long numEvents)
 {
-    string list;
-    
+    streamWindow = (numEvents > 0) ? numEvents : NO_STREAMING;
+}
 
-#ifdef MUM_MACOSX
-    long n,i;
-    // Get number of destinations...
-    if(midiClient != 0)
+long MuPlayer::StreamWindow(void)
+{
+    return streamWindow;
+}
+
+bool MuPlayer::ReserveQueues(int numQueues, long numEvents)
+{
+    int i;
+    bool ok = true;
+    
+    pthread_mutex_lock(&poolLock);
+    if(numQueues > poolSize)
     {
-        n = MIDIGetNumberOfDestinations();
-        if(n != 0)
+        GrowPool(numQueues);
+        if(poolSize < numQueues)
+            ok = false;
+    }
+    
+    // only idle queues can have their storage replaced...
+    for(i = 0; i < poolSize; i++)
+    {
+        EventQueue * queue = eqPool[i];
+        int expected = QUEUE_FREE;
+        if(queue->state.compare_exchange_strong(expected, QUEUE_LOADING, memory_order_acquire, memory_order_relaxed))
         {
-            CFStringRef name;
-            char cname[64];
-            MIDIEndpointRef dest;
-            
-            // List Possible MIDI Destinations...
-            for(i = 0; i < n; i++)
+            if(!ReserveEvents(queue, numEvents))
+                ok = false;
+            queue->state.store(QUEUE_FREE, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&poolLock);
+    
+    return ok;
+}
+
+int MuPlayer::SetRealtime(const MuRealtimeConfig & config)
+{
+    realtime = config;
+    lockError = 0;
+    
+    // queues are created first, so their storage is locked too...
+    realtimeFlags &= ~REALTIME_PREALLOCATED;
+    if((config.numQueues > 0) && (config.numEvents > 0) && ReserveQueues(config.numQueues, config.numEvents))
+        realtimeFlags |= REALTIME_PREALLOCATED;
+    
+    if(config.lockMemory)
+    {
+        LockMemory();
+    }
+    else if(realtimeFlags & (REALTIME_MEMORY_LOCKED | REALTIME_BUFFERS_LOCKED))
+    {
+        munlockall();
+        realtimeFlags &= ~(REALTIME_MEMORY_LOCKED | REALTIME_BUFFERS_LOCKED);
+    }
+    
+    // thread settings wait for the scheduler if it isn't running...
+    if(schedulerThread != 0)
+        ApplySchedulerSettings();
+    
+    return realtimeFlags;
+}
+
+int MuPlayer::RealtimeSettings(void)
+{
+    return realtimeFlags;
+}
+
+// appends a line to a real-time report, explaining a refusal...
+static void ReportSetting(string & report, const char * setting, const char * state, int error)
+{
+    report += setting;
+    report += ": ";
+    report += state;
+    if(error != 0)
+    {
+        report += " (";
+        report += strerror(error);
+        report += ")";
+    }
+    report += "\n";
+}
+
+string MuPlayer::RealtimeReport(void)
+{
+    string report;
+    char buff[64];
+    
+    if((realtime.numQueues > 0) && (realtime.numEvents > 0))
+    {
+        snprintf(buff, sizeof(buff), "%d queues of %ld events", realtime.numQueues, realtime.numEvents);
+        ReportSetting(report, "preallocation", (realtimeFlags & REALTIME_PREALLOCATED) ? buff : "failed", 0);
+    }
+    
+    if(realtime.lockMemory)
+    {
+        if(realtimeFlags & REALTIME_MEMORY_LOCKED)
+            ReportSetting(report, "memory", "locked", 0);
+        else if(realtimeFlags & REALTIME_BUFFERS_LOCKED)
+            ReportSetting(report, "memory", "event buffers locked, process not locked", lockError);
+        else
+            ReportSetting(report, "memory", "not locked", lockError);
+    }
+    
+    if(realtime.priority != NO_REALTIME_PRIORITY)
+    {
+        snprintf(buff, sizeof(buff), "SCHED_FIFO %d", realtime.priority);
+        if(realtimeFlags & REALTIME_PRIORITY)
+            ReportSetting(report, "priority", buff, 0);
+        else if(schedulerThread == 0)
+            ReportSetting(report, "priority", "waiting for the scheduler to start", 0);
+        else
+            ReportSetting(report, "priority", "default policy", priorityError);
+    }
+    
+    if(realtime.cpu != ANY_CPU)
+    {
+        snprintf(buff, sizeof(buff), "CPU %d", realtime.cpu);
+        if(realtimeFlags & REALTIME_AFFINITY)
+            ReportSetting(report, "affinity", buff, 0);
+        else if(schedulerThread == 0)
+            ReportSetting(report, "affinity", "waiting for the scheduler to start", 0);
+        else
+            ReportSetting(report, "affinity", "any CPU", affinityError);
+    }
+    
+    return report;
+}
+
+void MuPlayer::LockMemory(void)
+{
+    int i;
+    bool ok = true;
+    
+    realtimeFlags &= ~(REALTIME_MEMORY_LOCKED | REALTIME_BUFFERS_LOCKED);
+    
+    // the whole process: code, thread stacks and every buffer,
+    // including those allocated later, as long as the limit leaves
+    // room for them (past it, every later allocation would fail)...
+    if(mlockall(MCL_CURRENT) == 0)
+    {
+        if(FutureLocksFit() && (mlockall(MCL_CURRENT | MCL_FUTURE) == 0))
+        {
+            realtimeFlags |= REALTIME_MEMORY_LOCKED;
+            return;
+        }
+        munlockall();
+        lockError = ENOMEM;
+    }
+    else
+        lockError = errno;
+    
+    // ...or at least what the scheduler touches while it plays (the
+    // flag is raised first, so GrowPool() and ReserveEvents() lock
+    // what they allocate from now on)
+    realtimeFlags |= REALTIME_BUFFERS_LOCKED;
+    if(mlock(this, sizeof(MuPlayer)) != 0)
+        ok = false;
+    pthread_mutex_lock(&poolLock);
+    if((poolMax > 0) &&
+       ((mlock(eqPool, poolMax * sizeof(EventQueue *)) != 0) ||
+        (mlock(dueQueues, poolMax * sizeof(EventQueue *)) != 0)))
+        ok = false;
+    for(i = 0; i < poolSize; i++)
+    {
+        if(!LockQueue(eqPool[i]))
+            ok = false;
+    }
+    pthread_mutex_unlock(&poolLock);
+    if(!ok)
+        realtimeFlags &= ~REALTIME_BUFFERS_LOCKED;
+}
+
+void MuPlayer::ApplySchedulerSettings(void)
+{
+    sched_param param;
+    int res;
+    
+    realtimeFlags &= ~(REALTIME_PRIORITY | REALTIME_AFFINITY);
+    priorityError = 0;
+    affinityError = 0;
+    
+    // priority: SCHED_FIFO within the range the system allows,
+    // or back to the policy the thread had before...
+    if(realtime.priority != NO_REALTIME_PRIORITY)
+    {
+        if(!policySaved)
+            policySaved = (pthread_getschedparam(schedulerThread, &savedPolicy, &savedParam) == 0);
+        param.sched_priority = realtime.priority;
+        if(param.sched_priority > sched_get_priority_max(SCHED_FIFO))
+            param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+        if(param.sched_priority < sched_get_priority_min(SCHED_FIFO))
+            param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        res = pthread_setschedparam(schedulerThread, SCHED_FIFO, &param);
+        if(res == 0)
+            realtimeFlags |= REALTIME_PRIORITY;
+        else
+            priorityError = res;
+    }
+    else if(policySaved)
+    {
+        pthread_setschedparam(schedulerThread, savedPolicy, &savedParam);
+        policySaved = false;
+    }
+    
+#ifdef MUM_LINUX
+    // affinity: a single CPU, or back to the mask the thread had before...
+    cpu_set_t cpus;
+    if(realtime.cpu != ANY_CPU)
+    {
+        if((realtime.cpu < 0) || (realtime.cpu >= CPU_SETSIZE))
+        {
+            affinityError = EINVAL;
+            return;
+        }
+        if(!cpusSaved)
+            cpusSaved = (pthread_getaffinity_np(schedulerThread, sizeof(savedCpus), &savedCpus) == 0);
+        CPU_ZERO(&cpus);
+        CPU_SET(realtime.cpu, &cpus);
+        res = pthread_setaffinity_np(schedulerThread, sizeof(cpus), &cpus);
+        if(res == 0)
+            realtimeFlags |= REALTIME_AFFINITY;
+        else
+            affinityError = res;
+    }
+    else if(cpusSaved)
+    {
+        pthread_setaffinity_np(schedulerThread, sizeof(savedCpus), &savedCpus);
+        cpusSaved = false;
+    }
+#else
+    // threads can't be bound to a CPU on other systems...
+    if(realtime.cpu != ANY_CPU)
+        affinityError = ENOTSUP;
+#endif
+}
+
+bool MuPlayer::Init(void)
+{
+#ifdef MUM_MACOSX
+     long n,i;
+    
+    OSStatus err = noErr;
+    
+    // create Client...
+    if(midiClient == 0)
+    {
+        err = MIDIClientCreate(CFSTR("MuM Playback"), NULL, NULL, &midiClient);
+        if(err == noErr)
+        {
+            // Create Output Port...
+            err = MIDIOutputPortCreate(midiClient, CFSTR("MuM Output"), &midiOutPort);
+            if(err == noErr)
             {
-                dest = MIDIGetDestination(i);
-                if (dest != 0)
+                // List Possible Destinations...
+                n = MIDIGetNumberOfDestinations();
+                if(n != 0)
                 {
-                    MIDIObjectGetStringProperty(dest, kMIDIPropertyName, &name);
-                    CFStringGetCString(name, cname, sizeof(cname), 0);
-                    CFRelease(name);
-                    list += cname;
-                    list += "\n";
+                    CFStringRef name;
+                    char cname[64];
+                    MIDIEndpointRef dest;
+                    
+                    // List Possible MIDI Destinations...
+                    for(i = 0; i < n; i++)
+                    {
+                        dest = MIDIGetDestination(i);
+                        if (dest != 0)
+                        {
+                            MIDIObjectGetStringProperty(dest, kMIDIPropertyName, &name);
+                            CFStringGetCString(name, cname, sizeof(cname), 0);
+                            CFRelease(name);
+                            cout << "[Destination " << i << "]: " << cname << endl << endl;
+                        }
+                    }
+                    
+                    // Choose a MIDI destination for playback...
+                    midiDest = MIDIGetDestination(0);
+                    
+                    // without loaders, materials are loaded by Play()...
+                    StartLoaders();
+                    if(StartScheduler())
+                        return true;
+                }
+                else
+                {
+                    cout << "No MIDI destinations present!\n" << endl;
                 }
             }
+            else
+            {
+                cout << "Failed to open output port!\n" << endl;
+            }
+        }
+        else
+        {
+            cout << "Failed to create MIDI client!\n" << endl;
         }
     }
+    else
+    {
+        cout << "Client already initialized! (call reset MIDI)\n" << endl;
+    }
+    
+    return false;
 #endif
     
 #ifdef MUM_LINUX
-    
     unsigned int nPorts;
     string portName;
     
+    // RtMidiOut constructor
+    try
+    {
+        midiout = new RtMidiOut(RtMidiOut::LINUX_ALSA, MUM_CLIENT_NAME);
+    }
+    catch( RtMidiError &error )
+    {
+        error.printMessage();
+        exit( EXIT_FAILURE );
+    }
+    
     // Check outputs.
     nPorts = midiout->getPortCount();
     
-    for ( unsigned int i = 0; i < nPorts; i++ )
+    cout << endl << "Available MIDI ports:" << endl;
+    
+    for( unsigned int i = 0; i < nPorts; i++ )
     {
         try
         {
@@ -274,337 +904,1351 @@ string MuPlayer::ListDestinations(void)
         {
             error.printMessage();
         }
-        
-        list += portName;
+        cout << "\tport " << i << ": " << portName << endl;
+    }
+    
+    selectedPort = 0;
+    
+    if(selectedPort >= 0)
+    {
+        // Connect to available port.
+        midiout->openPort( selectedPort, MUM_PORT_NAME );
+    }
+    else
+    {
+        // create a virtual port.
+        midiout->openVirtualPort(MUM_PORT_NAME);
+    }
+    
+    // without loaders, materials are loaded by Play()...
+    StartLoaders();
+    if(StartScheduler())
+        return true;
+
+    return false;
+    
+#endif
+}
+
+bool MuPlayer::Init(MuMIDISink * outputSink)
+{
+    if(outputSink == NULL)
+        return false;
+    
+    // no MIDI setup: every message goes to the sink...
+    SetOutputSink(outputSink);
+    StartLoaders();
+    return StartScheduler();
+}
+
+void MuPlayer::SetOutputSink(MuMIDISink * outputSink)
+{
+    // the scheduler holds this lock while it sends messages...
+    pthread_mutex_lock(&scheduleLock);
+    sink = outputSink;
+    pthread_mutex_unlock(&scheduleLock);
+}
+
+MuMIDISink * MuPlayer::OutputSink(void)
+{
+    return sink;
+}
+
+void MuPlayer::SetBatchOutput(bool T_F)
+{
+    // the scheduler sends every gathered message
+    // before it lets go of this lock...
+    pthread_mutex_lock(&scheduleLock);
+    batchOutput = T_F;
+    pthread_mutex_unlock(&scheduleLock);
+}
+
+bool MuPlayer::BatchOutput(void)
+{
+    return batchOutput;
+}
+
+bool MuPlayer::SetLookAhead(long long nanoseconds)
+{
+    if(nanoseconds < 0)
+        return false;
+    
+#ifdef MUM_LINUX
+    bool ok = true;
+    
+    // the sequencer queue is created the first time it is needed
+    // (under the lock, since the scheduler may be sending messages)...
+    pthread_mutex_lock(&scheduleLock);
+    if(nanoseconds != NO_LOOKAHEAD)
+        ok = (midiout != NULL) && midiout->startQueue();
+    if(ok)
+        lookAhead = nanoseconds;
+    pthread_cond_broadcast(&scheduleWakeup);
+    pthread_mutex_unlock(&scheduleLock);
+    return ok;
+#else
+    // messages are always sent when they are due...
+    return (nanoseconds == NO_LOOKAHEAD);
+#endif
+}
+
+long long MuPlayer::LookAhead(void)
+{
+    return lookAhead;
+}
+
+bool MuPlayer::SelectMIDIDestination(int destNumber)
+{
+#ifdef MUM_MACOSX
+    if(destNumber >= 0) // FIXED: was 'destNumber > 0' - check if it works...
+    {
+        midiDest = MIDIGetDestination(destNumber);
+        if (midiDest != 0)
+        {
+            return true;
+        }
+    }
+#endif
+    
+#ifdef MUM_LINUX
+    if(destNumber >= 0)
+    {
+        midiout->closePort();
+        midiout->openPort( destNumber, MUM_PORT_NAME );
+        selectedPort = destNumber;
+        return true;
+    }
+#endif
+    
+    return false;
+}
+
+string MuPlayer::ListDestinations(void)
+{
+    string list;
+    
+
+#ifdef MUM_MACOSX
+    long n,i;
+    // Get number of destinations...
+    if(midiClient != 0)
+    {
+        n = MIDIGetNumberOfDestinations();
+        if(n != 0)
+        {
+            CFStringRef name;
+            char cname[64];
+            MIDIEndpointRef dest;
+            
+            // List Possible MIDI Destinations...
+            for(i = 0; i < n; i++)
+            {
+                dest = MIDIGetDestination(i);
+                if (dest != 0)
+                {
+                    MIDIObjectGetStringProperty(dest, kMIDIPropertyName, &name);
+                    CFStringGetCString(name, cname, sizeof(cname), 0);
+                    CFRelease(name);
+                    list += cname;
+                    list += "\n";
+                }
+            }
+        }
+    }
+#endif
+    
+#ifdef MUM_LINUX
+    
+    unsigned int nPorts;
+    string portName;
+    
+    // Check outputs.
+    nPorts = midiout->getPortCount();
+    
+    for ( unsigned int i = 0; i < nPorts; i++ )
+    {
+        try
+        {
+            portName = midiout->getPortName(i);
+        }
+        catch (RtMidiError &error)
+        {
+            error.printMessage();
+        }
+        
+        list += portName;
+    }
+
+#endif
+    
+    return list;
+}
+
+void MuPlayer::Reset(void)
+{
+    // Stop scheduler thread
+    if(schedulerThread != 0)
+    {
+        // wait until it is gone, so the pool can be cleaned safely...
+        pthread_cancel(schedulerThread);
+        pthread_join(schedulerThread, NULL);
+        schedulerThread = 0;
+    }
+    // thread settings go with the thread, the request is kept for Init()...
+    realtimeFlags &= ~(REALTIME_PRIORITY | REALTIME_AFFINITY);
+    policySaved = false;
+#ifdef MUM_LINUX
+    cpusSaved = false;
+#endif
+
+    // Stop loader threads and release all queue buffers
+    StopLoaders();
+    CleanPlaybackPool();
+    realtimeFlags &= ~REALTIME_PREALLOCATED;
+    
+    // Release MIDI components...
+#ifdef MUM_MACOSX
+    midiDest = 0;
+    midiOutPort = 0;
+    midiClient = 0;
+#endif
+    
+#ifdef MUM_LINUX
+    if(midiout != NULL)
+    {
+        midiout->closePort();
+        delete midiout;
+        midiout = NULL;
+    }
+#endif
+    sink = NULL;
+    batchCount = 0;
+    batchLength = 0;
+    lookAhead = NO_LOOKAHEAD;
+    scheduledAhead = NO_LOOKAHEAD;
+    tempo = NORMAL_TEMPO;
+}
+
+bool MuPlayer::Play(MuMaterial & inMat, int mode)
+{
+    int selectedQueue = -1;
+    
+    // First find a usable event queue...
+    if(mode == PLAYBACK_MODE_NORMAL)
+    {
+        selectedQueue = SelectQueue();
+        
+        // if unused queue is found...
+        if(selectedQueue >= 0)
+        {
+            // start the queue's working thread...
+            PoolQueue(selectedQueue)->window = streamWindow;
+            StartQueueThread(inMat,selectedQueue);
+        }
+        else
+        {
+            // otherwise report failure...
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MuPlayer::Play(const MuPerformance & perf)
+{
+    int selectedQueue;
+    EventQueue * queue;
+    
+    if(perf.NumberOfEvents() == 0)
+        return false;
+    
+    selectedQueue = SelectQueue();
+    if(selectedQueue < 0)
+        return false;
+    
+    // the queue reads the performance's events directly,
+    // so it can be activated right away...
+    queue = PoolQueue(selectedQueue);
+    queue->performance = perf.Acquire();
+    queue->events = queue->performance->events;
+    queue->numEvents = queue->performance->count;
+    queue->window = queue->numEvents;
+    queue->next = 0;
+    queue->played = 0;
+    queue->paused = false;
+    queue->loadingTime = NanoClockStamp();
+    ActivateQueue(queue);
+    
+    return true;
+}
+
+bool MuPlayer::SendProgramChange(unsigned char channel, unsigned char pc)
+{
+    MuMIDIBuffer programChange;
+    programChange.data = new MuMIDIMessage[1];
+    if(programChange.data)
+    {
+        programChange.max = 1;
+        programChange.count = 1;
+        
+        programChange.data[0].time = 0.0;
+        programChange.data[0].stamp = 0;
+        programChange.data[0].status = 0xC0 + channel;
+        programChange.data[0].data1 = pc;
+        programChange.data[0].data2 = pc;
+        
+        if(this->SendEvents(programChange) == false)
+        {
+            // the buffer is only released by accepted requests...
+            delete [] programChange.data;
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+    
+    return true;
+}
+
+bool MuPlayer::SendEvents(MuMIDIBuffer events)
+{
+    int selectedQueue = SelectQueue();
+    
+    // if unused queue is found...
+    if(selectedQueue >= 0)
+    {
+        // start the queue thread...
+        StartQueueThread(events,selectedQueue);
+    }
+    else
+    {
+        // otherwise report failure...
+        return false;
+    }
+    return true;
+}
+
+
+
+bool MuPlayer::StartQueueThread(MuMaterial & inMat, int queueIdx)
+{
+    EventQueue * queue = PoolQueue(queueIdx);
+    
+    // make a copy of the input material so the loader can
+    // work on it safely, as it will be working assynchronously
+    queue->material = inMat;
+    queue->loader = MuPlayer::EnqueueMaterial;
+    
+    // hand the queue to the loaders...
+    if(PushJob(queue))
+        return true;
+    
+    // ...or, if none is available, load it right here
+    // (without streaming, as its refills are loader jobs)...
+    queue->window = NO_STREAMING;
+    EnqueueMaterial(queue);
+    return true;
+}
+
+bool MuPlayer::StartQueueThread(MuMIDIBuffer events, int queueIdx)
+{
+    EventQueue * queue = PoolQueue(queueIdx);
+    
+    // keep the input event buffer for the loader, which
+    // will copy it to the queue assynchronously
+    queue->input = events;
+    queue->loader = MuPlayer::EnqueueEvents;
+    
+    // hand the queue to the loaders, or load it right here...
+    if(!PushJob(queue))
+        EnqueueEvents(queue);
+    return true;
+}
+
+bool MuPlayer::StartLoaders(void)
+{
+    // loaders are already running...
+    if(numLoaders > 0)
+        return true;
+    
+    while(numLoaders < LOADER_THREADS)
+    {
+        if(pthread_create(&loaders[numLoaders], NULL, MuPlayer::RunLoader, (void*)this) != 0)
+        {
+            cout << "Failed to start loader thread!" << endl;
+            break;
+        }
+        numLoaders++;
+    }
+    
+    return (numLoaders > 0);
+}
+
+void MuPlayer::StopLoaders(void)
+{
+    // loaders only stop at cancellation points, while waiting for
+    // jobs (refills of streaming queues left in the ring are dropped
+    // with the rest)...
+    for(int i = 0; i < numLoaders; i++)
+        pthread_cancel(loaders[i]);
+    for(int i = 0; i < numLoaders; i++)
+        pthread_join(loaders[i], NULL);
+    numLoaders = 0;
+    
+    // forget jobs which were never started...
+    while(PopJob() != NULL);
+    idleLoaders.store(0, memory_order_relaxed);
+}
+
+bool MuPlayer::PushJob(EventQueue * queue)
+{
+    LoaderJob * cell;
+    unsigned long pos, seq;
+    
+    if(numLoaders == 0)
+        return false;
+    
+    // claim the next free cell (each cell's sequence tells
+    // whether it is free for position 'pos')...
+    pos = jobHead.load(memory_order_relaxed);
+    while(true)
+    {
+        cell = &jobs[pos & (LOADER_JOBS - 1)];
+        seq = cell->sequence.load(memory_order_acquire);
+        long diff = (long)(seq - pos);
+        if(diff == 0)
+        {
+            if(jobHead.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                break;
+        }
+        else if(diff < 0)
+        {
+            // the job queue is full...
+            return false;
+        }
+        else
+        {
+            pos = jobHead.load(memory_order_relaxed);
+        }
+    }
+    
+    // publish the job...
+    cell->queue = queue;
+    cell->sequence.store(pos + 1, memory_order_release);
+    
+    // ...and wake up a loader, if they are all asleep (a read-modify-write
+    // sees the latest count, and a loader which counts itself afterwards
+    // is sure to see the job; see RunLoader())
+    if(idleLoaders.fetch_add(0, memory_order_acq_rel) > 0)
+    {
+        pthread_mutex_lock(&loaderLock);
+        pthread_cond_signal(&loaderWakeup);
+        pthread_mutex_unlock(&loaderLock);
+    }
+    
+    return true;
+}
+
+EventQueue * MuPlayer::PopJob(void)
+{
+    LoaderJob * cell;
+    EventQueue * queue;
+    unsigned long pos, seq;
+    
+    pos = jobTail.load(memory_order_relaxed);
+    while(true)
+    {
+        cell = &jobs[pos & (LOADER_JOBS - 1)];
+        seq = cell->sequence.load(memory_order_acquire);
+        long diff = (long)(seq - (pos + 1));
+        if(diff == 0)
+        {
+            if(jobTail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                break;
+        }
+        else if(diff < 0)
+        {
+            // no jobs...
+            return NULL;
+        }
+        else
+        {
+            pos = jobTail.load(memory_order_relaxed);
+        }
+    }
+    
+    // take the job and free the cell for the next round...
+    queue = cell->queue;
+    cell->sequence.store(pos + LOADER_JOBS, memory_order_release);
+    return queue;
+}
+
+void * MuPlayer::RunLoader(void * pl)
+{
+    MuPlayer * player = (MuPlayer *)pl;
+    EventQueue * queue;
+    
+    while(true)
+    {
+        queue = player->PopJob();
+        if(queue == NULL)
+        {
+            // announce we are going to sleep, then look again, so a
+            // job pushed in between can't be missed (see PushJob())...
+            pthread_mutex_lock(&player->loaderLock);
+            pthread_cleanup_push(UnlockMutex, &player->loaderLock);
+            player->idleLoaders.fetch_add(1, memory_order_acq_rel);
+            queue = player->PopJob();
+            while(queue == NULL)
+            {
+                pthread_cond_wait(&player->loaderWakeup, &player->loaderLock);
+                queue = player->PopJob();
+            }
+            player->idleLoaders.fetch_sub(1, memory_order_relaxed);
+            pthread_cleanup_pop(1);
+        }
+        
+        // fill up the queue...
+        queue->loader(queue);
+    }
+    
+    return NULL;
+}
+
+void * MuPlayer::EnqueueMaterial(void* arg)
+{
+    EventQueue * queue = (EventQueue *)arg;
+    
+    if(!LoadMaterial(queue))
+    {
+        // nothing to play: the queue goes back to the pool...
+        queue->material.Clear();
+        queue->compiler.Clear();
+        queue->state.store(QUEUE_FREE, memory_order_release);
+    }
+    
+    return NULL;
+}
+
+bool MuPlayer::LoadMaterial(EventQueue * queue)
+{
+    MuEventCompiler & compiler = queue->compiler;
+    long numEvents, window;
+    bool streaming;
+    
+    // extract note events from input material (a streaming
+    // queue keeps the compiler until its last refill)...
+    if(!compiler.Start(queue->material))
+        return false;
+    queue->material.Clear();
+    
+    // each note needs two MIDI events (on/off) per note
+    numEvents = compiler.NumberOfEvents();
+    if(numEvents == 0)
+        return false;
+    
+    // materials which fit in the stream window are compiled at once;
+    // longer ones get a ring of 'window' events...
+    window = queue->window;
+    if((window <= 0) || (numEvents <= window))
+        window = numEvents;
+    streaming = (window < numEvents);
+    
+    // make room for the note events (a recycled queue
+    // reuses the storage it already has, if possible)...
+    if(!ReserveEvents(queue, window))
+        return false;
+    
+    // compile the notes into events, already in chronological
+    // order (just the first chunk, when streaming)...
+    queue->events = queue->buffer.data;
+    queue->window = window;
+    queue->numEvents = compiler.Compile(queue->buffer.data, streaming ? StreamChunk(window) : window);
+    queue->buffer.count = queue->numEvents;
+    queue->streaming = streaming;
+    queue->waiting = false;
+    queue->next = 0;
+    queue->played = 0;
+    queue->paused = false;
+    if(!streaming)
+        compiler.Clear();
+    
+    // IMPORTANT: LOADING TIME
+    // The following timestamp is registering this moment, after
+    // the event buffer has been successfully allocated and filled,
+    // to be the initial time for playback of this queue. All events
+    // in the queue will be referenced  from this point. The amount
+    // of nanoseconds retrieved hear will be added to the stamp
+    // of every event so the scheduler can compare stamps and decide
+    // when to send the messages.
+    queue->loadingTime = NanoClockStamp();
+    //cout << "[Loading Time]: " << queue->loadingTime << endl;
+    
+    // after the queue is set to 'active' the scheduler may
+    // use it at any moment (even at interrupt time). That's
+    // why this MUST BE THE LAST ACTION (unless the queue is
+    // streaming, in which case the scheduler won't recycle
+    // it before the stream is over)! A streaming queue gets
+    // the rest of its ring now, and later refills as jobs...
+    ActivateQueue(queue);
+    if(streaming)
+        StreamEvents(queue);
+    
+    return true;
+}
+
+void * MuPlayer::StreamEvents(void * arg)
+{
+    EventQueue * queue = (EventQueue *)arg;
+    long room, n = 0;
+    bool stopped;
+    
+    // one refill of a streaming queue: no other refill is under way, and
+    // the scheduler only frees slots while we work (a stopped queue is
+    // drained by the scheduler, and gets no more events)...
+    pthread_mutex_lock(&scheduleLock);
+    stopped = (queue->state.load(memory_order_relaxed) == QUEUE_DRAINING);
+    room = queue->window - (queue->numEvents - queue->played);
+    pthread_mutex_unlock(&scheduleLock);
+    
+    if(stopped)
+        queue->compiler.Clear();
+    else
+        n = FillRing(queue, room);
+    
+    pthread_mutex_lock(&scheduleLock);
+    PublishEvents(queue, n);
+    pthread_mutex_unlock(&scheduleLock);
+    
+    return NULL;
+}
+
+void MuPlayer::PublishEvents(EventQueue * queue, long numEvents)
+{
+    // called with scheduleLock held, after a refill: the new
+    // events are handed to the scheduler, which may have run
+    // out of events while they were compiled...
+    queue->numEvents += numEvents;
+    if(queue->compiler.Remaining() == 0)
+    {
+        // the scheduler recycles the queue after its last event...
+        queue->streaming = false;
+        if(queue->starved)
+            LinkActivatedQueue(queue);
+    }
+    else if(queue->state.load(memory_order_relaxed) == QUEUE_DRAINING)
+    {
+        // stopped while it was refilled: one more job lets it go...
+        RefillQueue(queue);
+    }
+    else
+    {
+        if(queue->starved)
+            LinkActivatedQueue(queue);
+        
+        // the next refill waits until there is room for another
+        // chunk (the scheduler may have made it already)...
+        queue->waiting = true;
+        ReleasePlayed(queue, NanoClockStamp());
+    }
+}
+
+void MuPlayer::RefillQueue(EventQueue * queue)
+{
+    // called with scheduleLock held, when a streaming queue
+    // waiting for room has room for another chunk, or when it
+    // is stopped: its next refill goes to the loaders...
+    queue->waiting = false;
+    queue->loader = MuPlayer::StreamEvents;
+    if(queue->player->PushJob(queue))
+        return;
+    
+    // ...or, if the job ring is full, it is done right here
+    // (the scheduler reads no slot while we hold the lock)...
+    long n = 0;
+    if(queue->state.load(memory_order_relaxed) == QUEUE_DRAINING)
+        queue->compiler.Clear();
+    else
+        n = FillRing(queue, queue->window - (queue->numEvents - queue->played));
+    PublishEvents(queue, n);
+}
+
+void * MuPlayer::EnqueueEvents(void* arg)
+{
+    long i, n;
+    EventQueue * queue = (EventQueue *)arg;
+    MuMIDIBuffer tempBuff = queue->input;
+    n = (tempBuff.data != NULL) ? tempBuff.count : 0;
+    
+    // make room for the events (a recycled queue
+    // reuses the storage it already has, if possible)...
+    if(n > 0)
+    {
+        // copy MIDI events from input buffer (calling code
+        // may not fill stamps, so they come from times)...
+        if(ReserveEvents(queue, n))
+        {
+            for(i = 0; i < n; i++)
+            {
+                queue->buffer.data[i] = tempBuff.data[i];
+                queue->buffer.data[i].stamp = TimeToNanoStamp(tempBuff.data[i].time);
+            }
+            queue->buffer.count = n;
+            queue->events = queue->buffer.data;
+            queue->numEvents = n;
+            queue->window = n;
+            queue->next = 0;
+            queue->played = 0;
+            queue->paused = false;
+            
+            // the input buffer belongs to the queue
+            // since SendEvents() accepted it...
+            delete [] tempBuff.data;
+            queue->input.data = NULL;
+            queue->input.count = 0;
+            queue->input.max = 0;
+            
+            // IMPORTANT: LOADING TIME
+            // The following timestamp is registering this moment, after
+            // the event buffer has been successfully allocated and filled,
+            // to be the initial time for playback of this queue. All events
+            // in the queue will be referenced  from this point. The amount
+            // of nanoseconds retrieved hear will be added to the stamp
+            // of every event so the scheduler can compare stamps and decide
+            // when to send the messages.
+            queue->loadingTime = NanoClockStamp();
+            //cout << "[Loading Time]: " << queue->loadingTime << endl;
+            
+            // after the queue is set to 'active' the scheduler may
+            // use it at any moment (even at interrupt time). That's
+            // why this MUST BE THE LAST ACTION!
+            ActivateQueue(queue);
+            return NULL;
+        }
+    }
+    
+    // nothing to send: the queue goes back to the pool...
+    delete [] tempBuff.data;
+    queue->input.data = NULL;
+    queue->input.count = 0;
+    queue->input.max = 0;
+    queue->state.store(QUEUE_FREE, memory_order_release);
+    
+    return NULL;
+}
+
+
+bool MuPlayer::StartScheduler(void)
+{
+    int res;
+    pthread_once(&scheduleOnce, MuPlayer::InitScheduleWakeup);
+    res = pthread_create(&schedulerThread, NULL, MuPlayer::ScheduleEvents, (void*)this);
+    if(res)
+    {
+        // the player can't be used, but the application may go on...
+        cout << "Failed to start scheduler thread!" << endl;
+        schedulerThread = 0;
+        return false;
+    }
+    
+    // real-time settings requested before Init()...
+    ApplySchedulerSettings();
+
+    return true;
+}
+
+void MuPlayer::InitScheduleWakeup(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+#ifdef MUM_LINUX
+    // deadlines are measured with the monotonic clock (see NanoClockStamp())...
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init(&scheduleWakeup, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void MuPlayer::WakeScheduler(void)
+{
+    pthread_once(&scheduleOnce, MuPlayer::InitScheduleWakeup);
+    pthread_mutex_lock(&scheduleLock);
+    pthread_cond_broadcast(&scheduleWakeup);
+    pthread_mutex_unlock(&scheduleLock);
+}
+
+void MuPlayer::ActivateQueue(EventQueue * queue)
+{
+    // hand the queue to the scheduler, which may be sleeping
+    // (the lock publishes everything the loader wrote to it)...
+    pthread_once(&scheduleOnce, MuPlayer::InitScheduleWakeup);
+    pthread_mutex_lock(&scheduleLock);
+    queue->state.store(QUEUE_ACTIVE, memory_order_release);
+    
+    // its events are timed from this moment, at the current tempo...
+    queue->scale = queue->tempo * queue->player->tempo;
+    queue->origin = queue->loadingTime;
+    LinkActivatedQueue(queue);
+    pthread_mutex_unlock(&scheduleLock);
+}
+
+void MuPlayer::LinkActivatedQueue(EventQueue * queue)
+{
+    // called with scheduleLock held...
+    queue->starved = false;
+    queue->nextActivated = queue->player->activatedQueues;
+    queue->player->activatedQueues = queue;
+    pthread_cond_broadcast(&scheduleWakeup);
+}
+
+void MuPlayer::RecycleQueue(EventQueue * queue)
+{
+    // reset queue (its event storage is kept for
+    // the next request; a performance is let go)...
+    queue->state.store(QUEUE_DRAINING, memory_order_relaxed);
+    MuPerformance::Release(queue->performance);
+    queue->performance = NULL;
+    queue->events = NULL;
+    queue->numEvents = 0;
+    queue->window = 0;
+    queue->streaming = false;
+    queue->starved = false;
+    queue->waiting = false;
+    queue->buffer.count = 0;
+    queue->paused = false;
+    queue->next = 0;
+    queue->played = 0;
+    queue->loader = NULL;
+    queue->loadingTime = 0;
+    queue->nextTime = 0;
+    queue->tempo = NORMAL_TEMPO;
+    queue->scale = NORMAL_TEMPO;
+    queue->origin = 0;
+    queue->sentEvents = 0;
+    queue->lateEvents = 0;
+    queue->maxLatency = 0;
+    queue->player->statQueues.fetch_add(1, memory_order_relaxed);
+    // lastly deactivate queue (a request which claims it
+    // afterwards sees everything reset above)...
+    queue->state.store(QUEUE_FREE, memory_order_release);
+}
+
+void MuPlayer::CancelQueue(EventQueue * queue)
+{
+    // called by the scheduler, with scheduleLock held...
+    if(queue->streaming)
+    {
+        // the loaders may be refilling the queue: its refill stops as
+        // soon as it sees it draining, and hands it back to be recycled
+        // (a queue waiting for room gets one more refill to do that)...
+        queue->state.store(QUEUE_DRAINING, memory_order_relaxed);
+        queue->starved = true;
+        if(queue->waiting)
+            RefillQueue(queue);
+    }
+    else
+    {
+        RecycleQueue(queue);
+    }
+}
+
+void MuPlayer::DrainStoppedQueues(unsigned long stops)
+{
+    int i, kept = 0;
+    
+    // called by the scheduler, with scheduleLock held: queues
+    // picked before the last Stop() leave the priority queue
+    // (and their events leave the sequencer)...
+    ClearScheduledOutput(true);
+    for(i = 0; i < numDueQueues; i++)
+    {
+        if(dueQueues[i]->stopCount == stops)
+            dueQueues[kept++] = dueQueues[i];
+        else
+            CancelQueue(dueQueues[i]);
+    }
+    numDueQueues = kept;
+    
+    // ...and the ones left are put back in order
+    for(i = (numDueQueues / 2) - 1; i >= 0; i--)
+        SiftDueQueue(i);
+}
+
+void MuPlayer::RecordDispatch(EventQueue * queue, long long latency)
+{
+    long long jitter = latency - lastLatency;
+    
+    // called by the scheduler for every event it sends (only the
+    // scheduler writes these counters, so plain increments would
+    // do, but GetStats() and ResetStats() run on other threads)...
+    lastLatency = latency;
+    if(jitter < 0)
+        jitter = -jitter;
+    statSent.fetch_add(1, memory_order_relaxed);
+    statLatency.fetch_add(latency, memory_order_relaxed);
+    latencyHist[StatsBucket(latency)].fetch_add(1, memory_order_relaxed);
+    jitterHist[StatsBucket(jitter)].fetch_add(1, memory_order_relaxed);
+    if(latency > statMaxLatency.load(memory_order_relaxed))
+        statMaxLatency.store(latency, memory_order_relaxed);
+    
+    queue->sentEvents++;
+    if(latency > queue->maxLatency)
+        queue->maxLatency = latency;
+    if(latency > lateThreshold.load(memory_order_relaxed))
+    {
+        statLate.fetch_add(1, memory_order_relaxed);
+        queue->lateEvents++;
+    }
+}
+
+void MuPlayer::Dispatch(const MuMIDIMessage & msg, long long due)
+{
+    // called by the scheduler, with scheduleLock held...
+    if(sink != NULL)
+    {
+        sink->Send(msg, due);
+        return;
+    }
+    
+    // gather messages due in the same tick, to be sent together
+    // (messages sent ahead of time always go in batches)...
+    if(batchOutput || (scheduledAhead != NO_LOOKAHEAD))
+    {
+        if(batchCount == OUTPUT_BATCH)
+            FlushBatch();
+        unsigned char * bytes = batchBytes + batchLength;
+        bytes[0] = msg.status;
+        bytes[1] = msg.data1;
+        bytes[2] = msg.data2;
+        batchDue[batchCount] = due;
+        batchSizes[batchCount] = MuMIDISink::MessageLength(msg.status);
+        batchLength += batchSizes[batchCount];
+        batchCount++;
+        return;
+    }
+    
+#ifdef MUM_MACOSX
+    SendMIDIMessage(msg, midiOutPort, midiDest);
+#endif
+    
+#ifdef MUM_LINUX
+    SendMIDIMessage(msg, midiout);
+#endif
+}
+
+void MuPlayer::FlushOutput(void)
+{
+    if(batchCount > 0)
+        FlushBatch();
+    if(sink != NULL)
+        sink->Flush();
+}
+
+void MuPlayer::FlushBatch(void)
+{
+    int i;
+    
+#ifdef MUM_MACOSX
+    if((midiOutPort != 0) && (midiDest != 0))
+    {
+        MIDITimeStamp timestamp = 0.0;
+        Byte buffer[1024]; // storage space for MIDI Packets
+        MIDIPacketList * packetlist = (MIDIPacketList*)buffer;
+        MIDIPacket * packet = MIDIPacketListInit(packetlist);
+        unsigned char * bytes = batchBytes;
+        
+        // every message goes into one packet list...
+        for(i = 0; i < batchCount; i++)
+        {
+            packet = MIDIPacketListAdd( packetlist, sizeof(buffer),
+                                       packet, timestamp,
+                                       batchSizes[i], bytes );
+            
+            // ...unless it is full: then it is sent and started again
+            if(packet == NULL)
+            {
+                MIDISend(midiOutPort, midiDest, packetlist);
+                packet = MIDIPacketListInit(packetlist);
+                packet = MIDIPacketListAdd( packetlist, sizeof(buffer),
+                                           packet, timestamp,
+                                           batchSizes[i], bytes );
+            }
+            bytes += batchSizes[i];
+        }
+        MIDISend(midiOutPort, midiDest, packetlist);
+    }
+#endif
+    
+#ifdef MUM_LINUX
+    // RtMidi queues every message and drains its output once...
+    if(midiout != NULL)
+    {
+        if(scheduledAhead != NO_LOOKAHEAD)
+        {
+            // ...and the sequencer holds each one until it is due
+            long long now = NanoClockStamp();
+            for(i = 0; i < batchCount; i++)
+                batchDelays[i] = (double)(batchDue[i] - now) / ONE_SECOND_NS;
+            midiout->scheduleMessages(batchBytes, batchSizes, batchDelays, batchCount);
+        }
+        else
+        {
+            midiout->sendMessages(batchBytes, batchSizes, batchCount);
+        }
+    }
+#endif
+    
+    batchCount = 0;
+    batchLength = 0;
+}
+
+// true if queue 'a' should send its next event before queue 'b'
+// (on equal times, the queue which started playing first goes first)...
+static bool DueBefore(EventQueue * a, EventQueue * b)
+{
+    if(a->nextTime != b->nextTime)
+        return a->nextTime < b->nextTime;
+    return a->loadingTime < b->loadingTime;
+}
+
+void MuPlayer::PushDueQueue(EventQueue * queue)
+{
+    int i = numDueQueues++;
+    while(i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if(!DueBefore(queue, dueQueues[parent]))
+            break;
+        dueQueues[i] = dueQueues[parent];
+        i = parent;
     }
-
-#endif
-    
-    return list;
+    dueQueues[i] = queue;
 }
 
-void MuPlayer::Reset(void)
+void MuPlayer::SiftDueQueue(int i)
 {
-    // Stop scheduler thread
-    if(schedulerThread != 0)
+    EventQueue * queue = dueQueues[i];
+    while(true)
     {
-        pthread_cancel(schedulerThread);
-        schedulerThread = 0;
+        int child = (2 * i) + 1;
+        if(child >= numDueQueues)
+            break;
+        if((child + 1 < numDueQueues) && DueBefore(dueQueues[child + 1], dueQueues[child]))
+            child++;
+        if(!DueBefore(dueQueues[child], queue))
+            break;
+        dueQueues[i] = dueQueues[child];
+        i = child;
     }
+    dueQueues[i] = queue;
+}
 
-    // Release all queue buffers and threads
-    CleanPlaybackPool();
+void MuPlayer::FinishDueQueue(EventQueue * queue)
+{
+    // take it out of the priority queue (it is at the top)...
+    numDueQueues--;
+    if(numDueQueues > 0)
+    {
+        dueQueues[0] = dueQueues[numDueQueues];
+        SiftDueQueue(0);
+    }
     
-    // Release MIDI components...
-#ifdef MUM_MACOSX
-    midiDest = 0;
-    midiOutPort = 0;
-    midiClient = 0;
-#endif
+    // a streaming queue waits for more events
+    // (its refill will hand it back)...
+    if(queue->streaming)
+        queue->starved = true;
+    else
+        RecycleQueue(queue);
+}
+
+void MuPlayer::ReleasePlayed(EventQueue * queue, long long now)
+{
+    // events which are due have left the sequencer (without
+    // look-ahead, every event sent), so their slots may be
+    // reused by a streaming queue...
+    while((queue->played < queue->next) && (QueueDue(queue, queue->played) <= now))
+        queue->played++;
     
+    // ...which is refilled once there is room for another chunk
+    if(queue->waiting && (queue->played > StreamRoomEvent(queue)))
+        RefillQueue(queue);
+}
+
+long long MuPlayer::ScheduleAhead(void)
+{
+    // called by the scheduler, with scheduleLock held
+    // (sinks always receive messages when they are due)...
+    if(sink != NULL)
+        return NO_LOOKAHEAD;
+    return lookAhead;
+}
+
+void MuPlayer::ClearScheduledOutput(bool keepNoteOffs)
+{
 #ifdef MUM_LINUX
-    midiout->closePort();
-    delete midiout;
+    // messages waiting in the sequencer are discarded, except note
+    // offs when playback stops or pauses, so sounding notes still
+    // end (queues which go on at another time or position send
+    // their own note offs, and old ones would cut new notes short)...
+    if(midiout != NULL)
+        midiout->clearQueue(keepNoteOffs);
 #endif
 }
 
-bool MuPlayer::Play(MuMaterial & inMat, int mode)
+void MuPlayer::RewindDueQueues(bool keepNoteOffs)
 {
+    long long now = NanoClockStamp();
+    EventQueue * queue;
     int i;
-    int selectedQueue = -1;
-    MuNote note;
     
-    // First find a usable event queue...
-    if(mode == PLAYBACK_MODE_NORMAL)
+    // called with scheduleLock held, when playback is paused, moved
+    // or retimed: events handed to the sequencer which are not due
+    // yet are taken back, to be sent again when playback goes on...
+    ClearScheduledOutput(keepNoteOffs);
+    for(i = 0; i < poolSize; i++)
     {
-        // at the end of this loop, if at
-        // least one queue is available,
-        // selectedQueue contains its index..
-        for (i = 0; i < MAX_QUEUES; i++)
+        queue = eqPool[i];
+        if(queue->state.load(memory_order_relaxed) != QUEUE_ACTIVE)
+            continue;
+        ReleasePlayed(queue, now);
+        if(queue->played < queue->next)
         {
-            // if the current queue is not being played or filled,...
-            if(eqPool[i].active == false && eqPool[i].loading == false)
+            queue->sentEvents -= queue->next - queue->played;
+            queue->next = queue->played;
+            
+            // a streaming queue waiting for events goes back to
+            // the priority queue (the others are already there,
+            // or waiting to be moved there)...
+            if(queue->starved)
             {
-                // it can be selected for a new material...
-                selectedQueue = i;
-                // mark queue as under construction...
-                eqPool[i].loading = true;
-                break;
+                queue->starved = false;
+                dueQueues[numDueQueues++] = queue;
             }
         }
-        // if unused queue is found...
-        if(selectedQueue >= 0)
-        {
-            // start the queue's working thread...
-            StartQueueThread(inMat,selectedQueue);
-        }
-        else
-        {
-            // otherwise report failure...
-            return false;
-        }
     }
-
-    return true;
+    
+    // ...and the priority queue is put back in order
+    RetimeDueQueues();
 }
 
-bool MuPlayer::SendProgramChange(unsigned char channel, unsigned char pc)
+void MuPlayer::RetimeDueQueues(void)
 {
-    MuMIDIBuffer programChange;
-    programChange.data = new MuMIDIMessage[1];
-    if(programChange.data)
-    {
-        programChange.max = 1;
-        programChange.count = 1;
-        
-        programChange.data[0].time = 0.0;
-        programChange.data[0].status = 0xC0 + channel;
-        programChange.data[0].data1 = pc;
-        programChange.data[0].data2 = pc;
-        
-        if(this->SendEvents(programChange) == false)
-            return false;
-    }
-    else
+    EventQueue * queue;
+    int i;
+    
+    // called with scheduleLock held, after queues were rewound or
+    // moved: each queue's place depends on its next event (or, after
+    // its last one, on the moment it leaves the sequencer)...
+    for(i = 0; i < numDueQueues; i++)
     {
-        return false;
+        queue = dueQueues[i];
+        queue->nextTime = QueueWakeup(queue, scheduledAhead);
     }
-    
-    return true;
+    for(i = (numDueQueues / 2) - 1; i >= 0; i--)
+        SiftDueQueue(i);
 }
 
-bool MuPlayer::SendEvents(MuMIDIBuffer events)
+void MuPlayer::MoveQueue(EventQueue * queue, long long position, long long now)
 {
-    int selectedQueue = -1;
-    int i;
+    // called with scheduleLock held: the queue reaches
+    // 'position' of its time line at 'now'...
+    if(queue->scale != NORMAL_TEMPO)
+        position = llround(position / queue->scale);
+    queue->origin = now - position;
+}
+
+void MuPlayer::EndSoundingNotes(EventQueue * queue)
+{
+    unsigned char sounding[16][128];
+    long i;
+    int type, channel, key;
     
-    // at the end of this loop, if at
-    // least one queue is available,
-    // selectedQueue contains its index..
-    for (i = 0; i < MAX_QUEUES; i++)
+    // called with scheduleLock held, before a queue is moved: notes
+    // turned on by the events it has played which were not turned
+    // off yet get their note offs now...
+    memset(sounding, 0, sizeof(sounding));
+    for(i = 0; i < queue->next; i++)
     {
-        // if the current queue is not being played or filled,...
-        if(eqPool[i].active == false && eqPool[i].loading == false)
+        const MuMIDIMessage & msg = QueueEvent(queue, i);
+        type = msg.status & 0xF0;
+        channel = msg.status & 0x0F;
+        key = msg.data1 & 0x7F;
+        if((type == MU_NOTE_ON) && (msg.data2 > 0))
         {
-            // it can be selected for a new material...
-            selectedQueue = i;
-            // mark queue as under construction...
-            eqPool[i].loading = true;
-            break;
+            if(sounding[channel][key] < 255)
+                sounding[channel][key]++;
+        }
+        else if((type == MU_NOTE_OFF) || (type == MU_NOTE_ON))
+        {
+            if(sounding[channel][key] > 0)
+                sounding[channel][key]--;
         }
     }
-    // if unused queue is found...
-    if(selectedQueue >= 0)
-    {
-        // start the queue thread...
-        StartQueueThread(events,selectedQueue);
-    }
-    else
+    
+    long long now = NanoClockStamp();
+    bool sent = false;
+    MuMIDIMessage off;
+    off.time = 0.0;
+    off.stamp = 0;
+    off.data2 = 0;
+    for(channel = 0; channel < 16; channel++)
     {
-        // otherwise report failure...
-        return false;
+        for(key = 0; key < 128; key++)
+        {
+            off.status = MU_NOTE_OFF + channel;
+            off.data1 = key;
+            while(sounding[channel][key]-- > 0)
+            {
+                Dispatch(off, now);
+                sent = true;
+            }
+        }
     }
-    return true;
+    if(sent)
+        FlushOutput();
 }
 
-
-
-bool MuPlayer::StartQueueThread(MuMaterial & inMat, int queueIdx)
+bool MuPlayer::SetTempo(double factor)
 {
-    int res;
+    long long now;
+    int i;
     
-    // make a copy of the input material so the thread can
-    // work on it safely, as it will be working assynchronously
-    eqPool[queueIdx].material = inMat;
+    if((factor < MIN_TEMPO) || (factor > MAX_TEMPO))
+        return false;
     
-    // Start the thread...
-    res = pthread_create(&(eqPool[queueIdx].queueThread), NULL, MuPlayer::EnqueueMaterial, (void*)(&eqPool[queueIdx]));
-    if(res)
+    pthread_mutex_lock(&scheduleLock);
+    now = NanoClockStamp();
+    
+    // events in the sequencer were timed at the old tempo
+    // (note offs included, they are sent again)...
+    if(scheduledAhead != NO_LOOKAHEAD)
+        RewindDueQueues(false);
+    
+    // every queue goes on from the point it has reached...
+    for(i = 0; i < poolSize; i++)
     {
-        // if we fail, terminate process...
-        cout << "THREAD ERROR! - Terminating..." << endl;
-        exit(EXIT_FAILURE);
+        EventQueue * queue = eqPool[i];
+        if(queue->state.load(memory_order_relaxed) != QUEUE_ACTIVE)
+            continue;
+        long long position = QueuePosition(queue, now);
+        queue->scale = queue->tempo * factor;
+        MoveQueue(queue, position, now);
     }
+    tempo = factor;
+    RetimeDueQueues();
+    pthread_mutex_unlock(&scheduleLock);
+    WakeScheduler();
     
-    // if successful...
     return true;
 }
 
-bool MuPlayer::StartQueueThread(MuMIDIBuffer events, int queueIdx)
+double MuPlayer::Tempo(void)
 {
-    int res;
+    double factor;
     
-    // make a copy of the input event buffer so the thread can
-    // work on it safely, as it will be working assynchronously
-    eqPool[queueIdx].buffer = events;
-    
-    // Start the thread...
-    res = pthread_create(&(eqPool[queueIdx].queueThread), NULL, MuPlayer::EnqueueEvents, (void*)(&eqPool[queueIdx]));
-    if(res)
-    {
-        // if we fail, terminate process...
-        cout << "THREAD ERROR! - Terminating..." << endl;
-        exit(EXIT_FAILURE);
-    }
+    pthread_mutex_lock(&scheduleLock);
+    factor = tempo;
+    pthread_mutex_unlock(&scheduleLock);
     
-    // if successful...
-    return true;
+    return factor;
 }
 
-void * MuPlayer::EnqueueMaterial(void* arg)
+bool MuPlayer::SetQueueTempo(int queue, double factor)
 {
-    int numVoices, i;
-    MuNote note;
-    
-    unsigned char channel, instrument;
-    long numNotes,numEvents,nextEvent, j, k;
-    EventQueue * queue = (EventQueue *)arg;
-    
-    // get the total number of notes in input material...
-    numNotes = queue->material.NumberOfNotes();
-    numVoices = queue->material.NumberOfVoices();
+    EventQueue * q;
+    long long now;
+    int state = QUEUE_FREE;
     
-    // each note needs two MIDI events (on/off) per note
-    numEvents = numNotes * 2;
+    if((factor < MIN_TEMPO) || (factor > MAX_TEMPO))
+        return false;
     
-    // allocate memory for the note events...
-    if(numEvents > 0)
+    // (the pool only changes under scheduleLock)...
+    pthread_mutex_lock(&scheduleLock);
+    if((queue >= 0) && (queue < poolSize))
     {
-        // Attention! this buffer needs to be released when
-        // the scheduler is done sending its events...
-        queue->buffer.data = new MuMIDIMessage[numEvents];
-        if(queue->buffer.data)
-        {
-            // If Allocation worked, extract MIDI events from notes...
-            queue->buffer.max = numEvents;
-            nextEvent = 0;
-            
-            for(i = 0; i < numVoices; i++)
-            {
-                channel = queue->material.Channel(i);
-                channel--; // adjust to zero-based counting
-                numNotes = queue->material.NumberOfNotes(i);
-                for (j = 0; j < numNotes; j++)
-                {
-                    note = queue->material.GetNote(i, j);
-                    queue->buffer.data[nextEvent] = note.MIDIOn();
-                    queue->buffer.data[nextEvent].status += channel;
-                    nextEvent++;
-                    queue->buffer.data[nextEvent] = note.MIDIOff();
-                    queue->buffer.data[nextEvent].status += channel;
-                    nextEvent++;
-                }
-            }
-            // After extracting notes from all voices, nextEvent contains
-            // the number of events used in the buffer (which should be
-            // the same as buffer.max, but just in case...)
-            queue->buffer.count = nextEvent;
-            
-            // sort events by timestamp...
-            long n = queue->buffer.count;
-            for(j = n; j >= 1; j-- )
-            {
-                for( k = 0; k < j-1; k++ )
-                {
-                    if( queue->buffer.data[k].time > queue->buffer.data[k+1].time )
-                    {
-                        // swap messages...
-                        MuMIDIMessage temp;
-                        temp = queue->buffer.data[k];
-                        queue->buffer.data[k] = queue->buffer.data[k+1];
-                        queue->buffer.data[k+1] = temp;
-                    }
-                }
-            }
-            queue->material.Clear();
-            queue->next = 0;
-            queue->paused = false;
-            
-            // IMPORTANT: LOADING TIME
-            // The following timestamp is registering this moment, after
-            // the event buffer has been successfully allocated and filled,
-            // to be the initial time for playback of this queue. All events
-            // in the queue will be referenced  from this point. The amount
-            // of microseconds retrieved hear will be added to the timestamp
-            // of every event so the scheduler can compare stamps and decide
-            // when to send the messages.
-            queue->loadingTime = ClockStamp();
-            //cout << "[Loading Time]: " << queue->loadingTime << endl;
-            
-            // after the queue is set to 'active' the scheduler may
-            // use it at any moment (even at interrupt time). That's
-            // why this MUST BE THE LAST ACTION!
-            queue->active = true;
-            
-            // after the queue is active we turn off the loading flag...
-            queue->loading = false;
-        }
+        q = eqPool[queue];
+        state = q->state.load(memory_order_relaxed);
+    }
+    if(state == QUEUE_LOADING)
+    {
+        // the queue starts at this tempo when it is activated...
+        q->tempo = factor;
+    }
+    else if(state == QUEUE_ACTIVE)
+    {
+        now = NanoClockStamp();
+        if(scheduledAhead != NO_LOOKAHEAD)
+            RewindDueQueues(false);
+        long long position = QueuePosition(q, now);
+        q->tempo = factor;
+        q->scale = factor * tempo;
+        MoveQueue(q, position, now);
+        RetimeDueQueues();
     }
+    pthread_mutex_unlock(&scheduleLock);
     
-    // after the work is done we terminate this thread...
-    pthread_exit(NULL);
+    if(state == QUEUE_ACTIVE)
+        WakeScheduler();
+    return (state == QUEUE_LOADING) || (state == QUEUE_ACTIVE);
 }
 
-void * MuPlayer::EnqueueEvents(void* arg)
+double MuPlayer::QueueTempo(int queue)
 {
-    long i, n;
-    EventQueue * queue = (EventQueue *)arg;
-    MuMIDIBuffer tempBuff = queue->buffer;
-    n = queue->buffer.count;
+    double factor = NORMAL_TEMPO;
     
-    // allocate memory for the events...
-    if(n > 0)
-    {
-        // Attention! this buffer needs to be released when
-        // the scheduler is done sending its events...
-        queue->buffer.data = new MuMIDIMessage[n];
+    pthread_mutex_lock(&scheduleLock);
+    if((queue >= 0) && (queue < poolSize))
+        factor = eqPool[queue]->tempo;
+    pthread_mutex_unlock(&scheduleLock);
     
-        // copy MIDI events from input buffer...
-        if(queue->buffer.data)
-        {
-            for(i = 0; i < n; i++)
-            {
-                queue->buffer.data[i] = tempBuff.data[i];
-            }
-            
-            queue->paused = false;
-            
-            // IMPORTANT: LOADING TIME
-            // The following timestamp is registering this moment, after
-            // the event buffer has been successfully allocated and filled,
-            // to be the initial time for playback of this queue. All events
-            // in the queue will be referenced  from this point. The amount
-            // of microseconds retrieved hear will be added to the timestamp
-            // of every event so the scheduler can compare stamps and decide
-            // when to send the messages.
-            queue->loadingTime = ClockStamp();
-            //cout << "[Loading Time]: " << queue->loadingTime << endl;
-            
-            // after the queue is set to 'active' the scheduler may
-            // use it at any moment (even at interrupt time). That's
-            // why this MUST BE THE LAST ACTION!
-            queue->active = true;
-            
-            // after the queue is active we turn off the loading flag...
-            queue->loading = false;
-        }
-    }
-    // after the work is done we terminate this thread...
-    pthread_exit(NULL);
+    return factor;
 }
 
-
-bool MuPlayer::StartScheduler(void)
+bool MuPlayer::Seek(int queue, double position)
 {
-    int res;
-    res = pthread_create(&schedulerThread, NULL, MuPlayer::ScheduleEvents, (void*)eqPool);
-    if(res)
+    EventQueue * q;
+    long long stamp;
+    long first, last, middle;
+    bool ok = false;
+    
+    stamp = (position > 0.0) ? llround(position * ONE_SECOND_NS) : 0;
+    
+    pthread_mutex_lock(&scheduleLock);
+    q = ((queue >= 0) && (queue < poolSize)) ? eqPool[queue] : NULL;
+    if((q != NULL) && (q->state.load(memory_order_relaxed) == QUEUE_ACTIVE) && (q->window >= q->numEvents) && !q->streaming)
     {
-        cout << "THREAD ERROR! - Terminating..." << endl;
-        exit(EXIT_FAILURE);
+        // events in the sequencer belong to the old position
+        // (notes left sounding are ended here instead)...
+        if(scheduledAhead != NO_LOOKAHEAD)
+            RewindDueQueues(false);
+        EndSoundingNotes(q);
+        
+        // the first event at or after the new position
+        // comes next (events are in chronological order)...
+        first = 0;
+        last = q->numEvents;
+        while(first < last)
+        {
+            middle = (first + last) / 2;
+            if(QueueEvent(q, middle).stamp < stamp)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        q->next = first;
+        q->played = first;
+        MoveQueue(q, stamp, NanoClockStamp());
+        RetimeDueQueues();
+        ok = true;
     }
-
-    return true;
+    pthread_mutex_unlock(&scheduleLock);
+    
+    if(ok)
+        WakeScheduler();
+    return ok;
 }
 
 // FIX FIX FIX: FINISH IMPLEMENTING THIS CAREFULLY!!
@@ -614,71 +2258,165 @@ bool MuPlayer::StartScheduler(void)
 //    for later
 void * MuPlayer::ScheduleEvents(void * pl)
 {
-    int i;
-    
     MuPlayer * player = (MuPlayer *)pl;
-    EventQueue * pool = player->eqPool;
+    EventQueue * queue;
+    unsigned long stops, newStops;
+    bool rewound = false;
+    
+    // the lock is held while the scheduler works, and released while it
+    // sleeps, so a queue activated in between can't be missed...
+    pthread_mutex_lock(&scheduleLock);
+    pthread_cleanup_push(UnlockMutex, &scheduleLock);
+    stops = MuPlayer::stopCount.load(memory_order_acquire);
     
     // this thread will terminate
-    // when the Player's stop flag is set...
-    while (!MuPlayer::stop)
+    // when the Player is reset...
+    while (true)
     {
+        // drain the queues cancelled by Stop()...
+        newStops = MuPlayer::stopCount.load(memory_order_acquire);
+        if(newStops != stops)
+        {
+            stops = newStops;
+            player->DrainStoppedQueues(stops);
+        }
+        
         // only do work if the player is not paused...
-        if(!MuPlayer::pause)
+        if(!MuPlayer::pause.load(memory_order_acquire))
         {
-            for(i = 0; i < MAX_QUEUES; i++)
+            rewound = false;
+            
+            // move newly activated queues to the priority queue...
+            while(player->activatedQueues != NULL)
             {
-                // if current queue is active,...
-                if (pool[i].active == true)
+                queue = player->activatedQueues;
+                player->activatedQueues = queue->nextActivated;
+                queue->nextActivated = NULL;
+                
+                // requests made before Stop() are cancelled...
+                if(queue->stopCount != stops)
                 {
-                    // look for its next event...
-                    MuMIDIMessage msg = pool[i].buffer.data[pool[i].next];
-                    long msgTime = (long)(msg.time * ONE_SECOND) + (pool[i].loadingTime);
-                    // get current time from the system
-                    long currTime = ClockStamp();
-                    
-                    // if the timestamp on the message is expired...
-                    if( currTime >= msgTime)
+                    CancelQueue(queue);
+                    continue;
+                }
+                
+                // a streaming queue may come back after playing
+                // every event, only to be told the stream is over
+                // (its last events may still be in the sequencer)...
+                if((queue->next >= queue->numEvents) && !queue->streaming && (queue->played >= queue->next))
+                {
+                    RecycleQueue(queue);
+                    continue;
+                }
+                queue->nextTime = QueueWakeup(queue, player->ScheduleAhead());
+                player->PushDueQueue(queue);
+            }
+            
+            // get current time from the system (with look-ahead,
+            // events due within the window are sent now)...
+            long long currTime = NanoClockStamp();
+            long long ahead = player->ScheduleAhead();
+            bool sent = false;
+            player->scheduledAhead = ahead;
+            
+            // send every expired event, earliest first...
+            while((player->numDueQueues > 0) && (player->dueQueues[0]->nextTime <= currTime + ahead))
+            {
+                queue = player->dueQueues[0];
+                
+                // a queue which has sent its last event is done when that
+                // event is due (with look-ahead, it waits until then); a
+                // streaming queue waiting for room is refilled when the
+                // event which makes room is due (it stays here until then,
+                // and gets more events right away if we refill it)...
+                if(queue->next >= queue->numEvents)
+                {
+                    ReleasePlayed(queue, currTime);
+                    if((queue->next < queue->numEvents) || (queue->streaming && queue->waiting))
                     {
-                        // schedule it to be sent to destination...
-#ifdef MUM_MACOSX
-                        SendMIDIMessage(msg,player->midiOutPort, player->midiDest);
-#endif
-                        
-#ifdef MUM_LINUX
-                        SendMIDIMessage(msg,player->midiout);
-#endif
-                        // advance event counter...
-                        pool[i].next += 1;
-                        // if this is the last event in the buffer,
-                        // this queue needs to be reset...
-                        if(pool[i].next >= pool[i].buffer.count)
-                        {
-                            // reset queue
-                            delete [] pool[i].buffer.data;
-                            pool[i].buffer.data = NULL;
-                            pool[i].buffer.count = 0;
-                            pool[i].buffer.max = 0;
-                            pool[i].paused = false;
-                            pool[i].next = 0;
-                            pool[i].queueThread = 0;
-                            pool[i].loadingTime = 0;
-                            // lastly deactivate queue
-                            pool[i].active = false;
-                            pool[i].loading = false;
-                        }
+                        queue->nextTime = QueueWakeup(queue, ahead);
+                        player->SiftDueQueue(0);
+                    }
+                    else
+                    {
+                        player->FinishDueQueue(queue);
+                    }
+                    continue;
+                }
+                MuMIDIMessage msg = QueueEvent(queue, queue->next);
+                
+                // measure how late it is going out...
+                long long latency = NanoClockStamp() - queue->nextTime;
+                player->RecordDispatch(queue, (latency > 0) ? latency : 0);
+                
+                // schedule it to be sent to destination...
+                player->Dispatch(msg, queue->nextTime);
+                sent = true;
+                // advance event counter...
+                queue->next += 1;
+                
+                // a streaming queue may be waiting for room...
+                ReleasePlayed(queue, currTime);
+                
+                // if this is the last event in the buffer,
+                // this queue needs to be reset...
+                if(queue->next >= queue->numEvents)
+                {
+                    // (with look-ahead, once its last event leaves the
+                    // sequencer; streaming queues wait for more events,
+                    // or for room, if their refill is not under way)
+                    if(queue->streaming ? !queue->waiting : (ahead == NO_LOOKAHEAD))
+                    {
+                        player->FinishDueQueue(queue);
+                    }
+                    else
+                    {
+                        queue->nextTime = QueueWakeup(queue, ahead);
+                        player->SiftDueQueue(0);
                     }
                 }
-            } // end MAX_QUEUES loop
-            usleep(10); // idle for a moment...
+                else
+                {
+                    // otherwise its place depends on its next event...
+                    queue->nextTime = QueueDue(queue, queue->next);
+                    player->SiftDueQueue(0);
+                }
+            }
+
+            // complete delivery of this group of messages...
+            if(sent)
+                player->FlushOutput();
+
+            // sleep until the next event is due...
+            if(player->numDueQueues == 0)
+            {
+                pthread_cond_wait(&scheduleWakeup, &scheduleLock);
+                player->statWakeups.fetch_add(1, memory_order_relaxed);
+            }
+            else
+            {
+                // (with look-ahead, half a window before it has to be sent,
+                // so every wake up sends half a window's worth of events)
+                long long nextTime = player->dueQueues[0]->nextTime - (ahead / 2);
+                if(WaitUntil(&scheduleWakeup, &scheduleLock, nextTime))
+                    player->statWakeups.fetch_add(1, memory_order_relaxed);
+            }
         } // end if(!pause)
         else
         {
-            usleep(100); // idle for a moment...
+            // events waiting in the sequencer are taken back...
+            if(!rewound)
+            {
+                player->RewindDueQueues(true);
+                rewound = true;
+            }
+            
+            // sleep until playback is resumed or stopped...
+            pthread_cond_wait(&scheduleWakeup, &scheduleLock);
         }
     } // end infinite loop
     
-    
+    pthread_cleanup_pop(1);
     pthread_exit(NULL);
 }
 
@@ -695,15 +2433,9 @@ void MuPlayer::SendMIDIMessage(MuMIDIMessage msg, MIDIPortRef outPort, MIDIEndpo
         msgBuff[1] = msg.data1;
         msgBuff[2] = msg.data2;
         
-        // If this is a program change or pitchbend message, send 2 bytes...
-        if(((msgBuff[0] & 0xF0) == 0xC0) || ((msgBuff[0] & 0xF0) == 0xE0) )
-        {
-            byteCount = 2;
-        }
-        else // for all other voice messages send three bytes...
-        {
-            byteCount = 3;
-        }
+        // program changes and channel pressure take 2 bytes,
+        // all other voice messages take three...
+        byteCount = MuMIDISink::MessageLength(msgBuff[0]);
         
         MIDITimeStamp timestamp = 0.0;
         Byte buffer[1024]; // storage space for MIDI Packets
@@ -732,15 +2464,9 @@ void MuPlayer::SendMIDIMessage(MuMIDIMessage msg, RtMidiOut * midiOut)
         msgBuff[1] = msg.data1;
         msgBuff[2] = msg.data2;
         
-        // If this is a program change or pitchbend message, send 2 bytes...
-        if(((msgBuff[0] & 0xF0) == 0xC0) || ((msgBuff[0] & 0xF0) == 0xE0) )
-        {
-            byteCount = 2;
-        }
-        else // for all other voice messages send three bytes...
-        {
-            byteCount = 3;
-        }
+        // program changes and channel pressure take 2 bytes,
+        // all other voice messages take three...
+        byteCount = MuMIDISink::MessageLength(msgBuff[0]);
         
       midiOut->sendMessage( msgBuff, byteCount);
     }
@@ -752,12 +2478,14 @@ void MuPlayer::SendMIDIMessage(MuMIDIMessage msg, RtMidiOut * midiOut)
 
 void MuPlayer::Pause(bool T_F)
 {
-    pause = T_F;
+    pause.store(T_F, memory_order_release);
+    WakeScheduler();
 }
 
 void MuPlayer::Stop(void)
 {
-    stop = true;
+    stopCount.fetch_add(1, memory_order_acq_rel);
+    WakeScheduler();
 }
 
 
@@ -32,9 +32,16 @@
 #define MU_PLAYER_H
 
 #include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <string.h>
 #include <iostream>
 #include <string>
 #include "MuMaterial.h"
+#include "MuPerformance.h"
+#include "MuMIDISink.h"
 using namespace std;
 
 #ifdef MUM_MACOSX
@@ -49,9 +56,39 @@ using namespace std;
 #define MUM_CLIENT_NAME "MuM Playback"
 #define MUM_PORT_NAME "MuM Output"
 
-//!@brief Maximum number of queue objects in the playback pool
+//!@brief Initial number of queue objects in the playback pool (the pool grows on demand)
 const int MAX_QUEUES = 10;
 
+//!@brief Queue limit meaning the playback pool may grow without bounds (see MuPlayer::SetMaxQueues())
+const int NO_QUEUE_LIMIT = 0;
+
+//!@brief Number of persistent loader threads which fill up playback queues
+const int LOADER_THREADS = 2;
+
+//!@brief Capacity of the loader job queue (must be a power of two)
+const unsigned long LOADER_JOBS = 256;
+
+//!@brief Stream window meaning materials are compiled entirely before playback (see MuPlayer::SetStreamWindow())
+const long NO_STREAMING = 0;
+
+//!@brief Queue state: idle, may be picked for playback
+const int QUEUE_FREE = 0;
+
+//!@brief Queue state: picked for playback and being filled up by a loader
+const int QUEUE_LOADING = 1;
+
+//!@brief Queue state: handed to the scheduler, which is playing its events
+const int QUEUE_ACTIVE = 2;
+
+//!@brief Queue state: finished or stopped, being reset by the scheduler
+const int QUEUE_DRAINING = 3;
+
+//!@brief Number of buckets in MuPlayer's latency and jitter histograms (see MuPlaybackStats)
+const int STATS_BUCKETS = 24;
+
+//!@brief Default lateness, in nanoseconds, above which an event is counted as late (see MuPlayer::SetLateThreshold())
+const long long DEFAULT_LATE_THRESHOLD = 1000000LL;
+
 //!@brief Normal Playback Mode: imediate playback of scheduled materials
 const int PLAYBACK_MODE_NORMAL = 1;
 
@@ -61,6 +98,42 @@ const int PLAYBACK_MODE_GAME = 2;
 //!@brief size of midi message 
 const int MESSAGE_LENGTH = 3;
 
+//!@brief Maximum number of MIDI messages gathered into a single output batch (see MuPlayer::SetBatchOutput())
+const int OUTPUT_BATCH = 256;
+
+//!@brief Look-ahead meaning messages are sent when they are due, with no sequencer queue (see MuPlayer::SetLookAhead())
+const long long NO_LOOKAHEAD = 0;
+
+//!@brief Tempo factor meaning events are played at the times they were compiled with (see MuPlayer::SetTempo())
+const double NORMAL_TEMPO = 1.0;
+
+//!@brief Slowest tempo factor accepted by MuPlayer::SetTempo() and MuPlayer::SetQueueTempo()
+const double MIN_TEMPO = 0.01;
+
+//!@brief Fastest tempo factor accepted by MuPlayer::SetTempo() and MuPlayer::SetQueueTempo()
+const double MAX_TEMPO = 100.0;
+
+//!@brief Real-time priority meaning the scheduler thread keeps the default scheduling policy (see MuRealtimeConfig)
+const int NO_REALTIME_PRIORITY = 0;
+
+//!@brief CPU number meaning the scheduler thread may run on any CPU (see MuRealtimeConfig)
+const int ANY_CPU = -1;
+
+//!@brief Real-time setting: the scheduler thread runs with SCHED_FIFO priority
+const int REALTIME_PRIORITY = 0x01;
+
+//!@brief Real-time setting: the scheduler thread is bound to a single CPU
+const int REALTIME_AFFINITY = 0x02;
+
+//!@brief Real-time setting: all of the process's memory is locked (mlockall)
+const int REALTIME_MEMORY_LOCKED = 0x04;
+
+//!@brief Real-time setting: only the player and its event buffers are locked in memory
+const int REALTIME_BUFFERS_LOCKED = 0x08;
+
+//!@brief Real-time setting: playback queues were created and filled with event storage in advance
+const int REALTIME_PREALLOCATED = 0x10;
+
 /**
  * @brief Event Queue - MIDI events to be played
  *
@@ -74,29 +147,177 @@ const int MESSAGE_LENGTH = 3;
  * a valid vector.
  *
  **/
+class MuPlayer;
+
 struct EventQueue
 {
-    //! @brief buffer of messages to be sent
+    //! @brief buffer of messages to be sent; its storage is kept when the queue is recycled ('max' is its capacity)
     MuMIDIBuffer buffer;
+    //! @brief events handed to SendEvents(), waiting to be copied to 'buffer' by the working thread
+    MuMIDIBuffer input;
+    //! @brief events being played: either the queue's own 'buffer' or the events of a performance
+    const MuMIDIMessage * events;
+    //! @brief number of messages placed in 'events' so far
+    long numEvents;
+    //! @brief capacity of 'events': message 'i' is at index i % window (streaming queues reuse their storage as a ring)
+    long window;
+    //! @brief streaming flag: set while the loaders are still adding events to a playing queue
+    bool streaming;
+    //! @brief set by the scheduler when a streaming queue has played every event available
+    bool starved;
+    //! @brief set while a streaming queue waits for the scheduler to make room in the ring before its next refill
+    bool waiting;
+    //! @brief performance being played, if any (the queue holds a reference to its data)
+    MuPerformanceData * performance;
     //! @brief index of next message to be sent
     long next;
-    //! @brief activation flag: true == active, false == inactive;
-    // a queue should not be picked for playback when it is active.
-    bool active;
-    //! @brief loading flag: set while the working thread is filling up the queue;
-    // a queue should not be picked for playback when it is loading.
-    bool loading;
+    //! @brief index of the first message which is not due yet (with look-ahead, messages from 'played' to 'next' wait in the sequencer)
+    long played;
+    //! @brief life cycle state: QUEUE_FREE -> QUEUE_LOADING -> QUEUE_ACTIVE -> QUEUE_DRAINING -> QUEUE_FREE;
+    // only a free queue may be picked for playback (see MuPlayer's UNDER THE HOOD notes).
+    atomic<int> state;
+    //! @brief number of Stop() commands issued before the queue was picked (see MuPlayer::Stop())
+    unsigned long stopCount;
     //! @brief pause flag: true == paused, false == running
     bool paused;
-    //! @brief queue thread: fills event queue with events from input MuMaterial
-    pthread_t queueThread;
+    //! @brief loader job: fills event queue with events from input material or buffer (run by a loader thread)
+    void * (*loader)(void * arg);
     //! @brief reference to input material to be associated with this queue
     MuMaterial material;
-    //! @brief time in microseconds when the event queue is loaded and ready to be played
-    long loadingTime;
+    //! @brief events of a streaming material which are not in the ring yet (kept between refills)
+    MuEventCompiler compiler;
+    //! @brief time in nanoseconds (see NanoClockStamp()) when the event queue is loaded and ready to be played
+    long long loadingTime;
+    //! @brief time in nanoseconds when the next message in this queue is due (used by the scheduler)
+    long long nextTime;
+    //! @brief tempo factor of this queue (see MuPlayer::SetQueueTempo())
+    double tempo;
+    //! @brief tempo factor in effect: the queue's times the player's
+    double scale;
+    //! @brief time in nanoseconds where the queue's time stamp zero falls, at its current tempo
+    // (message 'i' is due at origin + stamp / scale; 'origin' starts as 'loadingTime' and moves with tempo changes and seeks)
+    long long origin;
+    //! @brief player which owns this queue
+    MuPlayer * player;
+    //! @brief link to the next queue activated since the scheduler last looked (see ActivateQueue())
+    EventQueue * nextActivated;
+    //! @brief number of events sent from this queue (see MuPlayer::GetQueueStats())
+    long sentEvents;
+    //! @brief number of events sent from this queue later than the player's late threshold
+    long lateEvents;
+    //! @brief largest latency, in nanoseconds, of an event sent from this queue
+    long long maxLatency;
 };
 typedef struct EventQueue EventQueue;
 
+/**
+ * @brief Playback Statistics structure
+ *
+ * @details
+ * MuPlaybackStats is a snapshot of the timing measurements taken by
+ * MuPlayer's scheduler (see MuPlayer::GetStats()). The latency of an
+ * event is the time it was actually sent minus the time it was
+ * scheduled for (the queue's loading time plus the event's time stamp).
+ * Its jitter is the difference, in absolute value, between its latency
+ * and the latency of the event sent before it.
+ *
+ * Both histograms use the same buckets, measured in microseconds:
+ * bucket 0 counts values under 1 us, bucket 'k' counts values from
+ * 2^(k-1) up to 2^k us and the last bucket counts every value from
+ * 2^(STATS_BUCKETS-2) us up.
+ **/
+struct MuPlaybackStats
+{
+    //! @brief number of events sent
+    unsigned long eventsSent;
+    //! @brief number of events sent later than 'lateThreshold'
+    unsigned long lateEvents;
+    //! @brief lateness, in nanoseconds, above which an event is counted as late
+    long long lateThreshold;
+    //! @brief sum of every event's latency, in nanoseconds (divide by 'eventsSent' for the average)
+    long long totalLatency;
+    //! @brief largest latency seen, in nanoseconds
+    long long maxLatency;
+    //! @brief number of times the scheduler woke up (at a deadline or when signalled)
+    unsigned long wakeups;
+    //! @brief number of queues which finished playing (or were stopped)
+    unsigned long queuesPlayed;
+    //! @brief latency histogram (see above)
+    unsigned long latency[STATS_BUCKETS];
+    //! @brief jitter histogram (see above)
+    unsigned long jitter[STATS_BUCKETS];
+};
+typedef struct MuPlaybackStats MuPlaybackStats;
+
+/**
+ * @brief Queue Statistics structure
+ *
+ * @details
+ * MuQueueStats describes the progress of a queue which is being
+ * played (see MuPlayer::GetQueueStats()).
+ **/
+struct MuQueueStats
+{
+    //! @brief index of the queue in the playback pool
+    int queue;
+    //! @brief number of events sent so far
+    long eventsSent;
+    //! @brief number of events available to the scheduler (for streaming queues, produced so far)
+    long numEvents;
+    //! @brief number of events sent later than the player's late threshold
+    long lateEvents;
+    //! @brief largest latency, in nanoseconds, of an event sent from the queue
+    long long maxLatency;
+    //! @brief time, in nanoseconds, since the queue started playing
+    long long elapsed;
+    //! @brief events sent per second since the queue started playing
+    double throughput;
+    //! @brief current position, in nanoseconds, in the queue's own time line (see MuPlayer::Seek())
+    long long position;
+};
+typedef struct MuQueueStats MuQueueStats;
+
+/**
+ * @brief Loader Job structure
+ *
+ * @details
+ * LoaderJob is a cell in MuPlayer's lock-free job queue, which hands
+ * playback queues to the loader threads. 'sequence' tells producers
+ * and consumers whether the cell is free or holds a job.
+ **/
+struct LoaderJob
+{
+    //! @brief position of the cell in the job sequence
+    atomic<unsigned long> sequence;
+    //! @brief queue to be loaded
+    EventQueue * queue;
+};
+typedef struct LoaderJob LoaderJob;
+
+/**
+ * @brief Real-Time Configuration structure
+ *
+ * @details
+ * MuRealtimeConfig lists the real-time settings MuPlayer should try to
+ * apply to its scheduler thread (see MuPlayer::SetRealtime()). Each
+ * setting is optional and may be refused by the system, usually for
+ * lack of privileges; MuPlayer reports which ones were applied.
+ **/
+struct MuRealtimeConfig
+{
+    //! @brief SCHED_FIFO priority for the scheduler thread, or NO_REALTIME_PRIORITY
+    int priority;
+    //! @brief CPU the scheduler thread should run on, or ANY_CPU
+    int cpu;
+    //! @brief true to lock memory, so playback never waits for pages to be brought back
+    bool lockMemory;
+    //! @brief number of queues to create in advance (see MuPlayer::ReserveQueues())
+    int numQueues;
+    //! @brief number of events each queue should hold without allocating memory
+    long numEvents;
+};
+typedef struct MuRealtimeConfig MuRealtimeConfig;
+
 /**
  * @class MuPlayer
  *
@@ -167,39 +388,83 @@ typedef struct EventQueue EventQueue;
  * playback. It is possible to pause/resume/stop an individual
  * (playback queue) or the entire playback system. See Pause()
  * and Stop() for more details on how to use the playback
- * controls of MuPlayer.
+ * controls of MuPlayer. The tempo of every queue, or of a single
+ * queue, can be changed while it plays, and a queue can be moved to
+ * another point of its events, without recompiling them (see SetTempo(),
+ * SetQueueTempo() and Seek()).
  *
  * UNDER THE HOOD
  *
  * In order to allow many materials to playback simultaneously,
  * MuPlayer employs Posix Threads. The class contains a scheduler thread
- * and several working queue threads. The queue threads are initiated
- * when a request for playback is made. They strip the input materials
- * extracting MIDI events, put them in chronological order inside a
- * MIDI event queue and flag the queue as active. The scheduler, on
- * the other hand, starts when the player is initialized and keeps 
- * looking for active queues in the pool. For every active queue, it finds
- * the next pending event and checks its timestamp. If it is expired the
- * scheduler sends it. Then it moves to the next active queue and so on,
- * until the application terminates or the player is paused, stopped or
- * reset. When the scheduler reaches the last event in a queue, it
- * resets the queue and marks it as inactive, so it can be used again
- * by the player.
- *
- * The player comunicates to its threads through one-way flags.
- * Only the working queue thread can set the active flag and it only
- * does that once, when the event queue is filled up. After that the 
- * working queue thread will terminate. Only the scheduler thread
- * will read this flag and turn it off when the event queue is completely
- * empty. Only the player will look for inactive queue so it can 
- * play another material. The playback controls are
- * implemented using this same type of mechanism. Each queue has a
- * pause flag which can only be set by the player and read by the
- * scheduler thread. When the scheduler detects an acitve queue,
- * it checks to see if it is paused. If it is, and there is a pending event
- * to be played, it discards it, unless it is a noteOff event.
- * if the entire player is paused, the scheduler ignores all queues
- * and just idles for a few microseconds before checking again.
+ * and a pool of LOADER_THREADS loader threads, which Init() starts and
+ * which live as long as the player. A request for playback claims a
+ * queue and pushes it onto a lock-free job ring; an idle loader picks
+ * it up, strips the input material extracting MIDI events, puts them in
+ * chronological order inside the queue and flags the queue as active.
+ * If no loader is running or the ring is full, the requesting thread
+ * loads the queue itself. The scheduler, on
+ * the other hand, starts when the player is initialized. Active queues
+ * are kept in a priority queue (a min-heap) ordered by the time of
+ * their next event. While the event at the top of the heap is due, the
+ * scheduler sends it, advances that queue and sifts it back into place,
+ * so it always sends the earliest event among all queues, no matter
+ * which queue it belongs to, and each event costs O(log q) steps for q
+ * active queues. When nothing else is due, the scheduler sleeps until
+ * the time of the event at the top of the heap. It is woken up earlier
+ * when a queue becomes active, or when playback is paused, resumed or
+ * stopped, so it uses practically no CPU time between events.
+ * Timestamps are compared in nanoseconds against the system's
+ * monotonic clock (see NanoClockStamp() and MuMIDIMessage::stamp), so
+ * playback timing is not disturbed by wall clock adjustments and does
+ * not lose precision in long sessions. When a queue's last event has
+ * been sent, the scheduler pops it from the heap and recycles it: the
+ * queue goes through QUEUE_DRAINING while it is reset, and back to
+ * QUEUE_FREE, keeping its event storage, so the next request can use it.
+ *
+ * With a look-ahead window (see SetLookAhead()), the scheduler sends
+ * every event due within the window at once, each with its delay, and
+ * the system's MIDI sequencer delivers them on time. A queue which has
+ * sent its last event stays in the priority queue until that event is
+ * due, so the events waiting in the sequencer can still be taken back
+ * when playback is paused.
+ *
+ * A streaming queue (see SetStreamWindow()) does not keep a loader
+ * for itself. Each refill is a job of its own: it compiles as many
+ * events as there is room for in the queue's ring and returns. When the
+ * ring is full, the queue waits for room without a thread; the scheduler,
+ * which makes the room as it plays, pushes the next refill onto the job
+ * ring once there is room for another chunk (or refills the queue itself
+ * if the ring is full). So long streams never hold the loaders, and
+ * other requests are loaded as promptly as ever.
+ *
+ * Each queue also has a tempo and an origin: its event 'i' is due at
+ * origin + stamp(i) / tempo, where the tempo is the queue's own factor
+ * times the player's. The origin starts as the queue's loading time.
+ * Changing a tempo or seeking only moves the origin (and, for a seek,
+ * the queue's next event), under the scheduler's lock, and wakes the
+ * scheduler, which computes every due time from the new origin.
+ *
+ * The player comunicates to its threads through each queue's state,
+ * an atomic value which follows a single cycle: QUEUE_FREE ->
+ * QUEUE_LOADING -> QUEUE_ACTIVE -> QUEUE_DRAINING -> QUEUE_FREE.
+ * Play() claims a free queue by switching it to QUEUE_LOADING with a
+ * compare-and-swap. Requests scan the pool, and grow it when every
+ * queue is busy, holding the pool's lock, so requests made from several
+ * threads at once each get a different queue.
+ * Only the loader filling the queue may then touch it, until it hands
+ * the queue to the scheduler (QUEUE_ACTIVE), under the scheduler's
+ * lock. From then on, only the scheduler thread uses the queue. When
+ * its last event is sent, or when playback is stopped, the scheduler
+ * marks it QUEUE_DRAINING, resets it and releases it (QUEUE_FREE) with
+ * a release store, so the next request which claims it sees it clean.
+ * A streaming queue stopped while it is being refilled stays in
+ * QUEUE_DRAINING until its refill job notices it and gives it back.
+ * The playback controls are atomic flags as well: if the entire
+ * player is paused, the scheduler ignores all queues and sleeps until
+ * playback is resumed or stopped. tests/MuPlayerStress.cpp, built with
+ * ThreadSanitizer by compileTests, plays from several threads at once
+ * to check these hand-offs.
  *
  * USAGE:
  *
@@ -235,13 +500,15 @@ typedef struct EventQueue EventQueue;
  * @note
  * Currently, only PLAYBACK_MODE_NORMAL is implemented.
  *
- * @warning
- * MuPlayer's playback queue pool is allocated at compile time.
- * Its size is limited by the MAX_QUEUES constant. Depending
- * on expected density of materials in the application, it may
- * be necessary to increase this value before compiling. Otherwise,
- * once all queues in the pool are in use, requests to play new
- * materials may not be honored.
+ * @note
+ * MuPlayer's playback pool starts with MAX_QUEUES queue objects and
+ * grows on demand, so overlapping requests are not dropped when every
+ * queue is busy. Queues are recycled after playback, keeping the memory
+ * allocated for their events, so a pool which has reached the density
+ * of the application stops allocating memory. Applications may set an
+ * upper limit for the pool with SetMaxQueues(), preallocate queues and
+ * event storage with ReserveQueues() and check the pool's occupancy with
+ * PoolSize() and ActiveQueues().
  *
  **/
 
@@ -250,7 +517,29 @@ class MuPlayer
 {
     private:
     
-    EventQueue eqPool[MAX_QUEUES];  // Playback Pool
+    // Playback Pool: queue objects are allocated one by one, so they
+    // don't move when the pool grows ('poolMax' is the capacity of the
+    // pointer arrays; 'maxQueues' limits the pool size, if not zero).
+    // Requesting threads scan and grow the pool holding 'poolLock';
+    // growth also takes scheduleLock, under which the scheduler and
+    // the playback controls read the pool...
+    EventQueue ** eqPool;
+    int poolSize;
+    int poolMax;
+    int maxQueues;
+    pthread_mutex_t poolLock;
+    
+    // materials with more events than this are streamed
+    // to their queues while they play (0 == never)...
+    long streamWindow;
+    
+    // active queues ordered by the time of their next event (min-heap,
+    // used only by the scheduler thread, with room for every queue in the
+    // pool), and queues activated since the scheduler last looked (both
+    // protected by scheduleLock)...
+    EventQueue ** dueQueues;
+    int numDueQueues;
+    EventQueue * activatedQueues;
     
 #ifdef MUM_MACOSX
     MIDIClientRef midiClient;       // MIDI Client (CoreMIDI)
@@ -263,11 +552,121 @@ class MuPlayer
     int selectedPort;
 #endif
     
+    // when set, messages go to this sink instead of
+    // the MIDI destination (protected by scheduleLock)...
+    MuMIDISink * sink;
+    
+    // messages due in the same scheduler tick, gathered by Dispatch()
+    // and sent together by FlushOutput() (protected by scheduleLock)...
+    unsigned char batchBytes[OUTPUT_BATCH * MESSAGE_LENGTH];
+    size_t batchSizes[OUTPUT_BATCH];
+    int batchCount;
+    long batchLength;
+    bool batchOutput;
+    long long batchDue[OUTPUT_BATCH];
+    double batchDelays[OUTPUT_BATCH];
+    
+    // how far ahead of time messages are handed to the sequencer
+    // (protected by scheduleLock), and the look-ahead the scheduler
+    // is using in its current tick (written only by the scheduler)...
+    long long lookAhead;
+    long long scheduledAhead;
+    
+    // tempo factor applied to every queue (protected by scheduleLock)...
+    double tempo;
+    
     pthread_t schedulerThread;
+    
+    // real-time settings requested by SetRealtime(), the ones in
+    // effect (REALTIME_ flags, which loaders may clear when storage
+    // they allocate can't be locked) and why the others were refused...
+    MuRealtimeConfig realtime;
+    atomic<int> realtimeFlags;
+    int priorityError;
+    int affinityError;
+    int lockError;
+    
+    // the scheduler thread's own policy and CPU mask, saved before the
+    // first change so they can be restored when a setting is withdrawn...
+    int savedPolicy;
+    sched_param savedParam;
+    bool policySaved;
+#ifdef MUM_LINUX
+    cpu_set_t savedCpus;
+    bool cpusSaved;
+#endif
     static pthread_mutex_t sendMIDIlock;
     
-    static bool pause; // flag to communicate pause command to scheduler
-    static bool stop;  // flag to communicate stop command to scheduler
+    // timing statistics, written by the scheduler and read by
+    // GetStats() without locks ('lastLatency' is the scheduler's)...
+    atomic<unsigned long> statSent;
+    atomic<unsigned long> statLate;
+    atomic<unsigned long> statWakeups;
+    atomic<unsigned long> statQueues;
+    atomic<long long> statLatency;
+    atomic<long long> statMaxLatency;
+    atomic<long long> lateThreshold;
+    atomic<unsigned long> latencyHist[STATS_BUCKETS];
+    atomic<unsigned long> jitterHist[STATS_BUCKETS];
+    long long lastLatency;
+    
+    // persistent loader threads, fed through a lock-free job queue
+    // (bounded MPMC ring); idle loaders sleep on loaderWakeup...
+    pthread_t loaders[LOADER_THREADS];
+    int numLoaders;
+    LoaderJob jobs[LOADER_JOBS];
+    atomic<unsigned long> jobHead;
+    atomic<unsigned long> jobTail;
+    atomic<int> idleLoaders;
+    pthread_mutex_t loaderLock;
+    pthread_cond_t loaderWakeup;
+    
+    // playback controls, read by the scheduler (Stop() increments the
+    // stop count, so queues picked before it can be told apart)...
+    static atomic<bool> pause;
+    static atomic<unsigned long> stopCount;
+    
+    // the scheduler sleeps until its next deadline, or until it is woken
+    // up by a new active queue or a change in playback controls...
+    static pthread_mutex_t scheduleLock;
+    static pthread_cond_t scheduleWakeup;
+    static pthread_once_t scheduleOnce;
+    static void InitScheduleWakeup(void);
+    static void WakeScheduler(void);
+    static void ActivateQueue(EventQueue * queue);
+    static void LinkActivatedQueue(EventQueue * queue);
+    static void RecycleQueue(EventQueue * queue);
+    static void CancelQueue(EventQueue * queue);
+    void DrainStoppedQueues(unsigned long stops);
+    static bool LoadMaterial(EventQueue * queue);
+    bool StartLoaders(void);
+    void StopLoaders(void);
+    bool PushJob(EventQueue * queue);
+    EventQueue * PopJob(void);
+    static void * RunLoader(void * pl);
+    static void * StreamEvents(void * arg);
+    static void RefillQueue(EventQueue * queue);
+    static void PublishEvents(EventQueue * queue, long numEvents);
+    void PushDueQueue(EventQueue * queue);
+    void SiftDueQueue(int i);
+    static bool ReserveEvents(EventQueue * queue, long numEvents);
+    bool GrowPool(int newSize);
+    int SelectQueue(void);
+    EventQueue * PoolQueue(int i);
+    void RecordDispatch(EventQueue * queue, long long latency);
+    void Dispatch(const MuMIDIMessage & msg, long long due);
+    void FlushOutput(void);
+    void FlushBatch(void);
+    long long ScheduleAhead(void);
+    void ClearScheduledOutput(bool keepNoteOffs);
+    void RewindDueQueues(bool keepNoteOffs);
+    void RetimeDueQueues(void);
+    void EndSoundingNotes(EventQueue * queue);
+    static void MoveQueue(EventQueue * queue, long long position, long long now);
+    void FinishDueQueue(EventQueue * queue);
+    static void ReleasePlayed(EventQueue * queue, long long now);
+    void LockMemory(void);
+    void ApplySchedulerSettings(void);
     
     public:
     
@@ -287,7 +686,8 @@ class MuPlayer
      * @brief Destructor
      *
      * @details
-     * currently, the MuPlayer Destructor does not handle any specific tasks.
+     * The MuPlayer Destructor resets the player (see Reset()) and
+     * releases the queue objects in the playback pool.
     **/
     ~MuPlayer(void);
     
@@ -297,7 +697,8 @@ class MuPlayer
      * @details
      * This method clears all data from playback pool. It goes through each
      * queue releasing memory buffers, zeroeing structure fields and emptying
-     * materials. It is called once by the Player's constructor and is reused
+     * materials. The queue objects themselves are kept, so the pool
+     * retains its size. It is called by Reset() and is reused
      * when necessary, by other methods.
      *
      **/
@@ -332,6 +733,28 @@ class MuPlayer
      **/
     bool Init(void);
     
+    /**
+     * @brief Initializes the MuPlayer to send its messages to a sink
+     *
+     * @details
+     * This overloaded version of Init() starts the player without any
+     * MIDI setup: every message is delivered to 'outputSink' (see
+     * MuMIDISink) instead of a MIDI destination. It can be used on
+     * machines which have no MIDI ports, to capture, record or measure
+     * playback. Apart from that, the player works as usual.
+     *
+     * @param
+     * outputSink (MuMIDISink *) - sink to receive every message; it is
+     * not owned by the player and must remain valid until the player
+     * is reset, or another sink is selected
+     *
+     * @return
+     * bool - false if 'outputSink' is NULL or the scheduler thread
+     * could not be started
+     *
+     **/
+    bool Init(MuMIDISink * outputSink);
+    
     /**
      * @brief Selects a MIDI destination  for playback
      *
@@ -351,6 +774,115 @@ class MuPlayer
      **/
     bool SelectMIDIDestination(int destNumber);
     
+    /**
+     * @brief directs playback to a MIDI sink
+     *
+     * @details
+     * SetOutputSink() makes the scheduler deliver every message to
+     * 'outputSink' (see MuMIDISink), starting with the next message
+     * it sends, instead of the selected MIDI destination. Calling it
+     * with NULL sends messages to the MIDI destination again. Sinks
+     * are not owned by the player; Reset() forgets the current sink.
+     *
+     * @param
+     * outputSink (MuMIDISink *) - sink to receive messages, or NULL
+     *
+     * @return
+     * void
+     *
+     **/
+    void SetOutputSink(MuMIDISink * outputSink);
+    
+    /**
+     * @brief returns the current MIDI sink
+     *
+     * @return
+     * MuMIDISink * - sink receiving messages, or NULL if messages go
+     * to the MIDI destination
+     *
+     **/
+    MuMIDISink * OutputSink(void);
+    
+    /**
+     * @brief turns batched MIDI output on or off
+     *
+     * @details
+     * When batched output is on (the default), the scheduler gathers
+     * every message due in the same scheduling tick (up to OUTPUT_BATCH
+     * at a time) and hands them to the MIDI system together: RtMidi
+     * queues them and drains its output once (see
+     * RtMidiOut::sendMessages()), and CoreMIDI receives them in a single
+     * packet list. Dense chords then cost one system call instead of one
+     * per note. When it is off, each message is sent as soon as it is
+     * due. Sinks are not affected (see MuMIDISink::Flush()).
+     *
+     * @param
+     * T_F (bool) - true to gather simultaneous messages, false to send
+     * them one at a time
+     *
+     * @return
+     * void
+     *
+     **/
+    void SetBatchOutput(bool T_F);
+    
+    /**
+     * @brief returns true if batched MIDI output is on
+     *
+     * @return
+     * bool - true if simultaneous messages are sent together
+     *
+     **/
+    bool BatchOutput(void);
+    
+    /**
+     * @brief hands messages to the MIDI system ahead of time
+     *
+     * @details
+     * By default, the scheduler sleeps until each message is due and
+     * sends it right then, so playback timing depends on how quickly
+     * the scheduler thread wakes up. SetLookAhead() enables sequencer
+     * scheduling: messages are handed to the system 'nanoseconds' before
+     * they are due, each with its delay, and the system's MIDI sequencer
+     * (the ALSA sequencer, through a queue created by
+     * RtMidiOut::startQueue()) delivers them on time. The scheduler then
+     * wakes up about twice per look-ahead window, however dense the
+     * material, and its own timing no longer affects playback.
+     *
+     * Messages already in the sequencer are taken back when playback is
+     * paused or stopped (note offs are left there, so sounding notes still
+     * end); after a pause, queues resume from their first message which
+     * was not due yet. When streaming (see SetStreamWindow()), the stream
+     * window should hold more than a look-ahead window's worth of events.
+     * Sinks are not affected: they always receive messages when they are
+     * due. The latency measured by GetStats() becomes the time by which
+     * events reach the sequencer after they are due, which is normally
+     * zero. A look-ahead of NO_LOOKAHEAD turns sequencer scheduling off.
+     *
+     * @note
+     * This should be called after Init(). Sequencer scheduling is only
+     * available through the ALSA sequencer.
+     *
+     * @param
+     * nanoseconds (long long) - look-ahead window, or NO_LOOKAHEAD
+     *
+     * @return
+     * bool - false if the MIDI system cannot schedule messages (the
+     * look-ahead is left unchanged)
+     *
+     **/
+    bool SetLookAhead(long long nanoseconds);
+    
+    /**
+     * @brief returns the look-ahead window
+     *
+     * @return
+     * long long - look-ahead in nanoseconds, or NO_LOOKAHEAD if messages
+     * are sent when they are due
+     *
+     **/
+    long long LookAhead(void);
+    
     /**
      * @brief Lists MIDI destinations available for playback in the system
      *
@@ -416,25 +948,19 @@ class MuPlayer
      * looking for inactive queues to use. Once it finds one, it calls
      * StartQueueThread() with a reference to the MuMaterial to be played.
      * That method stores a copy of the material inside the queue structure
-     * and starts the working thread, which, in turn, extracts data from the
-     * material and activates the queue. If Play() cannot find an inactive
-     * queue to use, it returns false, in which case the playback request
+     * and hands the queue to one of the player's loader threads, which, in
+     * turn, extracts data from the material and activates the queue. If every queue is busy, the pool
+     * is doubled in size (up to the limit set by SetMaxQueues()). If the
+     * pool has reached its limit, or memory for new queues cannot be
+     * allocated, Play() returns false, in which case the playback request
      * is not honored.
      *
-     * The playback pool is just an array of EventQueue structures, which
+     * The playback pool is a set of EventQueue structures, which
      * can be used and reused during the course of the application.
-     * The pool has a fixed size which is determined at compile time. 
      * Since not all queues are in use all the time,
-     * recycling them allows more efficient use of resources.
-     * If for any reason the pool size turns out to be too small, it can be
-     * increased by changing the value of MAX_QUEUES at the begining of
-     * MuPlayer's header file.      
-     *
-     * @code {.cpp}
-     *
-     * const int MAX_QUEUES = 10;
-     *
-     * @endcode
+     * recycling them allows more efficient use of resources: a
+     * recycled queue keeps the memory allocated for its events, which
+     * is only replaced when a larger material is played.
      *
      * @param
      * inMat (MuMaterial&) - material to be played
@@ -451,6 +977,31 @@ class MuPlayer
      **/
     bool Play(MuMaterial & inMat, int mode);
     
+    /**
+     * @brief starts playing a compiled performance
+     *
+     * @details
+     * This overloaded version of Play() takes a performance which was
+     * already compiled into MIDI events (see MuPerformance) and assigns
+     * an event queue from the playback pool to play them. No thread is
+     * started and nothing is converted, copied or allocated: the queue
+     * is activated at once, reading the performance's events directly,
+     * so the first event may be sent immediately. The same performance
+     * may be started any number of times, even while previous starts are
+     * still playing; each start holds a reference to the performance's
+     * events, so 'perf' may be changed or destroyed as soon as Play()
+     * returns.
+     *
+     * @param
+     * perf (const MuPerformance &) - performance to be played
+     *
+     * @return
+     * bool - Play() returns false if the performance is empty or if it
+     * couldn't find or create an idle event queue; otherwise it returns true.
+     *
+     **/
+    bool Play(const MuPerformance & perf);
+    
     /**
      * @brief initiates a playback queue for the requested buffer of MIDI
      * events.
@@ -463,40 +1014,30 @@ class MuPlayer
      * SendEvents() goes through the playback pool only once,
      * looking for inactive queues to use. it calls StartQueueThread() with 
      * the adress of the MIDI buffer to be sent. That method stores a copy
-     * of that address inside the queue structure and starts a working thread, 
-     * which, in turn, extracts data from the buffer and activates the queue.  
-     * If SendEvents() cannot find an inactive queue to use, it returns false, 
-     * in which case the send request is not honored.
-     *
-     * The playback pool is just an array of EventQueue structures, which
-     * can be used and reused during the course of the application.
-     * The pool has a fixed size which is determined at compile time.
-     * Since not all queues are in use all the time,
-     * recycling them allows more efficient use of resources.
-     * If for any reason the pool size turns out to be too small, it can be
-     * increased by changing the value of MAX_QUEUES at the begining of
-     * MuPlayer's header file.
-     *
-     * @code {.cpp}
-     *
-     * const int MAX_QUEUES = 10;
-     *
-     * @endcode
+     * of that address inside the queue structure and hands the queue to a
+     * loader thread, which, in turn, copies the events to the queue's own storage, releases
+     * the input buffer and activates the queue. As in Play(), the pool grows
+     * when every queue is busy. If SendEvents() cannot find or create an
+     * inactive queue to use, it returns false, in which case the send request
+     * is not honored and the input buffer is not released.
      *
      * @note
-     * SendEvents() does not create a separate working thread. Instead, it
-     * enqueues MIDI events directly to the playback pool. Therefore, MIDI
+     * SendEvents() does not create a separate working thread. Instead, its
+     * MIDI events are copied to the playback pool by the player's shared
+     * loader threads. Therefore, MIDI
      * buffers for SendEvents() should typically be short, so they don't
      * significantly impact performance and, consequently, music 
      * synchronization.
      *
      * @param
      * inEvents (MuMIDIBuffer) - events to be sent. this buffer should be
-     * allocated by calling code and is released inside SendEvents().
+     * allocated by calling code and is released inside SendEvents(), once
+     * the request is accepted. Events are scheduled by their 'time'
+     * field; their 'stamp' field is ignored and need not be filled.
      *
      * @return
-     * bool - SendEvents() returns false if (a) it couldn't find an
-     * idle event queue in the pool, otherwise it returns true.
+     * bool - SendEvents() returns false if (a) it couldn't find or create
+     * an idle event queue in the pool, otherwise it returns true.
      *
      **/
     bool SendEvents(MuMIDIBuffer events);
@@ -523,14 +1064,296 @@ class MuPlayer
     bool SendProgramChange(unsigned char channel, unsigned char pc);
     
     /**
-     * @brief starts an event queue working thread to playback notes
+     * @brief sets the maximum size of the playback pool
+     *
+     * @details
+     * SetMaxQueues() limits the number of queue objects the playback
+     * pool may grow to. Once the pool reaches this size and every queue
+     * is busy, Play() and SendEvents() fail. A limit of NO_QUEUE_LIMIT (the
+     * default) lets the pool grow as long as memory is available. The pool
+     * never shrinks: if it is already larger than 'limit', the queues
+     * are kept, but it won't grow any further.
+     *
+     * @param
+     * limit (int) - maximum number of queues, or NO_QUEUE_LIMIT
+     *
+     * @return
+     * void
+     *
+     **/
+    void SetMaxQueues(int limit);
+    
+    /**
+     * @brief returns the maximum size of the playback pool
+     *
+     * @details
+     * MaxQueues() returns the limit set by SetMaxQueues(), or
+     * NO_QUEUE_LIMIT if the pool may grow without bounds.
+     *
+     * @return
+     * int - maximum number of queues
+     *
+     **/
+    int MaxQueues(void);
+    
+    /**
+     * @brief returns the current size of the playback pool
+     *
+     * @details
+     * PoolSize() returns the number of queue objects currently
+     * allocated in the playback pool, whether they are in use or not.
+     *
+     * @return
+     * int - number of queues in the pool
+     *
+     **/
+    int PoolSize(void);
+    
+    /**
+     * @brief returns the number of queues in use
+     *
+     * @details
+     * ActiveQueues() returns the number of queues in the playback
+     * pool which are being loaded or played at the moment of the
+     * call. As queues are recycled by the scheduler thread, this
+     * number is only a snapshot of the pool's occupancy.
+     *
+     * @return
+     * int - number of busy queues
+     *
+     **/
+    int ActiveQueues(void);
+    
+    /**
+     * @brief preallocates queues and event storage
+     *
+     * @details
+     * ReserveQueues() grows the playback pool to at least 'numQueues'
+     * queue objects (subject to the limit set by SetMaxQueues()) and
+     * makes sure every idle queue has room for 'numEvents' MIDI events
+     * (two per note, when playing materials). Applications which know
+     * their expected density can call it after Init(), so that no memory
+     * is allocated while playing.
+     *
+     * @param
+     * numQueues (int) - minimum number of queues in the pool
+     *
+     * @param
+     * numEvents (long) - minimum number of events in each queue
+     *
+     * @return
+     * bool - false if the limit does not allow 'numQueues' queues or
+     * if memory could not be allocated; true otherwise
+     *
+     **/
+    bool ReserveQueues(int numQueues, long numEvents);
+    
+    /**
+     * @brief configures the scheduler thread for real-time playback
+     *
+     * @details
+     * By default the scheduler thread runs with the system's normal
+     * scheduling policy, like every other thread, so a busy machine may
+     * delay it, and it may have to wait for memory pages which were
+     * moved to disk. SetRealtime() applies the settings in 'config' (see
+     * MuRealtimeConfig), in this order:
+     *
+     * - numQueues, numEvents: queues are created and given event storage
+     * in advance (see ReserveQueues()), so starting playback does not
+     * allocate memory;
+     *
+     * - lockMemory: all of the process's memory, including what it
+     * allocates later, is locked (mlockall). Under a limit to locked
+     * memory this is only kept if, once the process is locked, the
+     * limit still has room for the player's own threads and for the
+     * process to double in size, because past it every later
+     * allocation (of thread stacks, for instance) would fail. Otherwise, or if the system refuses, the player itself and
+     * the event storage of its queues are locked instead, including
+     * queues and storage created later, which usually fits the limit
+     * allowed to unprivileged processes;
+     * Calling SetRealtime() with 'lockMemory' false unlocks it;
+     *
+     * - priority: the scheduler thread runs under SCHED_FIFO with this
+     * priority (limited to the range allowed by the system), so it takes
+     * the CPU as soon as it wakes up;
+     *
+     * - cpu: the scheduler thread runs only on this CPU (Linux only),
+     * which may be kept away from the application's busiest threads.
+     *
+     * Settings which are refused are skipped, and playback goes on
+     * normally. A thread setting left at NO_REALTIME_PRIORITY or ANY_CPU
+     * is not touched, so the scheduler keeps what it inherited (from chrt
+     * or taskset, for instance); withdrawing one which was applied brings
+     * back the policy or CPU mask the thread had before. If the scheduler
+     * is not running yet, thread settings are
+     * applied when Init() starts it (and again after every later Init()).
+     * RealtimeReport() describes what was applied.
+     *
+     * @param
+     * config (const MuRealtimeConfig &) - requested settings
+     *
+     * @return
+     * int - REALTIME_ flags for the settings in effect
+     *
+     **/
+    int SetRealtime(const MuRealtimeConfig & config);
+    
+    /**
+     * @brief returns the real-time settings in effect
+     *
+     * @return
+     * int - combination of REALTIME_PRIORITY, REALTIME_AFFINITY,
+     * REALTIME_MEMORY_LOCKED, REALTIME_BUFFERS_LOCKED and
+     * REALTIME_PREALLOCATED
+     *
+     **/
+    int RealtimeSettings(void);
+    
+    /**
+     * @brief describes the real-time settings
+     *
+     * @details
+     * RealtimeReport() returns one line for each setting requested with
+     * SetRealtime(), telling whether it is in effect and, if not, why
+     * the system refused it.
+     *
+     * @return
+     * string - report, one setting per line
+     *
+     **/
+    string RealtimeReport(void);
+    
+    /**
+     * @brief sets the size of the window used to stream long materials
+     *
+     * @details
+     * By default, Play() compiles the whole material into MIDI events
+     * before its queue starts playing, so the time it takes to start
+     * grows with the length of the material. SetStreamWindow() enables
+     * streaming: materials with more than 'numEvents' events (two per
+     * note) are compiled a chunk at a time. Their queue starts playing
+     * as soon as the first chunk (a quarter of the window) is ready,
+     * and the following events are produced in time order while it
+     * plays. The events are kept in a ring of 'numEvents' messages, so
+     * the stream never gets more than one window ahead of playback, and
+     * memory used by the queue does not depend on the length of the
+     * material. When the ring is full, the queue waits for the scheduler
+     * to play enough events to make room for another chunk, without
+     * holding a thread: each refill is a separate job for the loader
+     * threads, so any number of long streams leaves them free to load
+     * other requests. Shorter materials are still compiled at once. A
+     * window of NO_STREAMING (the default) disables streaming.
+     *
+     * @param
+     * numEvents (long) - size of the window in events, or NO_STREAMING
+     *
+     * @return
+     * void
+     *
+     **/
+    void SetStreamWindow(long numEvents);
+    
+    /**
+     * @brief returns the size of the streaming window
+     *
+     * @details
+     * StreamWindow() returns the window set by SetStreamWindow(), or
+     * NO_STREAMING if materials are always compiled before playback.
+     *
+     * @return
+     * long - size of the window in events
+     *
+     **/
+    long StreamWindow(void);
+    
+    /**
+     * @brief returns the player's timing statistics
+     *
+     * @details
+     * The scheduler measures how late each event is sent, compared to
+     * the time it was scheduled for, and keeps latency and jitter
+     * histograms, a count of late events and a count of its own
+     * wakeups (see MuPlaybackStats). The measurements cost a clock
+     * reading and a few atomic increments per event, so they are
+     * always on. GetStats() copies them to 'stats' without locking, so
+     * it can be called at any time, from any thread; as the scheduler
+     * may be working meanwhile, fields may differ by a few events.
+     *
+     * @param
+     * stats (MuPlaybackStats &) - receives the statistics
+     *
+     * @return
+     * void
+     *
+     **/
+    void GetStats(MuPlaybackStats & stats);
+    
+    /**
+     * @brief clears the player's timing statistics
+     *
+     * @details
+     * ResetStats() zeroes every counter and histogram, so that
+     * measurements can be taken for a particular passage. The late
+     * threshold is kept.
+     *
+     * @return
+     * void
+     *
+     **/
+    void ResetStats(void);
+    
+    /**
+     * @brief sets the lateness above which events are counted as late
+     *
+     * @param
+     * nanoseconds (long long) - late threshold (DEFAULT_LATE_THRESHOLD
+     * is one millisecond)
+     *
+     * @return
+     * void
+     *
+     **/
+    void SetLateThreshold(long long nanoseconds);
+    
+    /**
+     * @brief returns the progress of the queues being played
      *
      * @details
-     * Each queue has a working thread associated with it. It is
-     * used to fill up the queue with MIDI events extracted from
-     * the material being played. StartQueueThread() initiates this
-     * thread. The thread terminates automatically when all events
-     * from the input material are enqueued for playback.
+     * GetQueueStats() fills 'stats' with the number of events sent,
+     * late events, largest latency and throughput of each queue the
+     * scheduler is playing at the moment of the call (queues which are
+     * still loading are not included). It briefly takes the scheduler's
+     * lock, so it should not be called at a high rate.
+     *
+     * @param
+     * stats (MuQueueStats *) - array with room for 'max' entries
+     *
+     * @param
+     * max (int) - maximum number of queues to report
+     *
+     * @return
+     * int - number of entries filled in 'stats'
+     *
+     **/
+    int GetQueueStats(MuQueueStats * stats, int max);
+    
+    /**
+     * @brief hands an event queue to the loader threads to playback notes
+     *
+     * @details
+     * Each queue is filled up with MIDI events extracted from the
+     * material being played by one of the player's loader threads.
+     * These threads are started by Init() and kept for the lifetime
+     * of the player, so starting playback costs no thread creation:
+     * StartQueueThread() stores a copy of the material in the queue
+     * and pushes the queue onto a lock-free job queue, waking up an
+     * idle loader if necessary. If no loader thread is running (the
+     * player was not initialized, or the threads could not be created)
+     * or the job queue is full, the material is loaded on the calling
+     * thread instead (without streaming). Refills of streaming queues
+     * go through the same job queue, one chunk per job, so a loader is
+     * never kept busy by a queue waiting for room, and requests made
+     * while long materials are streaming are loaded right away.
      *
      * @param
      * inMat (MuMaterial &): reference to the material to be enqueued
@@ -539,24 +1362,23 @@ class MuPlayer
      * queueIdx (int): index of the selected queue
      *
      * @return
-     * bool: StartQueueThread() returns false if it cannot start
-     * the working thread and true otherwise
+     * bool: StartQueueThread() always returns true; errors found while
+     * loading the material return the queue to the pool
      *
      **/
     bool StartQueueThread(MuMaterial & inMat, int queueIdx);
 
     
     /**
-     * @brief starts an event queue working thread for MIDI events
+     * @brief hands an event queue to the loader threads for MIDI events
      *
      * @details
      * This overloaded version of StartQueueThread() works with
-     * a MIDI buffer instead of an MuMaterial.
-     * Each queue has a working thread associated with it. It is
-     * used to fill up the queue with MIDI events extracted from
-     * the input buffer. StartQueueThread() initiates this
-     * thread. The thread terminates automatically when all events
-     * from the input buffer are enqueued for playback.
+     * a MIDI buffer instead of an MuMaterial. It stores the buffer
+     * in the queue and hands the queue to the loader threads, which
+     * copy its events to the queue and activate it. As in the material
+     * version, the buffer is loaded on the calling thread if no loader
+     * is available.
      *
      * @param
      * inMat (MuMIDIBuffer): buffer of events to be enqueued
@@ -565,8 +1387,7 @@ class MuPlayer
      * queueIdx (int): index of the selected queue
      *
      * @return
-     * bool: StartQueueThread() returns false if it cannot start
-     * the working thread and true otherwise
+     * bool: StartQueueThread() always returns true
      *
      **/
     bool StartQueueThread(MuMIDIBuffer events, int queueIdx);
@@ -576,20 +1397,30 @@ class MuPlayer
      * in the corresponding playback event queue.
      *
      * @details
-     * EnqueueMaterial() is the thread function for a queue's working
-     * thread. It is initiated by StartQueueThread() and is responsible
+     * EnqueueMaterial() is the job function for queues playing materials.
+     * It is run by a loader thread (see StartQueueThread()) and is responsible
      * for getting each note from the input material converted to MIDI
      * events and placed in the queue in chronological order, so they
-     * can be scheduled for playback by the scheduler thread. When this
-     * method concludes its work, it sets the queue's 'active' flag to
-     * true, so its events can be accessd  by the scheduler.
+     * can be scheduled for playback by the scheduler thread. Each voice
+     * is read once, in order, and the voices' noteOns are merged with
+     * each other while noteOffs are merged through a heap, so loading
+     * takes O(n log n) time for 'n' notes; noteOffs are placed before
+     * noteOns at the same time. When this
+     * method concludes its work, it hands the queue to the scheduler
+     * (QUEUE_ACTIVE), so its events can be accessd  by the scheduler. When
+     * streaming is enabled (see SetStreamWindow()), long materials are
+     * activated after the first chunk of events, and the rest of the
+     * ring is filled before returning; further events are added by
+     * refill jobs while the queue plays, staying at most one window
+     * ahead of the scheduler. If the material can't be
+     * loaded, the queue goes back to the pool.
      *
      * @param
      * arg (void*) - this argument should receive the address of
-     * the event queue this working thread will be operating on.
+     * the event queue this job will be operating on.
      *
      * @return
-     * void *:  EnqueueMaterial() terminates when the tread exits
+     * void *:  always NULL
      *
      **/
     static void * EnqueueMaterial(void* arg);
@@ -600,20 +1431,20 @@ class MuPlayer
      * corresponding playback event queue.
      *
      * @details
-     * EnqueueEvents() is a thread function for a queue's working
-     * thread. It is initiated by the buffer verion ofStartQueueThread() 
+     * EnqueueEvents() is the job function for queues sending MIDI buffers.
+     * It is run by a loader thread (see the buffer version of StartQueueThread())
      * and is responsible for copying each MIDI event in the buffer to
      * be placed in the queue in chronological order, so they can be
      * scheduled for playback by the scheduler thread. When this method
-     * concludes its work, it sets the queue's 'active' flag to true,
-     * so its events can be accessd  by the scheduler.
+     * concludes its work, it hands the queue to the scheduler
+     * (QUEUE_ACTIVE), so its events can be accessd  by the scheduler.
      *
      * @param
      * arg (void*) - this argument should receive the address of
-     * the event queue this working thread will be operating on.
+     * the event queue this job will be operating on.
      *
      * @return
-     * void *:  EnqueueEvents() terminates when the tread exits
+     * void *:  always NULL
      *
      **/
     static void * EnqueueEvents(void* arg);
@@ -642,13 +1473,15 @@ class MuPlayer
      * @details
      * ScheduleEvents() is the scheduler thread function. It is started
      * from StartScheduler() and runs continuously until the Player is
-     * stopped. Before starting its main loop, ScheduleEvents() checks 
+     * reset. In its main loop, ScheduleEvents() first drains the queues
+     * cancelled by Stop(). Then it checks 
      * if the pause flag is set by the Player, in which case it will
-     * just idle until the next turn. If the player is not paused,
-     * it goes through each queue in the pool, checking if they are active. 
-     * For any active queues, ScheduleEvents() will look for the next event 
-     * in the queue, check its timestamp, and send it to the MIDI system 
-     * if the stamp is expired.
+     * sleep until it is resumed. If the player is not paused,
+     * it adds newly activated queues to its priority queue and then sends
+     * every expired event, always taking the earliest one among all active
+     * queues. When no event is due, it sleeps until the time of the earliest
+     * pending event (or indefinitely, if no queue is active), unless it is
+     * woken up by a new active queue or a change in playback controls.
      *
      * @param
      * pool (void *): pointer to the player object; as the scheduler thread
@@ -666,9 +1499,11 @@ class MuPlayer
      *
      * @details
      * SendMIDIMessage() is called by ScheduleEvents() to deliver
-     * a single MIDI message at a time to its destination.
+     * a single MIDI message at a time to its destination, unless
+     * messages are directed to a sink (see SetOutputSink()).
      * The time stamp within 'msg' is always ignored.
-     * SendMIDIMessage() always delivers every message immediately.
+     * SendMIDIMessage() always delivers every message immediately;
+     * it is used when batched output is off (see SetBatchOutput()).
      * Keeping track of time between events is done by calling code.
      *
      * @note
@@ -721,6 +1556,10 @@ class MuPlayer
      * Player pauses all queues. If it contains 'false', playback is resumed
      * in all queues. 
      *
+     * With a look-ahead window (see SetLookAhead()), events already
+     * handed to the MIDI sequencer which are not due yet are taken back
+     * when playback is paused, and sent again when it is resumed.
+     *
      * @param
      * T_F (bool) - true == pause, false == resume
      *
@@ -740,11 +1579,116 @@ class MuPlayer
      * stop command. It is possible, however to make new requests, as
      * long as the player is not Reset().
      *
+     * Requests made before Stop() are cancelled even if their queues
+     * are still being loaded: they are drained as soon as they reach
+     * the scheduler. Streaming queues stop producing events. Requests
+     * made after Stop() are played normally. Notes which are sounding
+     * when playback is stopped are not turned off, unless their note offs
+     * were already handed to the MIDI sequencer (see SetLookAhead()).
+     *
      * @return
      * void
      *
      **/
     void Stop(void);
+    
+    /**
+     * @brief changes the tempo of every queue
+     *
+     * @details
+     * SetTempo() scales the time between events in every queue, without
+     * recompiling them: a factor of 2.0 plays twice as fast, 0.5 at half
+     * speed. The scheduler maps each event's time stamp through the new
+     * tempo from the point each queue has reached, so playback continues
+     * from where it is and the change is heard within one scheduler tick.
+     * The player's tempo multiplies each queue's own tempo (see
+     * SetQueueTempo()) and applies to queues played later as well.
+     *
+     * With a look-ahead window (see SetLookAhead()), events already
+     * handed to the MIDI sequencer are taken back and sent again with
+     * their new times.
+     *
+     * @param
+     * factor (double) - tempo factor, from MIN_TEMPO to MAX_TEMPO
+     * (NORMAL_TEMPO plays events at their compiled times)
+     *
+     * @return
+     * bool - false if 'factor' is out of range
+     *
+     **/
+    bool SetTempo(double factor);
+    
+    /**
+     * @brief returns the tempo factor applied to every queue
+     *
+     * @return
+     * double - player's tempo factor
+     *
+     **/
+    double Tempo(void);
+    
+    /**
+     * @brief changes the tempo of a single queue
+     *
+     * @details
+     * SetQueueTempo() works like SetTempo() for one queue, identified by
+     * its index in the playback pool (see GetQueueStats()). The queue
+     * must be loading or playing; its tempo goes back to NORMAL_TEMPO
+     * when it finishes.
+     *
+     * @param
+     * queue (int) - index of the queue in the playback pool
+     *
+     * @param
+     * factor (double) - tempo factor, from MIN_TEMPO to MAX_TEMPO
+     *
+     * @return
+     * bool - false if 'factor' is out of range or the queue is not in use
+     *
+     **/
+    bool SetQueueTempo(int queue, double factor);
+    
+    /**
+     * @brief returns the tempo factor of a single queue
+     *
+     * @param
+     * queue (int) - index of the queue in the playback pool
+     *
+     * @return
+     * double - queue's own tempo factor (NORMAL_TEMPO if the
+     * queue does not exist)
+     *
+     **/
+    double QueueTempo(int queue);
+    
+    /**
+     * @brief moves a queue to another point of its time line
+     *
+     * @details
+     * Seek() makes a playing queue continue from 'position', measured
+     * in seconds from the start of its events (as in their time stamps,
+     * before any tempo is applied). The first event at or after
+     * 'position' is sent when that point is reached, at the current
+     * tempo, so seeking back to the start of a queue just before it ends
+     * plays it in a loop. Notes sounding when the queue is moved are
+     * turned off. Seeking past the last event finishes the queue.
+     *
+     * A queue can be moved while it is playing (see GetQueueStats() for
+     * its index and current position). Streaming queues (see
+     * SetStreamWindow()) can't be moved, since their events are compiled
+     * while they play.
+     *
+     * @param
+     * queue (int) - index of the queue in the playback pool
+     *
+     * @param
+     * position (double) - new position, in seconds
+     *
+     * @return
+     * bool - false if the queue is not playing or is streaming
+     *
+     **/
+    bool Seek(int queue, double position);
 };
 
 #endif /* MU_PLAYER_H */
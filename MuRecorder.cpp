@@ -8,6 +8,35 @@
 
 #include "MuRecorder.h"
 
+// Allocates an empty input ring with 'size' slots ('size' must be a power of two)...
+static MuInputRing * NewInputRing(unsigned long size)
+{
+    MuInputRing * r = new MuInputRing;
+    if(r != NULL)
+    {
+        r->data = new MuMIDIMessage[size];
+        if(r->data == NULL)
+        {
+            delete r;
+            return NULL;
+        }
+        r->size = size;
+        r->write.store(0);
+        r->read.store(0);
+        r->next.store(NULL);
+    }
+    return r;
+}
+
+static void DeleteInputRing(MuInputRing * r)
+{
+    if(r != NULL)
+    {
+        delete [] r->data;
+        delete r;
+    }
+}
+
 MuRecorder::MuRecorder(void)
 {
     
@@ -25,17 +54,19 @@ MuRecorder::MuRecorder(void)
 #endif
     
     // Common
-    buff1.data = NULL;
-    buff1.max = 0;
-    buff1.count = 0;
-    
-    buff2.data = NULL;
-    buff2.max = 0;
-    buff2.count = 0;
-    
-    currentBuffer = NULL;
+    writeRing = NULL;
+    readRing = NULL;
+    spareRing.store(NULL);
+    leaseIndex = 0;
+    captureMode = CAPTURE_MODE_FIXED;
+    capturedCount.store(0);
+    droppedCount.store(0);
+    consumedCount.store(0);
+    peakCount.store(0);
     
     initialStamp = 0;
+    lastStamp = 0;
+    stampAnchored = false;
 }
 
 MuRecorder::~MuRecorder(void)
@@ -52,41 +83,36 @@ MuRecorder::~MuRecorder(void)
 	}
 #endif
     
-    if(buff1.data != NULL)
-        delete [] buff1.data;
-    
-    if(buff2.data != NULL)
-        delete [] buff2.data;
+    // release every ring in the chain...
+    while(readRing != NULL)
+    {
+        MuInputRing * next = readRing->next.load();
+        DeleteInputRing(readRing);
+        readRing = next;
+    }
+    DeleteInputRing(spareRing.exchange(NULL));
 }
 
 bool MuRecorder::Init(long buffSize = DEFAULT_BUFFER_SIZE)
 {
     // remember when the Recorder started to run...
-    initialStamp = ClockStamp();
-    
-    // ALLOCATE MIDI BUFFERS...
-    if(buff1.data == NULL)
-    {
-        buff1.data = new MuMIDIMessage[buffSize];
-        if(buff1.data != NULL)
-        {
-            buff1.max = buffSize;
-            buff1.count = 0;
-        }
-    }
+    initialStamp = NanoClockStamp();
+    lastStamp = 0;
+    stampAnchored = false;
     
-    if(buff2.data == NULL)
+    // ALLOCATE INPUT RING...
+    // (ring size must be a power of two so indices can be masked)
+    if(readRing == NULL)
     {
-        buff2.data = new MuMIDIMessage[buffSize];
-        if(buff2.data != NULL)
-        {
-            buff2.max = buffSize;
-            buff2.count = 0;
-        }
+        unsigned long size = 2;
+        while((long)size < buffSize)
+            size <<= 1;
+        
+        readRing = writeRing = NewInputRing(size);
+        leaseIndex = 0;
+        PrepareSpareRing();
     }
     
-    currentBuffer = &buff1;
-    
 #ifdef MUM_MACOSX
     // INITIALIZE MIDI PORTS...
     long n,i;
@@ -227,48 +253,186 @@ bool MuRecorder::SelectMIDISource(int sourceNumber)
     return false;
 }
 
-void MuRecorder::ToggleCurrentBuffer(void)
-{
-    if (currentBuffer == &buff1)
-        currentBuffer = &buff2;
-    else
-        currentBuffer = &buff1;
-}
-
 MuMIDIBuffer MuRecorder::GetData(void)
 {
     MuMIDIBuffer outBuffer;
     outBuffer.data = NULL;
     outBuffer.max = 0;
     outBuffer.count = 0;
-    MuMIDIBuffer * previous;
+    MuInputRing * r;
     
-    // Keep the address of where the data is...
-    previous = currentBuffer;
+    // nothing to do if there are blocks lent by AcquireData()...
+    if((readRing == NULL) || (leaseIndex != readRing->read.load(memory_order_relaxed)))
+        return outBuffer;
     
-    // redirect input to the other buffer...
-    ToggleCurrentBuffer();
+    AdvanceReadRing();
+    PrepareSpareRing();
+    
+    // messages between read and write indices are ready
+    // (acquire: their contents are visible after this load);
+    // they may be spread along several rings...
+    long n = 0;
+    for(r = readRing; r != NULL; r = r->next.load(memory_order_acquire))
+        n += (long)(r->write.load(memory_order_acquire) - r->read.load(memory_order_relaxed));
     
     // allocate memory to copy data...
-    long i;
-    long n = previous->count;
     if(n > 0)
     {
         outBuffer.data = new MuMIDIMessage[n];
         if(outBuffer.data != NULL)
         {
-            for(i = 0; i < n; i++)
-                outBuffer.data[i] = previous->data[i];
+            long copied = 0;
+            for(r = readRing; (r != NULL) && (copied < n); r = r->next.load(memory_order_acquire))
+            {
+                unsigned long read = r->read.load(memory_order_relaxed);
+                unsigned long avail = r->write.load(memory_order_acquire) - read;
+                unsigned long i;
+                if(avail > (unsigned long)(n - copied))
+                    avail = n - copied;
+                for(i = 0; i < avail; i++)
+                    outBuffer.data[copied++] = r->data[(read + i) & (r->size - 1)];
+                
+                // free the slots we just copied, so we don't run out of space
+                // (release: copies are complete before the callback reuses them)
+                r->read.store(read + avail, memory_order_release);
+            }
             outBuffer.max = n;
             outBuffer.count = n;
+            consumedCount.fetch_add(n, memory_order_relaxed);
             
-            // flush previous buffer, so we don't run out of space
-            previous->count = 0;
+            AdvanceReadRing();
+            leaseIndex = readRing->read.load(memory_order_relaxed);
         }
     }
     return outBuffer;
 }
 
+MuMIDIBuffer MuRecorder::AcquireData(void)
+{
+    MuMIDIBuffer block;
+    block.data = NULL;
+    block.max = 0;
+    block.count = 0;
+    
+    if(readRing == NULL)
+        return block;
+    
+    AdvanceReadRing();
+    PrepareSpareRing();
+    
+    unsigned long size = readRing->size;
+    unsigned long write = readRing->write.load(memory_order_acquire);
+    unsigned long first = leaseIndex & (size - 1);
+    unsigned long n = write - leaseIndex;
+    
+    // blocks can't go past the end of the ring...
+    if(n > size - first)
+        n = size - first;
+    
+    if(n > 0)
+    {
+        block.data = readRing->data + first;
+        block.max = n;
+        block.count = n;
+        leaseIndex += n;
+    }
+    return block;
+}
+
+void MuRecorder::ReleaseData(MuMIDIBuffer block)
+{
+    if((readRing == NULL) || (block.data == NULL) || (block.count <= 0))
+        return;
+    
+    // only the oldest block can be released...
+    unsigned long read = readRing->read.load(memory_order_relaxed);
+    if( (block.data != readRing->data + (read & (readRing->size - 1))) ||
+        ((unsigned long)block.count > (leaseIndex - read)) )
+        return;
+    
+    // (release: calling code is done reading before the callback reuses the slots)
+    readRing->read.store(read + block.count, memory_order_release);
+    consumedCount.fetch_add(block.count, memory_order_relaxed);
+}
+
+void MuRecorder::AdvanceReadRing(void)
+{
+    while(readRing != NULL)
+    {
+        // the MIDI callback only links a new ring after it stops
+        // writing to the current one, so once 'next' is set, the
+        // current ring's write index can no longer change...
+        MuInputRing * next = readRing->next.load(memory_order_acquire);
+        if(next == NULL)
+            break;
+        
+        unsigned long read = readRing->read.load(memory_order_relaxed);
+        if((read != readRing->write.load(memory_order_acquire)) || (leaseIndex != read))
+            break;
+        
+        DeleteInputRing(readRing);
+        readRing = next;
+        leaseIndex = 0;
+    }
+}
+
+void MuRecorder::PrepareSpareRing(void)
+{
+    if((captureMode != CAPTURE_MODE_GROW) || (readRing == NULL))
+        return;
+    if(spareRing.load(memory_order_acquire) != NULL)
+        return;
+    
+    // spare rings are twice as large as the
+    // newest ring, up to a maximum size...
+    MuInputRing * last = readRing;
+    MuInputRing * next;
+    while((next = last->next.load(memory_order_acquire)) != NULL)
+        last = next;
+    
+    unsigned long size = last->size * 2;
+    if(size > MAX_INPUT_RING_SIZE)
+        size = last->size;
+    
+    // (release: the callback sees a fully built ring)
+    spareRing.store(NewInputRing(size), memory_order_release);
+}
+
+void MuRecorder::SetCaptureMode(short mode)
+{
+    if(mode == CAPTURE_MODE_GROW)
+    {
+        captureMode = CAPTURE_MODE_GROW;
+        PrepareSpareRing();
+    }
+    else
+    {
+        // take back any spare ring, so the callback stops growing...
+        captureMode = CAPTURE_MODE_FIXED;
+        DeleteInputRing(spareRing.exchange(NULL, memory_order_acq_rel));
+    }
+}
+
+short MuRecorder::CaptureMode(void)
+{
+    return captureMode;
+}
+
+unsigned long MuRecorder::CapturedEvents(void)
+{
+    return capturedCount.load(memory_order_relaxed);
+}
+
+unsigned long MuRecorder::DroppedEvents(void)
+{
+    return droppedCount.load(memory_order_relaxed);
+}
+
+unsigned long MuRecorder::PeakOccupancy(void)
+{
+    return peakCount.load(memory_order_relaxed);
+}
+
 #ifdef MUM_MACOSX
 void MuRecorder::MIDIInputCallback (const MIDIPacketList *list, void *procRef,void *srcRef)
 {
@@ -279,12 +443,24 @@ void MuRecorder::MIDIInputCallback (const MIDIPacketList *list, void *procRef,vo
     const MIDIPacket *packet = &(list->packet[0]);
     UInt16 nBytes,j;
     MuMIDIMessage msg;
-    msg.time = ((ClockStamp() - recorder->initialStamp)/ (float)ONE_SECOND);
+    long long now = NanoClockStamp();
+    UInt64 hostNow = mach_absolute_time();
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
     
     for ( i = 0; i < list->numPackets; i++)
     {
         nBytes = packet->length;
         
+        // packet time stamps are in host time units; a packet's
+        // age tells how long before 'now' it actually arrived
+        // (zero means the packet was stamped 'now')...
+        long long age = 0;
+        if((packet->timeStamp != 0) && (packet->timeStamp < hostNow))
+            age = (long long)(((hostNow - packet->timeStamp) * timebase.numer) / timebase.denom);
+        msg.stamp = (now - age) - recorder->initialStamp;
+        msg.time = (float)((double)msg.stamp / ONE_SECOND_NS);
+        
         j = 0;
         while(j < nBytes)
         {
@@ -328,7 +504,21 @@ void MuRecorder::MIDIInputCallback(double timeStamp, vector< unsigned char > * m
     unsigned int i;
     MuRecorder * recorder = (MuRecorder *)userData;
     MuMIDIMessage msg;
-    msg.time = ((ClockStamp() - recorder->initialStamp)/ (float)ONE_SECOND);
+    
+    // RtMidi passes the time since its previous message in
+    // 'timeStamp'; the first message is anchored to the clock
+    // and the following ones accumulate those deltas...
+    if(!recorder->stampAnchored)
+    {
+        recorder->lastStamp = NanoClockStamp() - recorder->initialStamp;
+        recorder->stampAnchored = true;
+    }
+    else
+    {
+        recorder->lastStamp += TimeToNanoStamp(timeStamp);
+    }
+    msg.stamp = recorder->lastStamp;
+    msg.time = (float)((double)msg.stamp / ONE_SECOND_NS);
     
     unsigned int nBytes = message->size();
     
@@ -358,11 +548,39 @@ void MuRecorder::MIDIInputCallback(double timeStamp, vector< unsigned char > * m
 
 void MuRecorder::AddMessageToBuffer(MuMIDIMessage msg)
 {
-    if(currentBuffer->count < (currentBuffer->max - 1))
+    MuInputRing * r = writeRing;
+    if(r == NULL)
+        return;
+    
+    unsigned long write = r->write.load(memory_order_relaxed);
+    unsigned long read = r->read.load(memory_order_acquire);
+    
+    // if the ring is full, move on to the spare ring, if there is one
+    // (release: GetData() sees the link only after we are done with the old ring)...
+    if((write - read) >= r->size)
     {
-        currentBuffer->data[currentBuffer->count] = msg;
-        currentBuffer->count++;
+        MuInputRing * spare = spareRing.exchange(NULL, memory_order_acq_rel);
+        if(spare == NULL)
+        {
+            droppedCount.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        r->next.store(spare, memory_order_release);
+        writeRing = r = spare;
+        write = 0;
     }
+    
+    // store message and then publish it
+    // (release: GetData() only sees the message after it is complete)...
+    r->data[write & (r->size - 1)] = msg;
+    r->write.store(write + 1, memory_order_release);
+    
+    // update statistics (only this thread writes 'capturedCount' and 'peakCount')...
+    unsigned long captured = capturedCount.load(memory_order_relaxed) + 1;
+    capturedCount.store(captured, memory_order_relaxed);
+    unsigned long waiting = captured - consumedCount.load(memory_order_relaxed);
+    if(waiting > peakCount.load(memory_order_relaxed))
+        peakCount.store(waiting, memory_order_relaxed);
 }
 
 // Obs.:
@@ -406,13 +624,41 @@ MuMIDIBuffer MuRecorder::JoinMIDIBuffers(MuMIDIBuffer buff1, MuMIDIBuffer buff2)
     return res;
 }
 
+// noteOff events include noteOns with key velocity zero...
+static bool IsNoteOff(const MuMIDIMessage & msg)
+{
+    return (((msg.status & 0xF0) == MU_NOTE_OFF) ||
+            (((msg.status & 0xF0) == MU_NOTE_ON) && (msg.data2 == 0)));
+}
+
+static bool IsNoteOn(const MuMIDIMessage & msg)
+{
+    return (((msg.status & 0xF0) == MU_NOTE_ON) && (msg.data2 != 0));
+}
+
+// finds the index of the last noteOff for each channel and pitch
+// (-1 when there is none), so a noteOn at index 'i' has a matching
+// noteOff only if lastOff[channel][pitch] > i...
+static void FindLastNoteOffs(MuMIDIBuffer buff, long lastOff[16][128])
+{
+    long i;
+    for(i = 0; i < 16 * 128; i++)
+        lastOff[i / 128][i % 128] = -1;
+    
+    for(i = 0; (buff.data != NULL) && (i < buff.count); i++)
+    {
+        if(IsNoteOff(buff.data[i]))
+            lastOff[buff.data[i].status & 0x0F][buff.data[i].data1 & 0x7F] = i;
+    }
+}
+
 MuMIDIBuffer MuRecorder::ExtractInvalidNotes(MuMIDIBuffer buff)
 {
     MuMIDIBuffer newBuff;
-    MuMIDIMessage first,second;
-    long i,j,k,n;
+    MuMIDIMessage first;
+    long lastOff[16][128];
+    long i,k,n;
     k = 0;
-    bool matchFound = false;
     
     n = buff.count;
     newBuff.data = new MuMIDIMessage[n];
@@ -420,34 +666,15 @@ MuMIDIBuffer MuRecorder::ExtractInvalidNotes(MuMIDIBuffer buff)
     {
         newBuff.max = n;
         newBuff.count = n;
-        // for each noteOn event in the input buffer, check remaining events for a matching noteOff
+        FindLastNoteOffs(buff, lastOff);
+        // a noteOn is invalid if there are no matching noteOffs after it...
         for(i = 0; i < n; i++)
         {
             first = buff.data[i];
-            matchFound = false;
-            if(((first.status & 0xF0) == 0x90) && (first.data2 != 0))
+            if(IsNoteOn(first) && (lastOff[first.status & 0x0F][first.data1 & 0x7F] < i))
             {
-                for(j = i+1; j < n; j++)
-                {
-                    second = buff.data[j];
-                    if( // this is a noteOff or...
-                      (((second.status & 0xF0) == 0x80) ||
-                       // a noteOn with key velocity zero...
-                      (((second.status & 0xF0) == 0x90) && (second.data2 == 0))) &&
-                      // and the event is for the same channel and same pitch...
-                      (((second.status & 0x0F) == (first.status & 0x0F)) && (second.data1 == first.data1))
-                    )
-                    {
-                        matchFound = true;
-                        break;
-                    }
-                }
-                
-                if(!matchFound)
-                {
-                    newBuff.data[k] = first;
-                    k++;
-                }
+                newBuff.data[k] = first;
+                k++;
             }
         }
     }
@@ -483,3 +710,223 @@ MuMIDIBuffer MuRecorder::ExtractEventsOfType(unsigned char eventType, MuMIDIBuff
     return newBuff;
 }
 
+MuMIDIBuffer MuRecorder::MergeMIDIBuffers(MuMIDIBuffer buff1, MuMIDIBuffer buff2)
+{
+    MuMIDIBuffer res;
+    res.data = NULL;
+    res.max = 0;
+    res.count = 0;
+    long i, j, k;
+    long n1 = (buff1.data != NULL) ? buff1.count : 0;
+    long n2 = (buff2.data != NULL) ? buff2.count : 0;
+    
+    if((n1 + n2) > 0)
+    {
+        res.data = new MuMIDIMessage[n1 + n2];
+        if(res.data != NULL)
+        {
+            i = j = k = 0;
+            while((i < n1) && (j < n2))
+            {
+                // on equal stamps, buff1 goes first...
+                if(buff2.data[j].stamp < buff1.data[i].stamp)
+                    res.data[k++] = buff2.data[j++];
+                else
+                    res.data[k++] = buff1.data[i++];
+            }
+            while(i < n1)
+                res.data[k++] = buff1.data[i++];
+            while(j < n2)
+                res.data[k++] = buff2.data[j++];
+            
+            res.max = n1 + n2;
+            res.count = k;
+        }
+    }
+    
+    return res;
+}
+
+// true if the next message in buffer 'a' should come
+// before the next message in buffer 'b'...
+static bool MergeBefore(MuMIDIBuffer * buffs, long * pos, long a, long b)
+{
+    long long sa = buffs[a].data[pos[a]].stamp;
+    long long sb = buffs[b].data[pos[b]].stamp;
+    return (sa < sb) || ((sa == sb) && (a < b));
+}
+
+static void SiftMergeHeap(MuMIDIBuffer * buffs, long * pos, long * heap, long n, long i)
+{
+    long top = heap[i];
+    while(true)
+    {
+        long child = (2 * i) + 1;
+        if(child >= n)
+            break;
+        if((child + 1 < n) && MergeBefore(buffs, pos, heap[child + 1], heap[child]))
+            child++;
+        if(!MergeBefore(buffs, pos, heap[child], top))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = top;
+}
+
+MuMIDIBuffer MuRecorder::MergeMIDIBuffers(MuMIDIBuffer * buffs, long numBuffs)
+{
+    MuMIDIBuffer res;
+    res.data = NULL;
+    res.max = 0;
+    res.count = 0;
+    long i, n, total;
+    
+    if((buffs == NULL) || (numBuffs <= 0))
+        return res;
+    
+    // two buffers or less don't need a heap...
+    if(numBuffs == 1)
+    {
+        MuMIDIBuffer empty;
+        empty.data = NULL;
+        empty.max = 0;
+        empty.count = 0;
+        return MergeMIDIBuffers(buffs[0], empty);
+    }
+    if(numBuffs == 2)
+        return MergeMIDIBuffers(buffs[0], buffs[1]);
+    
+    total = 0;
+    for(i = 0; i < numBuffs; i++)
+    {
+        if(buffs[i].data != NULL)
+            total += buffs[i].count;
+    }
+    if(total == 0)
+        return res;
+    
+    long * pos = new long[2 * numBuffs];
+    res.data = new MuMIDIMessage[total];
+    if((pos == NULL) || (res.data == NULL))
+    {
+        delete [] pos;
+        delete [] res.data;
+        res.data = NULL;
+        return res;
+    }
+    long * heap = pos + numBuffs;
+    
+    // the heap holds every buffer which still has messages...
+    n = 0;
+    for(i = 0; i < numBuffs; i++)
+    {
+        pos[i] = 0;
+        if((buffs[i].data != NULL) && (buffs[i].count > 0))
+            heap[n++] = i;
+    }
+    for(i = (n / 2) - 1; i >= 0; i--)
+        SiftMergeHeap(buffs, pos, heap, n, i);
+    
+    while(n > 0)
+    {
+        long b = heap[0];
+        res.data[res.count++] = buffs[b].data[pos[b]++];
+        if(pos[b] >= buffs[b].count)
+            heap[0] = heap[--n];
+        if(n > 0)
+            SiftMergeHeap(buffs, pos, heap, n, 0);
+    }
+    res.max = total;
+    
+    delete [] pos;
+    return res;
+}
+
+bool MuRecorder::MergeIntoMIDIBuffer(MuMIDIBuffer & dest, MuMIDIBuffer src)
+{
+    long n1 = (dest.data != NULL) ? dest.count : 0;
+    long n2 = (src.data != NULL) ? src.count : 0;
+    long i, j, k;
+    
+    if(n2 == 0)
+        return true;
+    if((dest.data == NULL) || (dest.max < (n1 + n2)))
+        return false;
+    
+    // fill 'dest' from the back, so no message is
+    // overwritten before it has been moved...
+    i = n1 - 1;
+    j = n2 - 1;
+    k = n1 + n2 - 1;
+    while(j >= 0)
+    {
+        // on equal stamps, dest messages stay first...
+        if((i >= 0) && (dest.data[i].stamp > src.data[j].stamp))
+            dest.data[k--] = dest.data[i--];
+        else
+            dest.data[k--] = src.data[j--];
+    }
+    dest.count = n1 + n2;
+    
+    return true;
+}
+
+// type flag for a message (see MuMIDI.h)...
+static unsigned char EventTypeFlag(unsigned char status)
+{
+    if(status < 0x80)
+        return 0;
+    return (unsigned char)(1 << ((status >> 4) & 0x07));
+}
+
+long MuRecorder::KeepEventsOfType(unsigned char typeFlags, MuMIDIBuffer & buff)
+{
+    long i, j = 0;
+    for(i = 0; (buff.data != NULL) && (i < buff.count); i++)
+    {
+        if(EventTypeFlag(buff.data[i].status) & typeFlags)
+        {
+            if(j != i)
+                buff.data[j] = buff.data[i];
+            j++;
+        }
+    }
+    buff.count = j;
+    return j;
+}
+
+long MuRecorder::RemoveEventsOfType(unsigned char typeFlags, MuMIDIBuffer & buff)
+{
+    long i, j = 0;
+    for(i = 0; (buff.data != NULL) && (i < buff.count); i++)
+    {
+        if(!(EventTypeFlag(buff.data[i].status) & typeFlags))
+        {
+            if(j != i)
+                buff.data[j] = buff.data[i];
+            j++;
+        }
+    }
+    buff.count = j;
+    return j;
+}
+
+long MuRecorder::RemoveInvalidNotes(MuMIDIBuffer & buff)
+{
+    long lastOff[16][128];
+    long i, j = 0;
+    
+    FindLastNoteOffs(buff, lastOff);
+    for(i = 0; (buff.data != NULL) && (i < buff.count); i++)
+    {
+        const MuMIDIMessage & msg = buff.data[i];
+        if(IsNoteOn(msg) && (lastOff[msg.status & 0x0F][msg.data1 & 0x7F] < i))
+            continue;
+        if(j != i)
+            buff.data[j] = buff.data[i];
+        j++;
+    }
+    buff.count = j;
+    return j;
+}
@@ -17,12 +17,12 @@
  * @details
  * MuRecorder introduces MIDI input to the MuM library.
  * The class starts an independent thread that constantly
- * looks for incomming MIDI data an adds it to a pair
- * of input buffers that the rest of the class can access.
+ * looks for incomming MIDI data an adds it to an input
+ * ring buffer that the rest of the class can access.
  * When user code wants to check for available data, it
  * calls GetData(), which copies available MIDI messages
- * from one of the buffers, leaving the other one free
- * to keep receiving other messages. Normally only a 
+ * from the ring, while the input thread keeps storing
+ * new messages in free slots. Normally only a 
  * single object of this class needs to be instantiated 
  * within a MuM based application.
  *
@@ -35,6 +35,7 @@
 #define MuRecoder_H
 
 #include <vector>
+#include <atomic>
 using namespace std;
 
 #include <pthread.h>
@@ -43,6 +44,7 @@ using namespace std;
 
 #ifdef MUM_MACOSX
 #include <CoreMIDI/MIDIServices.h>
+#include <mach/mach_time.h>
 #endif
 
 #ifdef MUM_LINUX
@@ -50,6 +52,39 @@ using namespace std;
 #include <unistd.h>
 #endif
 
+//! @brief capture mode: input ring has a fixed size; messages are dropped when it is full
+const short CAPTURE_MODE_FIXED = 0;
+//! @brief capture mode: a larger ring is chained to the input when it is full
+const short CAPTURE_MODE_GROW = 1;
+
+//! @brief largest ring (number of messages) allocated by CAPTURE_MODE_GROW
+const unsigned long MAX_INPUT_RING_SIZE = 1048576;
+
+/**
+ * @brief Input Ring structure
+ *
+ * @details
+ * MuInputRing is the single-producer/single-consumer ring buffer used
+ * by MuRecorder to store incomming MIDI messages. 'write' and 'read'
+ * count the messages written and read so far; the slot for message 'i'
+ * is data[i & (size - 1)]. When a recorder grows its input storage,
+ * rings are chained through 'next'. This structure is used internally
+ * by MuRecorder.
+ **/
+struct MuInputRing
+{
+    //! @brief message slots
+    MuMIDIMessage * data;
+    //! @brief number of slots (a power of two)
+    unsigned long size;
+    //! @brief messages written so far (MIDI input thread)
+    atomic<unsigned long> write;
+    //! @brief messages read so far (calling thread)
+    atomic<unsigned long> read;
+    //! @brief next ring in the chain, set by MIDI input thread when this ring is full
+    atomic<MuInputRing *> next;
+};
+
 /**
  * @class MuRecorder
  *
@@ -61,7 +96,7 @@ using namespace std;
  * MuRecorder is the class responsible for MIDI input in the
  * MuM Library. The class listens to system MIDI connections
  * from devices and applications and stores received MIDI events
- * in a pair of input buffers. From there, these events can be 
+ * in an input ring buffer. From there, these events can be 
  * retrieved by calling code using MuRecorder's methods.
  *
  * INITIALIZATION:
@@ -87,20 +122,27 @@ using namespace std;
  * Once MIDI connections are in place, Init() starts a listener thread
  * which is responsible for actually receiving MIDI events. The listener
  * pols system resources frequently looking for  MIDI messages. When 
- * a message is received, it gets copied to the current input buffer
- * and stamped with current system time with ClockStamp().
+ * a message is received, it gets copied to the input ring
+ * and stamped with the time elapsed since Init(), read from the
+ * system's monotonic clock (see NanoClockStamp()). Each message
+ * receives a nanosecond stamp (MuMIDIMessage::stamp) and the same
+ * time in seconds (MuMIDIMessage::time). Whenever the MIDI system
+ * provides its own time for an event (packet time stamps in CoreMIDI,
+ * event time deltas in RtMidi), that time is used instead of the
+ * moment the callback runs, so scheduling delays in the listener
+ * thread do not affect recorded timing.
  *
  * USING RECORDERS:
  *
  * Once initialized, the recorder object will immediately start
  * listening to incomming events. Each event received from
- * the system is timestamped and stored in the currently
- * available buffer. 
+ * the system is timestamped and stored in the next
+ * free slot of the input ring. 
  *
  * Whenever client code needs to get MIDI data it
- * calls GetData(). GetData() toggles current buffer
- * redirecting input to the other buffer, while copying data.
- * This way the listener thread doesn't have to wait to  
+ * calls GetData(). GetData() copies every message stored
+ * in the ring since the previous call and then frees
+ * their slots. The listener thread never has to wait to  
  * store new messages. GetData() makes a copy of the
  * available data, puts it into a MIDI buffer structure
  * (MuMIDIBuffer) and returnes it to the caller.
@@ -118,24 +160,59 @@ using namespace std;
  * The buffers returned by GetData() can be added into larger buffers
  * with MuRecorder::JoinMIDIBuffers() so user code can access 
  * all incomming that is continuously stored by the recorder.
+ * Buffers coming from different sources (several recorders, or
+ * recorded and generated data) can be combined in time order with
+ * MergeMIDIBuffers(), in a single linear pass. Recorded sessions can
+ * be cleaned up in place, without allocating memory, with
+ * KeepEventsOfType(), RemoveEventsOfType() and RemoveInvalidNotes().
  * This data can also be converted to a music material for use in MuM
  * with a call to MuMaterial::LoadMIDIBuffer();
  *
+ * Code which polls the recorder very frequently (live input tools, for
+ * instance) can avoid the allocation and copy done by GetData() with
+ * AcquireData() and ReleaseData(). AcquireData() lends calling code a
+ * block of messages which stays inside the recorder's own preallocated
+ * memory; when calling code is done with it, ReleaseData() gives the
+ * block back to the recorder, so its slots can receive new messages.
+ *
  * UNDER THE HOOD
  *
  * In order to keep working continuously and without generating wrong timestamps,
- * the listener works in a separate thread. Also it stores the data collected
- * from MIDI system in two separate, alternating buffers. Whenever GetData()
- * gets called, the listener stops writing in the current buffer and moves
- * to the other one. Meanwhile, GetData(), operating in the main thread,
- * copies data from the first buffer and returns it to calling code. The
- * two input buffers are pre-allocated when the recorder is initialized,
- * so that when getting new data, the listener never has to allocate memory, 
- * or move data around. It just copies a MIDI message structure into a new 
- * address in one of the arrays. Switching arrays is also a very cheap
- * operation (changing a pointer address) which is done by GetData(), so
- * that, as far as the listener is concerned it is just storing another
- * message to a given address.
+ * the listener works in a separate thread. It stores the data collected
+ * from MIDI system in a ring buffer shared with GetData(), which runs in the
+ * calling thread. The ring is a single-producer/single-consumer queue: only
+ * the listener writes messages and advances the write index, and only
+ * GetData() reads messages and advances the read index. Both indices are
+ * atomic; the listener publishes a message (with a release store of the
+ * write index) only after it has been completely written, and GetData()
+ * frees slots (with a release store of the read index) only after their
+ * messages have been copied, so neither side ever sees a partially written
+ * message and neither side ever waits for the other. The ring is
+ * pre-allocated when the recorder is initialized, so that when getting new
+ * data, the listener never has to allocate memory, or move data around. It
+ * just copies a MIDI message structure into the next free slot. If the ring
+ * is full, because GetData() has not been called for a long time, new
+ * messages are discarded.
+ *
+ * CAPTURE MODES AND STATISTICS
+ *
+ * Dense input (controller streams, for instance) may fill the input ring
+ * faster than calling code can drain it. By default (CAPTURE_MODE_FIXED)
+ * the ring keeps the size requested in Init() and messages arriving while
+ * it is full are dropped. In CAPTURE_MODE_GROW (see SetCaptureMode())
+ * the recorder keeps a spare ring, twice as large as the newest one,
+ * allocated in advance by the calling thread. When the input ring is full,
+ * the listener links the spare ring after it and goes on storing messages
+ * there, without waiting or allocating memory; GetData() and AcquireData()
+ * read the rings in order, release each ring once it has been emptied and
+ * prepare a new spare ring for the listener. Messages are only dropped if
+ * the spare ring has already been used and calling code has not yet
+ * collected data again.
+ *
+ * In either mode the recorder counts captured messages, dropped messages
+ * and the largest number of messages ever waiting to be collected (see
+ * CapturedEvents(), DroppedEvents() and PeakOccupancy()). These figures
+ * can be used to choose an adequate buffer size for Init().
  *
  * SAMPLE:
  *
@@ -184,9 +261,17 @@ class MuRecorder
     private:
     
     // DATA...
-    MuMIDIBuffer buff1;
-    MuMIDIBuffer buff2;
-    MuMIDIBuffer * currentBuffer; // points to one of the input buffers
+    MuInputRing * writeRing;                // ring being filled (MIDI input thread)
+    MuInputRing * readRing;                 // oldest ring with data (calling thread)
+    atomic<MuInputRing *> spareRing;        // next ring for the input thread, if any
+    unsigned long leaseIndex;               // messages handed out by AcquireData() so far
+    short captureMode;
+    
+    // STATISTICS...
+    atomic<unsigned long> capturedCount;
+    atomic<unsigned long> droppedCount;
+    atomic<unsigned long> consumedCount;
+    atomic<unsigned long> peakCount;
     
 #ifdef MUM_MACOSX
     // MIDI CONNECTIONS...
@@ -200,23 +285,33 @@ class MuRecorder
     int selectedPort;
 #endif
     
-    long initialStamp;
+    // TIME STAMPS (nanoseconds)...
+    long long initialStamp;
+    long long lastStamp;
+    bool stampAnchored;
     
     /**
-     * @brief toggles the current input buffer to be used by MIDI input
-     * callback function
+     * @brief releases input rings which have already been emptied
      *
      * @details
-     * MuRecorder uses two alternating input buffers to store incomming MIDI
-     * events. When client code requests data, the MIDI callback has to be
-     * redirected to a different buffer in order to keep running smoothly
-     * and avoid conflicts with the data reading routine. So whenever GetData() 
-     * is called, it runs ToggleCurrentBuffer() to point the listener to
-     * the next available buffer.
+     * When input storage grows, the oldest ring in the chain can be released
+     * as soon as the MIDI callback has moved to the next one and every message
+     * in it has been collected. AdvanceReadRing() is called by GetData() and
+     * AcquireData() and only runs in the calling thread.
      *
+     **/
+    void AdvanceReadRing(void);
+    
+    /**
+     * @brief allocates a spare ring for the MIDI callback
+     *
+     * @details
+     * In CAPTURE_MODE_GROW, PrepareSpareRing() makes sure a spare ring
+     * is available, so that the MIDI callback never has to allocate memory.
+     * It is called by Init(), GetData() and AcquireData(), in the calling thread.
      *
-     */
-    void ToggleCurrentBuffer(void);
+     **/
+    void PrepareSpareRing(void);
     
 public:
     // Constructor/Destructor
@@ -277,15 +372,15 @@ public:
      * is always safer to check the return value for this method. If Init()
      * for any reason returns 'false', it means one or more of the CoreMIDI/RtMidi
      * calls failed, in which case the MuRecorder object should not be used.
-     * Init() will also fail if it cannot allocate memory for the input buffers.
+     * Init() will also fail if it cannot allocate memory for the input ring.
      *
      * @param
-     * buffSize (long) - size of input buffers; each buffer will be
-     * 'buffSize' events long.
+     * buffSize (long) - size of the input ring; the ring will hold at least
+     * 'buffSize' events (its size is rounded up to a power of two).
      *
      * @return
      * bool - true for success, false for error in initializing the MIDI
-     * environment or allocating the input buffers.
+     * environment or allocating the input ring.
      *
      **/
     bool Init(long buffSize);
@@ -314,21 +409,18 @@ public:
      *
      * @details
      * GetData() returns recent input data collected by the MIDI input callback
-     * in one of the input buffers. Immediately after starting and before copying
-     * any data, GetData() redirects the current buffer pointer to a different
-     * input buffer, so that the MIDI callback thread can keep doing its job
-     * while data is being copied without any conflicts. Once all data is copied, 
-     * the method resets the input buffer count to zero so the callback can use 
-     * the buffer from the begining next time around.
+     * in the input ring. GetData() copies every message stored since the previous
+     * call, in arrival order, and only then releases their slots, so that the MIDI
+     * callback thread can keep doing its job while data is being copied without
+     * any conflicts. Messages which arrive while GetData() is running are
+     * returned by the next call.
      *
      *@attention
-     * Subsequent calls to GetData() will keep toggling from one buffer to 
-     * the other, so that it will never be reading from the same place the 
-     * Recorder is storing data. This means that once a block of MIDI data
-     * is copied from the input buffer by GetData() it will no longer be 
-     * available, as the data will be overwritten by the callback after 
-     * the next call to GetData(). Hence client code should store that 
-     * data if it intends to reuse it.
+     * Once a block of MIDI data is copied from the input ring by GetData() 
+     * it will no longer be available, as its slots will be overwritten by the
+     * callback with new messages. Hence client code should store that 
+     * data if it intends to reuse it. GetData() should only be called
+     * from one thread at a time.
      *
      * @return
      * MuMIDIBuffer - GetData() returns a MIDI buffer structure containing a
@@ -344,6 +436,122 @@ public:
      **/
     MuMIDIBuffer GetData(void);
     
+    /**
+     * @brief lends calling code a block of the latest input MIDI events,
+     * without copying them
+     *
+     * @details
+     * AcquireData() returns a MIDI buffer whose 'data' field points directly
+     * to a contiguous block of messages inside the recorder's input ring,
+     * containing messages received since the previous call to AcquireData()
+     * (or GetData()). No memory is allocated and nothing is copied. While the
+     * block is held by calling code, the recorder will not write to its
+     * slots. When calling code is done with the messages, it must hand the
+     * block back with ReleaseData().
+     *
+     * Because the block must be contiguous, when available messages wrap
+     * around the end of the ring (or continue in a chained ring, in
+     * CAPTURE_MODE_GROW) AcquireData() returns only the messages up to the
+     * end of the ring; the remaining ones are returned by the next calls,
+     * once the previous blocks are released.
+     * AcquireData() may be called several times before releasing, in which case
+     * each call returns the block following the previous one; blocks must then
+     * be released in the same order. When there are no new messages,
+     * AcquireData() returns an empty buffer ('data' == NULL, 'count' == 0).
+     *
+     * @warning
+     * The returned buffer belongs to the recorder. Calling code MUST NOT
+     * release its memory. Holding blocks for too long reduces the space
+     * available for new messages. GetData() returns nothing while blocks
+     * are held.
+     *
+     * @return
+     * MuMIDIBuffer - a buffer pointing to a block of the input ring. 'max'
+     * and 'count' both contain the number of messages in the block.
+     *
+     **/
+    MuMIDIBuffer AcquireData(void);
+    
+    /**
+     * @brief gives a block obtained with AcquireData() back to the recorder
+     *
+     * @details
+     * ReleaseData() returns the slots of a block lent by AcquireData() to the
+     * input ring, so they can receive new messages. Blocks must be released
+     * in the order they were acquired; a buffer which is not the oldest block
+     * held by calling code is ignored. After this call, the block's data
+     * should no longer be accessed.
+     *
+     * @param
+     * block (MuMIDIBuffer) - a buffer returned by AcquireData()
+     *
+     **/
+    void ReleaseData(MuMIDIBuffer block);
+    
+    /**
+     * @brief selects how the recorder deals with a full input ring
+     *
+     * @details
+     * SetCaptureMode() selects one of two capture modes. In CAPTURE_MODE_FIXED
+     * (the default), messages arriving while the input ring is full are dropped.
+     * In CAPTURE_MODE_GROW, the recorder keeps a preallocated spare ring which
+     * the MIDI callback chains to the input when the current ring is full, so
+     * input storage grows without blocking the callback. Each new ring is twice
+     * as large as the previous one, up to MAX_INPUT_RING_SIZE messages. The mode
+     * may be changed at any time, from the thread which collects data.
+     *
+     * @param
+     * mode (short) - CAPTURE_MODE_FIXED or CAPTURE_MODE_GROW
+     *
+     **/
+    void SetCaptureMode(short mode);
+    
+    /**
+     * @brief returns the current capture mode
+     *
+     * @return
+     * short - CAPTURE_MODE_FIXED or CAPTURE_MODE_GROW
+     *
+     **/
+    short CaptureMode(void);
+    
+    /**
+     * @brief returns the number of messages captured since Init()
+     *
+     * @return
+     * unsigned long - messages stored in the input ring(s)
+     *
+     **/
+    unsigned long CapturedEvents(void);
+    
+    /**
+     * @brief returns the number of messages dropped since Init()
+     *
+     * @details
+     * Messages are dropped when they arrive while the input ring is full
+     * and no spare ring is available.
+     *
+     * @return
+     * unsigned long - messages lost because of insufficient space
+     *
+     **/
+    unsigned long DroppedEvents(void);
+    
+    /**
+     * @brief returns the largest number of messages ever waiting to be collected
+     *
+     * @details
+     * PeakOccupancy() reports the highest number of messages stored by the
+     * recorder and not yet collected by GetData() or released with ReleaseData(),
+     * since Init(). A value close to the buffer size given to Init() means
+     * messages were (or were about to be) dropped in CAPTURE_MODE_FIXED.
+     *
+     * @return
+     * unsigned long - peak number of messages waiting in input storage
+     *
+     **/
+    unsigned long PeakOccupancy(void);
+    
 #ifdef MUM_MACOSX
     /**
      * @brief gets called by MIDI system when there is MIDI data available
@@ -425,10 +633,12 @@ public:
      *
      * @details
      * AddMessageToBuffer() stores the requested MuMIDIMessage in the next
-     * available position of the current input buffer. If the buffer is
-     * full, AddMessageToBuffer() fails silently. AddMessageToBuffer() is 
-     * called by the MIDIInputCallback when it needs to add a new MIDI 
-     * event to one of the input buffers.
+     * free slot of the input ring. If the ring is full, AddMessageToBuffer()
+     * moves on to the spare ring, in CAPTURE_MODE_GROW, or drops the message,
+     * updating the dropped message count. AddMessageToBuffer() never blocks
+     * or allocates memory.
+     * It is called by the MIDIInputCallback when it needs to add a new MIDI 
+     * event to the input ring.
      *
      * @warning
      * MIDIInputCallback is a static method of the MuRecorder class but should
@@ -528,6 +738,151 @@ public:
      *
      **/
     MuMIDIBuffer ExtractEventsOfType(unsigned char eventType, MuMIDIBuffer buff);
+    
+    /**
+     * @brief merges two MIDI buffers in time order
+     *
+     * @details
+     * MergeMIDIBuffers() takes two MuMIDIBuffers, each one in time order,
+     * and returns a new buffer containing the messages from both, also in
+     * time order. Messages are compared by their nanosecond stamps
+     * (MuMIDIMessage::stamp). The merge is done in a single linear pass;
+     * when two messages have the same stamp, the one from 'buff1' comes
+     * first, so the relative order of each input buffer is preserved.
+     * Input buffers are not modified.
+     *
+     * @note
+     * The merged buffer must be released by calling code when it is no
+     * longer needed.
+     *
+     * @param
+     * buff1 (MuMIDIBuffer) - first buffer to be merged
+     *
+     * @param
+     * buff2 (MuMIDIBuffer) - second buffer to be merged
+     *
+     * @return
+     * MuMIDIBuffer - a new buffer with the merged messages. If both inputs
+     * are empty, or allocation fails, 'data' is NULL and 'count' is zero.
+     *
+     **/
+    static MuMIDIBuffer MergeMIDIBuffers(MuMIDIBuffer buff1, MuMIDIBuffer buff2);
+    
+    /**
+     * @brief merges several MIDI buffers in time order
+     *
+     * @details
+     * This version of MergeMIDIBuffers() merges 'numBuffs' buffers from
+     * array 'buffs', each one in time order, into a single new buffer. The
+     * next message is chosen with a small heap holding the current position
+     * in each input buffer, so the whole merge takes O(n log k) steps for
+     * n messages in k buffers. Messages with the same stamp keep the order
+     * of the buffers in the array. Input buffers are not modified.
+     *
+     * @note
+     * The merged buffer must be released by calling code when it is no
+     * longer needed.
+     *
+     * @param
+     * buffs (MuMIDIBuffer *) - array of buffers to be merged
+     *
+     * @param
+     * numBuffs (long) - number of buffers in 'buffs'
+     *
+     * @return
+     * MuMIDIBuffer - a new buffer with the merged messages. If every input
+     * is empty, or allocation fails, 'data' is NULL and 'count' is zero.
+     *
+     **/
+    static MuMIDIBuffer MergeMIDIBuffers(MuMIDIBuffer * buffs, long numBuffs);
+    
+    /**
+     * @brief merges a MIDI buffer into another one, in place
+     *
+     * @details
+     * MergeIntoMIDIBuffer() merges the messages in 'src' into 'dest',
+     * keeping time order, without allocating memory. Both buffers must be
+     * in time order, and 'dest' must have room for every message from
+     * 'src' ('dest.max' >= 'dest.count' + 'src.count'). The merge runs
+     * backwards from the end of 'dest', so each message is moved only once.
+     * Messages with the same stamp keep 'dest' messages first.
+     *
+     * @param
+     * dest (MuMIDIBuffer &) - destination buffer; its 'count' is updated
+     *
+     * @param
+     * src (MuMIDIBuffer) - buffer to be merged into 'dest'
+     *
+     * @return
+     * bool - false if 'dest' doesn't have enough room for 'src' (in
+     * that case 'dest' is left untouched)
+     *
+     **/
+    static bool MergeIntoMIDIBuffer(MuMIDIBuffer & dest, MuMIDIBuffer src);
+    
+    /**
+     * @brief keeps only events of the requested types in a buffer
+     *
+     * @details
+     * KeepEventsOfType() removes from 'buff', in place, every message whose
+     * type is not in 'typeFlags', in a single pass. 'typeFlags' is a
+     * combination of the type flags defined in MuMIDI.h (for example,
+     * MU_NOTE_ON_FLAG | MU_NOTE_OFF_FLAG keeps only notes). Remaining
+     * messages keep their order and are moved to the beginning of the
+     * buffer. No memory is allocated or released.
+     *
+     * @param
+     * typeFlags (unsigned char) - set of event types to keep
+     *
+     * @param
+     * buff (MuMIDIBuffer &) - buffer to be filtered; its 'count' is updated
+     *
+     * @return
+     * long - number of messages left in the buffer
+     *
+     **/
+    static long KeepEventsOfType(unsigned char typeFlags, MuMIDIBuffer & buff);
+    
+    /**
+     * @brief removes events of the requested types from a buffer
+     *
+     * @details
+     * RemoveEventsOfType() is the opposite of KeepEventsOfType(): it
+     * removes from 'buff', in place, every message whose type is in
+     * 'typeFlags' (see MuMIDI.h), in a single pass and without allocating
+     * memory. Remaining messages keep their order.
+     *
+     * @param
+     * typeFlags (unsigned char) - set of event types to remove
+     *
+     * @param
+     * buff (MuMIDIBuffer &) - buffer to be filtered; its 'count' is updated
+     *
+     * @return
+     * long - number of messages left in the buffer
+     *
+     **/
+    static long RemoveEventsOfType(unsigned char typeFlags, MuMIDIBuffer & buff);
+    
+    /**
+     * @brief removes invalid notes from a buffer, in place
+     *
+     * @details
+     * RemoveInvalidNotes() removes from 'buff' every noteOn event which
+     * is not followed by a matching noteOff (the same events returned by
+     * ExtractInvalidNotes()). It finds the last noteOff for each channel
+     * and pitch in a first pass and compacts the buffer in a second pass,
+     * so it runs in linear time and does not allocate memory. Remaining
+     * messages keep their order.
+     *
+     * @param
+     * buff (MuMIDIBuffer &) - buffer to be cleaned; its 'count' is updated
+     *
+     * @return
+     * long - number of messages left in the buffer
+     *
+     **/
+    static long RemoveInvalidNotes(MuMIDIBuffer & buff);
 };
 
 #endif /* MuRecoder_H */
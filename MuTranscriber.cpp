@@ -0,0 +1,316 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuTranscriber.cpp
+ *
+ * @brief Transcriber Class Implementation
+ *
+ * @author Carlos Eduardo Mello
+ * @date 10/18/2026
+ *
+ **/
+
+#include "MuTranscriber.h"
+
+// initial number of slots for open notes...
+const long INITIAL_OPEN_NOTES = 64;
+
+MuTranscriber::MuTranscriber(void)
+{
+    int c;
+
+    openNotes = NULL;
+    openMax = 0;
+    for(c = 0; c < 16; c++)
+    {
+        done[c] = NULL;
+        doneMax[c] = 0;
+        doneCount[c] = 0;
+    }
+    Reset();
+}
+
+MuTranscriber::~MuTranscriber(void)
+{
+    int c;
+
+    delete [] openNotes;
+    for(c = 0; c < 16; c++)
+        delete [] done[c];
+}
+
+void MuTranscriber::Reset(void)
+{
+    int c, k;
+    long i;
+
+    for(c = 0; c < 16; c++)
+    {
+        for(k = 0; k < 128; k++)
+            head[c][k] = tail[c][k] = -1;
+        program[c] = 0;
+        voiceOfChannel[c] = -1;
+        doneCount[c] = 0;
+    }
+
+    // every slot goes back to the free list...
+    freeSlot = -1;
+    for(i = openMax - 1; i >= 0; i--)
+    {
+        openNotes[i].next = freeSlot;
+        freeSlot = i;
+    }
+    numOpen = 0;
+
+    target = NULL;
+    lastStamp = 0;
+    lastError.Set(MuERROR_NONE);
+}
+
+long MuTranscriber::OpenNotes(void)
+{
+    return numOpen;
+}
+
+MuError MuTranscriber::LastError(void)
+{
+    return lastError;
+}
+
+bool MuTranscriber::NewOpenNote(long & slot)
+{
+    long i;
+
+    // when every slot is in use, the pool doubles in size
+    // (open notes refer to each other by index, so they
+    // stay valid when the pool is moved)...
+    if(freeSlot < 0)
+    {
+        long newMax = (openMax > 0) ? (openMax * 2) : INITIAL_OPEN_NOTES;
+        OpenNote * temp = new OpenNote[newMax];
+        if(temp == NULL)
+            return false;
+        for(i = 0; i < openMax; i++)
+            temp[i] = openNotes[i];
+        for(i = newMax - 1; i >= openMax; i--)
+        {
+            temp[i].next = freeSlot;
+            freeSlot = i;
+        }
+        delete [] openNotes;
+        openNotes = temp;
+        openMax = newMax;
+    }
+
+    slot = freeSlot;
+    freeSlot = openNotes[slot].next;
+    numOpen++;
+    return true;
+}
+
+void MuTranscriber::CompleteNote(int channel, int pitch, long long end)
+{
+    long slot = head[channel][pitch];
+    long i;
+
+    if(slot < 0)
+        return;
+
+    // remove the oldest open note from its queue...
+    OpenNote & open = openNotes[slot];
+    head[channel][pitch] = open.next;
+    if(head[channel][pitch] < 0)
+        tail[channel][pitch] = -1;
+
+    // make room for the completed note...
+    if(doneCount[channel] == doneMax[channel])
+    {
+        long newMax = (doneMax[channel] > 0) ? (doneMax[channel] * 2) : INITIAL_OPEN_NOTES;
+        MuNote * temp = new MuNote[newMax];
+        if(temp == NULL)
+        {
+            lastError.Set(MuERROR_INSUF_MEM);
+        }
+        else
+        {
+            for(i = 0; i < doneCount[channel]; i++)
+                temp[i] = done[channel][i];
+            delete [] done[channel];
+            done[channel] = temp;
+            doneMax[channel] = newMax;
+        }
+    }
+
+    if(doneCount[channel] < doneMax[channel])
+    {
+        if((doneCount[channel] == 0) || (open.start < doneStart[channel]))
+        {
+            doneStart[channel] = open.start;
+            doneMark[channel] = open.mark;
+        }
+        MuNote & note = done[channel][doneCount[channel]++];
+        if(end < open.start)
+            end = open.start;
+        note.SetStart((float)((double)open.start / ONE_SECOND_NS));
+        note.SetDur((float)((double)(end - open.start) / ONE_SECOND_NS));
+        note.SetPitch(pitch);
+        note.SetAmp(open.velocity/128.0);
+        note.SetInstr(open.instr);
+    }
+
+    // and release its slot...
+    open.next = freeSlot;
+    freeSlot = slot;
+    numOpen--;
+}
+
+void MuTranscriber::UseMaterial(MuMaterial & mat)
+{
+    int c;
+
+    // voices created in another material can't be used
+    // (marks taken in them are ignored by the new one)...
+    if(target != &mat)
+    {
+        for(c = 0; c < 16; c++)
+            voiceOfChannel[c] = -1;
+        target = &mat;
+    }
+}
+
+void MuTranscriber::AddCompletedNotes(MuMaterial & mat)
+{
+    int c;
+    long i, j;
+
+    for(c = 0; c < 16; c++)
+    {
+        MuNote * notes = done[c];
+        long n = doneCount[c];
+        if(n == 0)
+            continue;
+
+        // notes are completed in noteOff order, which is usually
+        // close to start order, so insertion sort is quick here...
+        for(i = 1; i < n; i++)
+        {
+            if(notes[i].Start() < notes[i-1].Start())
+            {
+                MuNote temp = notes[i];
+                for(j = i - 1; (j >= 0) && (temp.Start() < notes[j].Start()); j--)
+                    notes[j+1] = notes[j];
+                notes[j+1] = temp;
+            }
+        }
+
+        // the first notes in a channel get their own voice...
+        if((voiceOfChannel[c] < 0) || (voiceOfChannel[c] >= mat.NumberOfVoices()))
+        {
+            voiceOfChannel[c] = mat.NumberOfVoices();
+            mat.AddVoices(1);
+            mat.SetChannel(voiceOfChannel[c], c + 1);
+        }
+
+        // (merging starts where the voice ended when the
+        // earliest of these notes started)...
+        mat.AddNotes(voiceOfChannel[c], notes, n, doneMark[c]);
+        if(mat.LastError().Get() != MuERROR_NONE)
+            lastError.Set(mat.LastError());
+        doneCount[c] = 0;
+    }
+}
+
+long MuTranscriber::Transcribe(MuMIDIBuffer events, MuMaterial & mat)
+{
+    long i, slot, total = 0;
+    int c;
+
+    lastError.Set(MuERROR_NONE);
+    UseMaterial(mat);
+
+    for(i = 0; (events.data != NULL) && (i < events.count); i++)
+    {
+        const MuMIDIMessage & msg = events.data[i];
+        unsigned char type = msg.status & 0xF0;
+        int channel = msg.status & 0x0F;
+        int pitch = msg.data1 & 0x7F;
+
+        if(type < MU_NOTE_OFF)
+            continue;
+        if(msg.stamp > lastStamp)
+            lastStamp = msg.stamp;
+
+        if((type == MU_NOTE_ON) && (msg.data2 != 0))
+        {
+            // start a new note and place it at the end of the open queue...
+            if(!NewOpenNote(slot))
+            {
+                lastError.Set(MuERROR_INSUF_MEM);
+                continue;
+            }
+            OpenNote & open = openNotes[slot];
+            open.start = msg.stamp;
+            open.velocity = msg.data2;
+            open.instr = (program[channel] != 0) ? program[channel] : (channel + 1);
+            open.next = -1;
+            if((voiceOfChannel[channel] >= 0) && (voiceOfChannel[channel] < mat.NumberOfVoices()))
+            {
+                open.mark = mat.MarkVoiceEnd(voiceOfChannel[channel]);
+            }
+            else
+            {
+                open.mark.note = NULL;
+                open.mark.version = 0;
+            }
+            if(tail[channel][pitch] >= 0)
+                openNotes[tail[channel][pitch]].next = slot;
+            else
+                head[channel][pitch] = slot;
+            tail[channel][pitch] = slot;
+        }
+        else if((type == MU_NOTE_OFF) || (type == MU_NOTE_ON))
+        {
+            CompleteNote(channel, pitch, msg.stamp);
+        }
+        else if(type == MU_PROGRAM_CHANGE)
+        {
+            program[channel] = msg.data1 + 1;
+        }
+    }
+
+    for(c = 0; c < 16; c++)
+        total += doneCount[c];
+    AddCompletedNotes(mat);
+
+    return total;
+}
+
+long MuTranscriber::Flush(MuMaterial & mat)
+{
+    long total = 0;
+    int c, k;
+
+    lastError.Set(MuERROR_NONE);
+    UseMaterial(mat);
+
+    for(c = 0; c < 16; c++)
+    {
+        for(k = 0; k < 128; k++)
+        {
+            while(head[c][k] >= 0)
+                CompleteNote(c, k, lastStamp);
+        }
+    }
+
+    for(c = 0; c < 16; c++)
+        total += doneCount[c];
+    AddCompletedNotes(mat);
+
+    return total;
+}
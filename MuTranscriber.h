@@ -0,0 +1,232 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuTranscriber.h
+ *
+ * @brief Transcriber Class Interface
+ *
+ * @author Carlos Eduardo Mello
+ * @date 10/18/2026
+ *
+ * @details
+ * This file declares MuTranscriber, the class used by MuM to turn live
+ * MIDI input into notes while a performance is going on.
+ *
+ **/
+
+#ifndef MuTranscriber_H
+#define MuTranscriber_H
+
+#include "MuMaterial.h"
+
+using namespace std;
+
+/**
+ * @class MuTranscriber
+ *
+ * @brief Incremental MIDI Transcriber
+ *
+ * @details
+ *
+ * MuTranscriber converts a stream of MIDI messages into notes inside
+ * a MuMaterial, a little at a time. It is meant to sit between a
+ * MuRecorder and code which analyses the performer's input while
+ * the performance is going on: every time calling code drains the
+ * recorder (with GetData() or AcquireData()), it hands the resulting
+ * buffer to Transcribe(), which appends to the material every note
+ * completed by that buffer.
+ *
+ * Unlike MuMaterial::LoadMIDIBuffer(), which converts a complete
+ * buffer at once, a transcriber keeps its state between calls. Notes
+ * which are still held when a buffer ends stay open inside the
+ * transcriber and are completed by a noteOff in a later buffer, so
+ * their durations are always correct, no matter where the buffers
+ * were cut. Each call does work proportional to the number of
+ * messages in the buffer, plus the number of notes it completes.
+ *
+ * Messages are paired as in LoadMIDIBuffer(): each noteOff (or
+ * noteOn with velocity zero) terminates the oldest open note with the
+ * same channel and pitch. Note start times come from the messages'
+ * nanosecond stamps (see MuMIDIMessage::stamp), converted to seconds.
+ * Each MIDI channel is placed in its own voice, created in the
+ * material when the first note in that channel is completed, with
+ * its channel number set accordingly. As in LoadMIDIBuffer(), a
+ * note's instrument is the last program selected in its channel
+ * (program + 1), or the channel number if no program change was seen.
+ *
+ * Completed notes are added to the material as soon as their
+ * noteOffs arrive. Notes in a voice are kept in time order, so a long
+ * note completed after shorter notes which started later is inserted
+ * before them. The transcriber remembers where the voice ended when
+ * each note started (see MuMaterial::MarkVoiceEnd()), so placing such
+ * a note only costs a walk over the notes added while it was held;
+ * every other note is appended at the cost of the new notes alone.
+ *
+ * A transcriber is associated with one material at a time. Calling
+ * code should not remove the voices created by the transcriber while
+ * it is in use. When the performance is over, Flush() completes any
+ * notes which are still open. Reset() discards all state, so the
+ * transcriber can be used with another material.
+ *
+ **/
+class MuTranscriber
+{
+    private:
+
+    // open note (waiting for its noteOff)...
+    struct OpenNote
+    {
+        long long start;
+        unsigned char velocity;
+        uShort instr;
+        MuNoteMark mark;    // end of the channel's voice when the note started
+        long next;  // next open note with the same channel and pitch
+    };
+
+    // open notes are kept in a pool, with a queue for each
+    // channel and pitch and a list of free slots...
+    OpenNote * openNotes;
+    long openMax;
+    long freeSlot;
+    long numOpen;
+    long head[16][128];
+    long tail[16][128];
+
+    // current state for each channel...
+    uShort program[16];
+    int voiceOfChannel[16];
+
+    // completed notes waiting to be added to the material, and the
+    // mark of the one which started first (they are added from it)...
+    MuNote * done[16];
+    long doneMax[16];
+    long doneCount[16];
+    MuNoteMark doneMark[16];
+    long long doneStart[16];
+
+    MuMaterial * target;
+    long long lastStamp;
+    MuError lastError;
+
+    void UseMaterial(MuMaterial & mat);
+    bool NewOpenNote(long & slot);
+    void CompleteNote(int channel, int pitch, long long end);
+    void AddCompletedNotes(MuMaterial & mat);
+
+    public:
+
+    /**
+     * @brief Default Constructor
+     *
+     * @details
+     * Creates an empty transcriber, with no open notes and not
+     * associated with any material.
+     *
+     **/
+    MuTranscriber(void);
+
+    /**
+     * @brief Destructor
+     *
+     * @details
+     * Releases the memory used by the transcriber. Notes which are
+     * still open are discarded.
+     *
+     **/
+    ~MuTranscriber(void);
+
+    /**
+     * @brief transcribes a block of MIDI messages
+     *
+     * @details
+     * Transcribe() reads every message in 'events', in time order,
+     * and appends the notes it completes to 'mat', one voice per MIDI
+     * channel. noteOns open new notes, which remain inside the
+     * transcriber until their noteOffs arrive, in this buffer or in a
+     * later one. Program changes set the instrument for notes started
+     * afterwards in the same channel. Other messages are ignored.
+     *
+     * 'events' is not modified or released by Transcribe(), so it can
+     * be a block lent by MuRecorder::AcquireData().
+     *
+     * If 'mat' is not the material used in previous calls, the
+     * transcriber starts using new voices in 'mat', but open notes
+     * are kept.
+     *
+     * @param
+     * events (MuMIDIBuffer) - messages to be transcribed
+     *
+     * @param
+     * mat (MuMaterial &) - material receiving completed notes
+     *
+     * @return
+     * long - number of notes added to 'mat'
+     *
+     **/
+    long Transcribe(MuMIDIBuffer events, MuMaterial & mat);
+
+    /**
+     * @brief completes every open note
+     *
+     * @details
+     * Flush() terminates every note which is still open at the time
+     * of the last message seen by the transcriber (or at the note's
+     * own start, if that is later, giving it duration zero) and adds
+     * those notes to 'mat'. It is usually called when the performance
+     * is over.
+     *
+     * @param
+     * mat (MuMaterial &) - material receiving completed notes
+     *
+     * @return
+     * long - number of notes added to 'mat'
+     *
+     **/
+    long Flush(MuMaterial & mat);
+
+    /**
+     * @brief discards all transcription state
+     *
+     * @details
+     * Reset() discards open notes and program changes and forgets
+     * the voices used in the current material. Memory allocated for
+     * open and completed notes is kept for reuse.
+     *
+     **/
+    void Reset(void);
+
+    /**
+     * @brief returns the number of open notes
+     *
+     * @details
+     * OpenNotes() returns the number of notes which have started but
+     * were not yet terminated by a noteOff.
+     *
+     * @return
+     * long - number of open notes
+     *
+     **/
+    long OpenNotes(void);
+
+    /**
+     * @brief returns last error
+     *
+     * @details
+     * LastError() returns the error generated by the last call to
+     * Transcribe() or Flush(). MuERROR_INSUF_MEM means some notes
+     * could not be stored and were lost.
+     *
+     * @return
+     * MuError - last error
+     *
+     **/
+    MuError LastError(void);
+};
+
+#endif /* MuTranscriber_H */
@@ -184,9 +184,14 @@ extern void ShowInts( int * array, int n )
 
 extern long ClockStamp(void)
 {
-    timeval tv;
-    gettimeofday(&tv, NULL);
-    return ((tv.tv_sec * ONE_SECOND) + (tv.tv_usec));
+    return (long)(NanoClockStamp() / 1000);
+}
+
+extern long long NanoClockStamp(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((ts.tv_sec * ONE_SECOND_NS) + ts.tv_nsec);
 }
 
 extern long TimeToStamp(float secs)
@@ -194,6 +199,11 @@ extern long TimeToStamp(float secs)
     return (long)(secs * ONE_SECOND);
 }
 
+extern long long TimeToNanoStamp(double secs)
+{
+    return llround(secs * ONE_SECOND_NS);
+}
+
 extern int MIDIToPitchClass(int midiPitch)
 {
     int pc = ((midiPitch % 12) + 60);
@@ -24,6 +24,8 @@
 #define _MU_UTIL_H_
 
 #include <sys/time.h>
+#include <time.h>
+#include <math.h>
 #include "MuError.h"
 
 // CONSTANTS
@@ -58,6 +60,9 @@ const short ACC_FAVOR_SHARPS = 2;
 //!@brief One second duration in microseconds
 const long ONE_SECOND = 1000000;
 
+//!@brief One second duration in nanoseconds
+const long long ONE_SECOND_NS = 1000000000LL;
+
 // PROTOTYPES
 
 
@@ -167,24 +172,41 @@ extern void ShowInts( int * array, int size );
 
 // Utility...
 /**
- * @brief looks up the current system time and returns it as a
+ * @brief looks up the current time and returns it as a
  * microsecond value
  *
  * @details
- * ClockStamp() reads the current system time using gettimeofDay()
- * It then converts the 'timeval' structure returned by the system call
- * to the corresponding value in microseconds. This method is extern and
- * can be used at any time by calling code for calculating time offsets
- * and other usefull utilities.
+ * ClockStamp() reads the system's monotonic clock (see NanoClockStamp())
+ * and returns its value in microseconds. Unlike wall clock time, this
+ * value is never stepped back or forward by clock adjustments, so it is
+ * safe to use for calculating time offsets and other usefull utilities.
+ * This method is extern and can be used at any time by calling code.
  *
  * @return
- * unsigned long: the current system time in microseconds (for
- * information about reference time values type 'man gettimeofday'
- * at a unix terminal)
+ * long: the current monotonic time in microseconds (the reference
+ * point is arbitrary; only differences between stamps are meaningful)
  *
  **/
 extern long ClockStamp(void);
 
+/**
+ * @brief looks up the current time and returns it as a
+ * nanosecond value
+ *
+ * @details
+ * NanoClockStamp() reads the system's monotonic clock (CLOCK_MONOTONIC)
+ * using clock_gettime() and returns its value in nanoseconds, as a 64 bit
+ * integer. This is the time base used by MuRecorder and MuPlayer to stamp
+ * and schedule MIDI messages (see MuMIDIMessage::stamp). Being an integer,
+ * it keeps its resolution no matter how long a session runs.
+ *
+ * @return
+ * long long: the current monotonic time in nanoseconds (the reference
+ * point is arbitrary; only differences between stamps are meaningful)
+ *
+ **/
+extern long long NanoClockStamp(void);
+
 /**
  * @brief converts input time from seconds to microseconds
  *
@@ -201,6 +223,20 @@ extern long ClockStamp(void);
  **/
 extern long TimeToStamp(float secs);
 
+/**
+ * @brief converts input time from seconds to nanoseconds
+ *
+ * @details
+ * TimeToNanoStamp() returns the time provided in 'secs' as the nearest
+ * number of nanoseconds. It is used to fill MuMIDIMessage::stamp from
+ * times expressed in seconds, such as note start times.
+ *
+ * @return
+ * long long: requested time in nanoseconds
+ *
+ **/
+extern long long TimeToNanoStamp(double secs);
+
 /**
  * @brief
  *
@@ -17,10 +17,48 @@
  **/
 
 #include "MuVoice.h"
+#include <atomic>
+
+// versions of note lists, shared by every voice, so a mark
+// never matches a list other than the one it was taken from...
+static std::atomic<long> lastListVersion(0);
+
+static long NewListVersion(void)
+{
+    return ++lastListVersion;
+}
+
+// copies a note list (already in time order) appending each
+// note at the end, so the copy takes linear time; returns the
+// new list, its last note and its number of notes...
+static MuNote * CopyNoteList(MuNote * src, MuNote * & last, long & count)
+{
+    MuNote * head = NULL;
+    last = NULL;
+    count = 0;
+    while(src)
+    {
+        MuNote * copy = new MuNote;
+        if(!copy)
+            break;
+        *copy = *src;
+        copy->SetNext(NULL);
+        if(last)
+            last->SetNext(copy);
+        else
+            head = copy;
+        last = copy;
+        count++;
+        src = src->Next();
+    }
+    return head;
+}
 
 MuVoice::MuVoice(void)
 {
     noteList = NULL;
+    lastNote = NULL;
+    listVersion = NewListVersion();
     numOfNotes = 0;
     instrumentNumber = 0;
     channelNumber = 0;
@@ -34,6 +72,8 @@ MuVoice::MuVoice(const MuVoice & inVoice)
 {
     MuNote * temp = NULL;
     noteList = NULL;
+    lastNote = NULL;
+    listVersion = NewListVersion();
     numOfNotes = 0;
     instrumentNumber = 0;
     channelNumber = 0;
@@ -42,12 +82,7 @@ MuVoice::MuVoice(const MuVoice & inVoice)
     if(inVoice.noteList != NULL)
     {
         temp = inVoice.noteList;
-        while(temp)
-        {
-            AddNote(*temp);
-            temp = temp->Next();
-        }
-                numOfNotes = inVoice.numOfNotes;
+        noteList = CopyNoteList(temp, lastNote, numOfNotes);
     }
 	instrumentNumber = inVoice.instrumentNumber;
 	numOfParameters = inVoice.numOfParameters;
@@ -74,13 +109,7 @@ MuVoice & MuVoice::operator=(const MuVoice & inVoice)
     if(inVoice.noteList != NULL)
     {
         temp = inVoice.noteList;
-        while(temp)
-        {
-            AddNote(*temp);
-            temp = temp->Next();
-        }
-        
-        numOfNotes = inVoice.numOfNotes;
+        noteList = CopyNoteList(temp, lastNote, numOfNotes);
     }
 	
 	instrumentNumber = inVoice.instrumentNumber;
@@ -152,6 +181,8 @@ void MuVoice::Clear(void)
     channelNumber = 0;
     numOfParameters = 0;
     noteList = NULL;
+    lastNote = NULL;
+    listVersion = NewListVersion();
     instrumentCode = "";
     voiceName = "";
 }
@@ -363,6 +394,8 @@ MuError MuVoice::IncludeNote(MuNote inNote)
 MuError MuVoice::RemoveNote(long num)
 {
     MuError err(MuERROR_NONE);
+    lastNote = NULL;
+    listVersion = NewListVersion();
     // if list is empty...
     if(!noteList) 
     {
@@ -431,6 +464,8 @@ MuError MuVoice::RemoveNote(long num)
 MuError MuVoice::RemoveLastNote(void)
 {
     MuError err(MuERROR_NONE);
+    lastNote = NULL;
+    listVersion = NewListVersion();
     // if list is empty...
     if(!noteList) 
     {
@@ -790,6 +825,145 @@ MuVoice	MuVoice::Extract(float beg, float end)
     return excerpt;
 }
 
+MuError MuVoice::CopyNotes(MuNote * outNotes, long n) const
+{
+    MuError err(MuERROR_NONE);
+    MuNote * temp = noteList;
+    long i;
+
+    if(n > numOfNotes)
+    {
+        err.Set(MuERROR_NOTE_NOT_FOUND);
+        return err;
+    }
+
+    // walk the list only once...
+    for(i = 0; (i < n) && (temp != NULL); i++)
+    {
+        outNotes[i] = *temp;
+        outNotes[i].SetNext(NULL);
+        temp = temp->Next();
+    }
+
+    return err;
+}
+
+MuError MuVoice::AddNotes(MuNote * inNotes, long n)
+{
+    // no mark: merging starts at the end of the list or at its beginning...
+    MuNoteMark none;
+    none.note = NULL;
+    none.version = 0;
+    return AddNotes(inNotes, n, none);
+}
+
+MuError MuVoice::AddNotes(MuNote * inNotes, long n, MuNoteMark from)
+{
+    MuError err(MuERROR_NONE);
+    MuNote * prev = NULL;
+    MuNote * curr = noteList;
+    MuNote * newNote;
+    long i;
+
+    // if input is not in time order, we can't merge it
+    // in a single pass, so we add one note at a time...
+    for(i = 1; i < n; i++)
+    {
+        if(inNotes[i].Start() < inNotes[i-1].Start())
+        {
+            for(i = 0; i < n; i++)
+            {
+                err = AddNote(inNotes[i]);
+                if(err.Get() != MuERROR_NONE)
+                    break;
+            }
+            return err;
+        }
+    }
+
+    // if the new notes start at or after the last note, there is no
+    // need to walk the list from the beginning (notes added by other
+    // methods may follow the cached last note, so we move to the end)...
+    if((lastNote != NULL) && (n > 0))
+    {
+        while(lastNote->Next() != NULL)
+            lastNote = lastNote->Next();
+        if(!(inNotes[0].Start() < lastNote->Start()))
+        {
+            prev = lastNote;
+            curr = NULL;
+        }
+    }
+
+    // ...and if they start at or after a note marked earlier, the
+    // notes before it don't need to be visited either
+    if((curr != NULL) && (n > 0) && (from.note != NULL) && (from.version == listVersion) &&
+       !(inNotes[0].Start() < from.note->Start()))
+    {
+        prev = from.note;
+        curr = from.note->Next();
+    }
+
+    // otherwise merge both sequences...
+    for(i = 0; i < n; i++)
+    {
+        newNote = new MuNote;
+        if(!newNote)
+        {
+            err.Set(MuERROR_INSUF_MEM);
+            break;
+        }
+        *newNote = inNotes[i];
+
+        // skip every note that doesn't start after the new one
+        // (same placement rule used by AddNote())...
+        while(curr && !(newNote->Start() < curr->Start()))
+        {
+            prev = curr;
+            curr = curr->Next();
+        }
+
+        // link new note between prev and curr...
+        newNote->SetNext(curr);
+        if(prev)
+            prev->SetNext(newNote);
+        else
+            noteList = newNote;
+        prev = newNote;
+
+        // same instrument rule used by AddNote()...
+        if(( InstrumentNumber() > 0) && (newNote->Instr() == 0))
+            newNote->SetInstr(InstrumentNumber());
+
+        numOfNotes++;
+    }
+
+    // remember the end of the list for the next call...
+    if((prev != NULL) && (curr == NULL))
+        lastNote = prev;
+
+    return err;
+}
+
+MuNoteMark MuVoice::Mark(void)
+{
+    MuNoteMark mark;
+
+    // the cached end of the list is brought up to date
+    // (after notes are removed it is found again, once)...
+    if(lastNote == NULL)
+        lastNote = noteList;
+    if(lastNote != NULL)
+    {
+        while(lastNote->Next() != NULL)
+            lastNote = lastNote->Next();
+    }
+
+    mark.note = lastNote;
+    mark.version = listVersion;
+    return mark;
+}
+
 uShort	MuVoice::InstrumentNumber(void)
 {
     return instrumentNumber;
@@ -938,6 +1112,8 @@ MuError MuVoice::RemoveBlankNotes(void)
 {
     MuError err(MuERROR_NONE);
     MuNote * curr, * previous, * temp;
+    lastNote = NULL;
+    listVersion = NewListVersion();
     
     if(!noteList)
         return MuERROR_VOICE_IS_EMPTY;
@@ -981,6 +1157,8 @@ MuError MuVoice::RemoveRepeatedPitches(void)
 {
     MuError err(MuERROR_NONE);
     MuNote * start, * curr, * previous;
+    lastNote = NULL;
+    listVersion = NewListVersion();
     
     if (numOfNotes == 0)
         return MuERROR_VOICE_IS_EMPTY;
@@ -46,6 +46,25 @@ const short SORT_FIELD_DUR = 2;
 const short SORT_FIELD_PITCH = 3;
 const short SORT_FIELD_AMP = 4;
 
+/**
+ * @brief Note List Mark
+ *
+ * @details
+ * MuNoteMark records where a voice's note list ends at a given moment
+ * (see MuVoice::Mark()). Notes which start at or after the marked note
+ * may later be added from that point, without walking the list from its
+ * beginning. A mark is ignored once the voice's notes are removed,
+ * cleared or copied to another voice.
+ **/
+struct MuNoteMark
+{
+    //! @brief last note in the list when the mark was taken (NULL if the list was empty)
+    MuNote * note;
+    //! @brief version of the note list the mark belongs to
+    long version;
+};
+typedef struct MuNoteMark MuNoteMark;
+
 
 /**
  * @class MuVoice
@@ -76,6 +95,8 @@ class MuVoice
     private:	
     
     MuNote *	noteList;
+    MuNote *	lastNote;   // end of list after the last AddNotes() (cleared when notes are removed)
+    long	listVersion;    // renewed when notes are removed or replaced, so old marks are ignored
     long	numOfNotes;
     uShort	instrumentNumber;
     unsigned char channelNumber;
@@ -425,6 +446,101 @@ class MuVoice
 	 **/	
     MuVoice	Extract(float beg, float end);
 	
+	/**
+	 *
+	 * @brief Copies notes from the voice into an array
+	 *
+	 * @details
+	 * CopyNotes() walks the note list once and copies the first 'n' notes,
+	 * in time order, to the array pointed by 'outNotes'. This is much faster
+	 * than calling GetNote() for every index, since GetNote() has to walk the
+	 * list from the begining on every call. 'outNotes' must contain the address
+	 * of an array with at least 'n' MuNote objects.
+	 *
+	 * @param outNotes (MuNote *) - destination array
+	 * @param n (long) - number of notes to be copied
+	 *
+	 * @return
+	 * MuError
+	 * <ul>
+	 * <li> MuERROR_NONE upon success
+	 * <li> MuERROR_NOTE_NOT_FOUND if 'n' is larger than the number of notes
+	 * </ul>
+	 *
+	 **/
+    MuError	CopyNotes(MuNote * outNotes, long n) const;
+	
+	/**
+	 *
+	 * @brief Adds an array of notes to voice's note list
+	 *
+	 * @details
+	 * AddNotes() inserts 'n' notes from 'inNotes' into the note list, in time
+	 * order, with the same results as calling AddNote() for each one of them.
+	 * When the input notes are already in time order, they are merged with
+	 * the note list in a single pass, so loading large amounts of notes takes
+	 * linear time. If the input array is not ordered, AddNotes() falls back to
+	 * inserting each note individually. The voice remembers where its list
+	 * ended after the last call, so successive calls adding notes which
+	 * start at or after the end of the voice (live input, for instance)
+	 * take time proportional to the number of new notes only.
+	 *
+	 * @param inNotes (MuNote *) - array of notes to be added
+	 * @param n (long) - number of notes in array
+	 *
+	 * @return
+	 * MuError
+	 * <ul>
+	 * <li> MuERROR_NONE upon success
+	 * <li> MuERROR_INSUF_MEM if memory allocation fails
+	 * </ul>
+	 *
+	 **/
+    MuError	AddNotes(MuNote * inNotes, long n);
+	
+	/**
+	 *
+	 * @brief Adds an array of notes to voice's note list, from a mark
+	 *
+	 * @details
+	 * This version of AddNotes() starts merging 'inNotes' with the note list
+	 * at 'from' (see Mark()), instead of at the beginning of the list, when
+	 * the mark is still valid and the first new note does not start before
+	 * the marked note. Notes which belong only a little before the end of a
+	 * long voice are then placed at the cost of walking over the notes added
+	 * since the mark was taken. Otherwise, the results are the same as those
+	 * of AddNotes() without a mark.
+	 *
+	 * @param inNotes (MuNote *) - array of notes to be added
+	 * @param n (long) - number of notes in array
+	 * @param from (MuNoteMark) - where merging should start
+	 *
+	 * @return
+	 * MuError
+	 * <ul>
+	 * <li> MuERROR_NONE upon success
+	 * <li> MuERROR_INSUF_MEM if memory allocation fails
+	 * </ul>
+	 *
+	 **/
+    MuError	AddNotes(MuNote * inNotes, long n, MuNoteMark from);
+	
+	/**
+	 *
+	 * @brief Marks the end of the note list
+	 *
+	 * @details
+	 * Mark() returns a mark for the current end of the note list, to be
+	 * given later to AddNotes(), when notes which start at or after the
+	 * current last note are added. The mark stays valid until notes are
+	 * removed from the voice, or the voice is cleared or replaced.
+	 *
+	 * @return
+	 * MuNoteMark - mark for the end of the list
+	 *
+	 **/
+    MuNoteMark	Mark(void);
+	
 	/** 
 	 * @brief Returns the instrument number definition for this voice
 	 *
@@ -183,9 +183,14 @@ class MidiOutAlsa: public MidiOutApi
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
   void sendMessage( const unsigned char *message, size_t size );
+  void sendMessages( const unsigned char *messages, const size_t *sizes, unsigned int count );
+  bool startQueue( void );
+  void scheduleMessages( const unsigned char *messages, const size_t *sizes, const double *delays, unsigned int count );
+  void clearQueue( bool keepNoteOffs );
 
  protected:
   void initialize( const std::string& clientName );
+  bool outputMessage( const unsigned char *message, size_t size, double delay = -1.0 );
 };
 
 #endif
@@ -704,6 +709,30 @@ MidiOutApi :: ~MidiOutApi( void )
 {
 }
 
+void MidiOutApi :: sendMessages( const unsigned char *messages, const size_t *sizes, unsigned int count )
+{
+  // APIs without output buffering send one message at a time.
+  for ( unsigned int i=0; i<count; ++i ) {
+    sendMessage( messages, sizes[i] );
+    messages += sizes[i];
+  }
+}
+
+bool MidiOutApi :: startQueue( void )
+{
+  // Most APIs can't hold messages back.
+  return false;
+}
+
+void MidiOutApi :: scheduleMessages( const unsigned char *messages, const size_t *sizes, const double * /*delays*/, unsigned int count )
+{
+  sendMessages( messages, sizes, count );
+}
+
+void MidiOutApi :: clearQueue( bool /*keepNoteOffs*/ )
+{
+}
+
 // *************************************************** //
 //
 // OS/API-specific methods.
@@ -2097,6 +2126,7 @@ MidiOutAlsa :: ~MidiOutAlsa()
   // Cleanup.
   AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
   if ( data->vport >= 0 ) snd_seq_delete_port( data->seq, data->vport );
+  if ( data->queue_id >= 0 ) snd_seq_free_queue( data->seq, data->queue_id );
   if ( data->coder ) snd_midi_event_free( data->coder );
   if ( data->buffer ) free( data->buffer );
   snd_seq_close( data->seq );
@@ -2122,6 +2152,7 @@ void MidiOutAlsa :: initialize( const std::string& clientName )
   data->seq = seq;
   data->portNum = -1;
   data->vport = -1;
+  data->queue_id = -1; // created by startQueue()
   data->bufferSize = 32;
   data->coder = 0;
   data->buffer = 0;
@@ -2291,7 +2322,7 @@ void MidiOutAlsa :: openVirtualPort( const std::string &portName )
   }
 }
 
-void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
+bool MidiOutAlsa :: outputMessage( const unsigned char *message, size_t size, double delay )
 {
   int result;
   AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
@@ -2302,14 +2333,14 @@ void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
     if ( result != 0 ) {
       errorString_ = "MidiOutAlsa::sendMessage: ALSA error resizing MIDI event buffer.";
       error( RtMidiError::DRIVER_ERROR, errorString_ );
-      return;
+      return false;
     }
     free (data->buffer);
     data->buffer = (unsigned char *) malloc( data->bufferSize );
     if ( data->buffer == NULL ) {
       errorString_ = "MidiOutAlsa::initialize: error allocating buffer memory!\n\n";
       error( RtMidiError::MEMORY_ERROR, errorString_ );
-      return;
+      return false;
     }
   }
 
@@ -2317,23 +2348,113 @@ void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
   snd_seq_ev_clear( &ev );
   snd_seq_ev_set_source( &ev, data->vport );
   snd_seq_ev_set_subs( &ev );
-  snd_seq_ev_set_direct( &ev );
+  if ( delay < 0.0 || data->queue_id < 0 )
+    snd_seq_ev_set_direct( &ev );
+  else {
+    // Let the queue deliver it, relative to its current time.
+    snd_seq_real_time_t time;
+    time.tv_sec = (unsigned int) delay;
+    time.tv_nsec = (unsigned int) ( ( delay - time.tv_sec ) * 1000000000.0 );
+    snd_seq_ev_schedule_real( &ev, data->queue_id, 1, &time );
+  }
   for ( unsigned int i=0; i<nBytes; ++i ) data->buffer[i] = message[i];
   result = snd_midi_event_encode( data->coder, data->buffer, (long)nBytes, &ev );
   if ( result < (int)nBytes ) {
     errorString_ = "MidiOutAlsa::sendMessage: event parsing error!";
     error( RtMidiError::WARNING, errorString_ );
-    return;
+    return false;
   }
 
-  // Send the event.
+  // Queue the event in the output buffer (ALSA drains it
+  // by itself if it fills up).
   result = snd_seq_event_output( data->seq, &ev );
   if ( result < 0 ) {
     errorString_ = "MidiOutAlsa::sendMessage: error sending MIDI message to port.";
     error( RtMidiError::WARNING, errorString_ );
-    return;
+    return false;
+  }
+  return true;
+}
+
+void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( outputMessage( message, size ) )
+    snd_seq_drain_output( data->seq );
+}
+
+void MidiOutAlsa :: sendMessages( const unsigned char *messages, const size_t *sizes, unsigned int count )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  bool queued = false;
+
+  // Queue every message, then drain the output once.
+  for ( unsigned int i=0; i<count; ++i ) {
+    if ( outputMessage( messages, sizes[i] ) ) queued = true;
+    messages += sizes[i];
+  }
+  if ( queued )
+    snd_seq_drain_output( data->seq );
+}
+
+bool MidiOutAlsa :: startQueue( void )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( data->queue_id >= 0 ) return true;
+
+  int queue = snd_seq_alloc_named_queue( data->seq, "RtMidi Output Queue" );
+  if ( queue < 0 ) {
+    errorString_ = "MidiOutAlsa::startQueue: error allocating the output queue.";
+    error( RtMidiError::WARNING, errorString_ );
+    return false;
   }
+
+  // Make room in the kernel for messages waiting in the queue
+  // (the default pool is small; failing here is not fatal).
+  snd_seq_set_client_pool_output( data->seq, 2000 );
+
+  snd_seq_start_queue( data->seq, queue, NULL );
   snd_seq_drain_output( data->seq );
+  data->queue_id = queue;
+  return true;
+}
+
+void MidiOutAlsa :: scheduleMessages( const unsigned char *messages, const size_t *sizes, const double *delays, unsigned int count )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  bool queued = false;
+
+  // Queue every message with its delay, then drain the output once.
+  for ( unsigned int i=0; i<count; ++i ) {
+    if ( outputMessage( messages, sizes[i], delays[i] < 0.0 ? 0.0 : delays[i] ) ) queued = true;
+    messages += sizes[i];
+  }
+  if ( queued )
+    snd_seq_drain_output( data->seq );
+}
+
+void MidiOutAlsa :: clearQueue( bool keepNoteOffs )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( data->queue_id < 0 ) return;
+
+  // Messages not yet drained to the kernel...
+  if ( !keepNoteOffs )
+    snd_seq_drop_output( data->seq );
+
+  // ...and the ones waiting in the queue.
+  snd_seq_remove_events_t *remove;
+  if ( snd_seq_remove_events_malloc( &remove ) < 0 ) {
+    errorString_ = "MidiOutAlsa::clearQueue: error allocating memory.";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+  unsigned int condition = SND_SEQ_REMOVE_OUTPUT;
+  if ( keepNoteOffs ) condition |= SND_SEQ_REMOVE_IGNORE_OFF;
+  snd_seq_remove_events_set_queue( remove, data->queue_id );
+  snd_seq_remove_events_set_condition( remove, condition );
+  snd_seq_remove_events( data->seq, remove );
+  snd_seq_remove_events_free( remove );
 }
 
 #endif // __LINUX_ALSA__
@@ -467,6 +467,50 @@ class RTMIDI_DLL_PUBLIC RtMidiOut : public RtMidi
   */
   void sendMessage( const unsigned char *message, size_t size );
 
+  //! Immediately send several messages out an open MIDI output port.
+  /*!
+      The messages are given back to back in \e messages, and the
+      length of each one in \e sizes. APIs which buffer their output
+      (such as ALSA) queue every message and flush the output once,
+      instead of once per message. Other APIs send the messages one
+      at a time.
+
+      \param messages Pointer to the MIDI messages as raw bytes
+      \param sizes    Length of each MIDI message in bytes
+      \param count    Number of messages
+  */
+  void sendMessages( const unsigned char *messages, const size_t *sizes, unsigned int count );
+
+  //! Prepare the output for messages scheduled ahead of time.
+  /*!
+      APIs which can deliver messages at a later time (such as the ALSA
+      sequencer, which keeps them in a queue in the kernel) set up and
+      start that queue. Returns false if the current API cannot schedule
+      messages, in which case scheduleMessages() sends them at once.
+  */
+  bool startQueue( void );
+
+  //! Schedule several messages to be sent at a later time.
+  /*!
+      Messages are given as in sendMessages(). Each one is sent
+      \e delays[i] seconds after the call (a delay of zero sends it as
+      soon as possible). startQueue() must have succeeded; otherwise the
+      messages are sent immediately.
+
+      \param messages Pointer to the MIDI messages as raw bytes
+      \param sizes    Length of each MIDI message in bytes
+      \param delays   Delay of each MIDI message in seconds
+      \param count    Number of messages
+  */
+  void scheduleMessages( const unsigned char *messages, const size_t *sizes, const double *delays, unsigned int count );
+
+  //! Discard scheduled messages which have not been sent yet.
+  /*!
+      If \e keepNoteOffs is true, pending note off messages are kept,
+      so notes which are already sounding still end.
+  */
+  void clearQueue( bool keepNoteOffs = true );
+
   //! Set an error callback function to be invoked when an error has occured.
   /*!
     The callback function will be called whenever an error has occured. It is best
@@ -594,6 +638,10 @@ class RTMIDI_DLL_PUBLIC MidiOutApi : public MidiApi
   MidiOutApi( void );
   virtual ~MidiOutApi( void );
   virtual void sendMessage( const unsigned char *message, size_t size ) = 0;
+  virtual void sendMessages( const unsigned char *messages, const size_t *sizes, unsigned int count );
+  virtual bool startQueue( void );
+  virtual void scheduleMessages( const unsigned char *messages, const size_t *sizes, const double *delays, unsigned int count );
+  virtual void clearQueue( bool keepNoteOffs );
 };
 
 // **************************************************************** //
@@ -624,6 +672,10 @@ inline unsigned int RtMidiOut :: getPortCount( void ) { return rtapi_->getPortCo
 inline std::string RtMidiOut :: getPortName( unsigned int portNumber ) { return rtapi_->getPortName( portNumber ); }
 inline void RtMidiOut :: sendMessage( const std::vector<unsigned char> *message ) { static_cast<MidiOutApi *>(rtapi_)->sendMessage( &message->at(0), message->size() ); }
 inline void RtMidiOut :: sendMessage( const unsigned char *message, size_t size ) { static_cast<MidiOutApi *>(rtapi_)->sendMessage( message, size ); }
+inline void RtMidiOut :: sendMessages( const unsigned char *messages, const size_t *sizes, unsigned int count ) { static_cast<MidiOutApi *>(rtapi_)->sendMessages( messages, sizes, count ); }
+inline bool RtMidiOut :: startQueue( void ) { return static_cast<MidiOutApi *>(rtapi_)->startQueue(); }
+inline void RtMidiOut :: scheduleMessages( const unsigned char *messages, const size_t *sizes, const double *delays, unsigned int count ) { static_cast<MidiOutApi *>(rtapi_)->scheduleMessages( messages, sizes, delays, count ); }
+inline void RtMidiOut :: clearQueue( bool keepNoteOffs ) { static_cast<MidiOutApi *>(rtapi_)->clearQueue( keepNoteOffs ); }
 inline void RtMidiOut :: setErrorCallback( RtMidiErrorCallback errorCallback, void *userData ) { rtapi_->setErrorCallback(errorCallback, userData); }
 
 #endif
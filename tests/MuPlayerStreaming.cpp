@@ -0,0 +1,94 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuPlayerStreaming.cpp
+ *
+ * @brief MuPlayer streaming test
+ *
+ * @details
+ * More long materials than there are loader threads are streamed
+ * through a small window (see MuPlayer::SetStreamWindow()), and a
+ * short material is played while they are still going. Streaming
+ * queues must not hold the loaders, so the short material must start
+ * right away, and every note of every material must reach the memory
+ * sink. Build it with compileTests and run it; it returns 0 on success.
+ *
+ **/
+
+#include "../MuPlayer.h"
+#include <stdio.h>
+
+const int STREAM_PLAYS = LOADER_THREADS + 1;
+const int STREAM_NOTES = 300;
+const long STREAM_WINDOW = 64;
+const int SHORT_PITCH = 90;
+const long long MAX_START_DELAY = 250000000LL; // 250 ms
+
+int main(void)
+{
+    MuPlayer * player = new MuPlayer;
+    MuMemorySink sink;
+    MuMaterial longMat, shortMat;
+    MuSinkEvent event;
+    MuNote note;
+    long long requested, delay = -1;
+    long expected, received, i;
+    int t;
+
+    for(i = 0; i < STREAM_NOTES; i++)
+    {
+        note.SetStart(i * 0.01);
+        note.SetDur(0.005);
+        note.SetPitch(60 + (i % 12));
+        note.SetAmp(0.5);
+        longMat.AddNote(note);
+    }
+    longMat.SetChannel(0, 1);
+    note.SetStart(0.0);
+    note.SetDur(0.01);
+    note.SetPitch(SHORT_PITCH);
+    shortMat.AddNote(note);
+    shortMat.SetChannel(0, 2);
+
+    sink.Reserve((STREAM_PLAYS * STREAM_NOTES + 1) * 2);
+    if(!player->Init(&sink))
+    {
+        printf("Init() failed\n");
+        return 1;
+    }
+    player->SetStreamWindow(STREAM_WINDOW);
+
+    // the long materials take every loader, if streams hold them...
+    for(t = 0; t < STREAM_PLAYS; t++)
+    {
+        player->Play(longMat, PLAYBACK_MODE_NORMAL);
+        usleep(10000);
+    }
+
+    requested = NanoClockStamp();
+    player->Play(shortMat, PLAYBACK_MODE_NORMAL);
+
+    // let every queue finish...
+    for(t = 0; (t < 1000) && (player->ActiveQueues() > 0); t++)
+        usleep(10000);
+
+    received = sink.NumberOfEvents();
+    for(i = 0; i < received; i++)
+    {
+        sink.GetEvent(i, event);
+        if(((event.msg.status & 0xF0) == MU_NOTE_ON) && (event.msg.data1 == SHORT_PITCH))
+            delay = event.sent - requested;
+    }
+    expected = (STREAM_PLAYS * STREAM_NOTES + 1) * 2;
+    printf("events: %ld of %ld, short material started after %lld ms\n",
+           received, expected, delay / 1000000);
+
+    delete player;
+    return ((received == expected) && (delay >= 0) && (delay <= MAX_START_DELAY)) ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuPlayerStress.cpp
+ *
+ * @brief MuPlayer concurrency stress test
+ *
+ * @details
+ * Several threads call MuPlayer::Play() at once, so the playback pool
+ * is scanned and grown concurrently, while another thread reads the
+ * pool's occupancy. Every note must reach the memory sink exactly
+ * once. Build it with compileTests (with ThreadSanitizer) and run it;
+ * it returns 0 on success.
+ *
+ **/
+
+#include "../MuPlayer.h"
+#include <stdio.h>
+
+const int STRESS_THREADS = 8;
+const int STRESS_PLAYS = 40;
+const int STRESS_NOTES = 4;
+
+static MuPlayer * player = NULL;
+static MuMaterial material;
+static int refused[STRESS_THREADS];
+static atomic<bool> playing(true);
+
+static void * PlayMany(void * arg)
+{
+    long t = (long)arg;
+    for(int i = 0; i < STRESS_PLAYS; i++)
+    {
+        if(!player->Play(material, PLAYBACK_MODE_NORMAL))
+            refused[t]++;
+    }
+    return NULL;
+}
+
+static void * WatchPool(void * arg)
+{
+    MuQueueStats stats[16];
+    while(playing)
+    {
+        player->ActiveQueues();
+        player->PoolSize();
+        player->GetQueueStats(stats, 16);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[STRESS_THREADS];
+    pthread_t watcher;
+    MuMemorySink sink;
+    long expected, received;
+    int t, failed = 0;
+    
+    for(t = 0; t < STRESS_NOTES; t++)
+    {
+        MuNote note;
+        note.SetStart(t * 0.01);
+        note.SetDur(0.005);
+        note.SetPitch(60 + t);
+        note.SetAmp(0.5);
+        material.AddNote(note);
+    }
+    material.SetChannel(0, 1);
+    
+    player = new MuPlayer;
+    sink.Reserve(STRESS_THREADS * STRESS_PLAYS * STRESS_NOTES * 2);
+    if(!player->Init(&sink))
+    {
+        printf("Init() failed\n");
+        return 1;
+    }
+    
+    pthread_create(&watcher, NULL, WatchPool, NULL);
+    for(t = 0; t < STRESS_THREADS; t++)
+        pthread_create(&threads[t], NULL, PlayMany, (void *)(long)t);
+    for(t = 0; t < STRESS_THREADS; t++)
+    {
+        pthread_join(threads[t], NULL);
+        failed += refused[t];
+    }
+    
+    // let every queue finish...
+    for(t = 0; (t < 200) && (player->ActiveQueues() > 0); t++)
+        usleep(10000);
+    playing = false;
+    pthread_join(watcher, NULL);
+    
+    expected = (long)(STRESS_THREADS * STRESS_PLAYS - failed) * STRESS_NOTES * 2;
+    received = sink.NumberOfEvents();
+    printf("plays: %d, refused: %d, pool: %d, events: %ld of %ld\n",
+           STRESS_THREADS * STRESS_PLAYS, failed, player->PoolSize(), received, expected);
+    
+    delete player;
+    return ((failed == 0) && (received == expected)) ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+//*********************************************
+//***************** NCM-UnB *******************
+//******** (c) Carlos Eduardo Mello ***********
+//*********************************************
+// This softwre may be freely reproduced,
+// copied, modified, and reused, as long as
+// it retains, in all forms, the above credits.
+//*********************************************
+
+/** @file MuTranscriberOverlap.cpp
+ *
+ * @brief MuTranscriber overlapping notes test
+ *
+ * @details
+ * A long note is held while several short notes are played, and the
+ * messages are handed to MuTranscriber::Transcribe() one note at a
+ * time. Each short note must reach the material as soon as its noteOff
+ * is transcribed, and the long note must be placed before them when it
+ * ends. The same is repeated after a note is removed from the voice,
+ * which invalidates the position the transcriber remembered. Build it
+ * with compileTests and run it; it returns 0 on success.
+ *
+ **/
+
+#include "../MuTranscriber.h"
+#include <stdio.h>
+
+const int SHORT_NOTES = 8;
+const long long STEP = 100000000LL; // 100 ms
+
+static int failures = 0;
+
+static void Check(bool ok, const char * what)
+{
+    if(!ok)
+    {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static void Message(MuMIDIMessage & msg, unsigned char status, int pitch, long long stamp)
+{
+    msg.status = status;
+    msg.data1 = pitch;
+    msg.data2 = (status == MU_NOTE_ON) ? 100 : 0;
+    msg.stamp = stamp;
+    msg.time = (float)((double)stamp / ONE_SECOND_NS);
+}
+
+static long Send(MuTranscriber & trans, MuMaterial & mat, MuMIDIMessage * msgs, long n)
+{
+    MuMIDIBuffer block;
+    block.data = msgs;
+    block.count = n;
+    block.max = n;
+    return trans.Transcribe(block, mat);
+}
+
+// plays a long note over SHORT_NOTES short ones, starting at 'origin'...
+static void Overlap(MuTranscriber & trans, MuMaterial & mat, long long origin, long before)
+{
+    MuMIDIMessage msgs[2];
+    long i;
+
+    Message(msgs[0], MU_NOTE_ON, 36, origin);
+    Send(trans, mat, msgs, 1);
+    for(i = 0; i < SHORT_NOTES; i++)
+    {
+        Message(msgs[0], MU_NOTE_ON, 60 + i, origin + (i + 1) * STEP);
+        Message(msgs[1], MU_NOTE_OFF, 60 + i, origin + (i + 1) * STEP + STEP / 2);
+        Check(Send(trans, mat, msgs, 2) == 1, "short note added when it ends");
+        Check(mat.NumberOfNotes(0) == before + i + 1, "short notes in the material while the long one is held");
+    }
+    Check(trans.OpenNotes() == 1, "long note still open");
+
+    Message(msgs[0], MU_NOTE_OFF, 36, origin + (SHORT_NOTES + 1) * STEP);
+    Check(Send(trans, mat, msgs, 1) == 1, "long note added when it ends");
+    Check(mat.NumberOfNotes(0) == before + SHORT_NOTES + 1, "every note in the material");
+
+    MuNote first = mat.GetNote(0, before);
+    Check((first.Pitch() == 36) && (first.Start() == (float)((double)origin / ONE_SECOND_NS)), "long note placed before the short ones");
+    for(i = 1; i < mat.NumberOfNotes(0); i++)
+        Check(!(mat.GetNote(0, i).Start() < mat.GetNote(0, i - 1).Start()), "notes in time order");
+}
+
+int main(void)
+{
+    MuTranscriber trans;
+    MuMaterial mat;
+    MuMIDIMessage msgs[2];
+
+    Overlap(trans, mat, 0, 0);
+
+    // a note removed from the voice makes the transcriber's
+    // remembered positions invalid, which must do no harm...
+    Message(msgs[0], MU_NOTE_ON, 36, 10 * STEP * SHORT_NOTES);
+    Send(trans, mat, msgs, 1);
+    mat.RemoveNote(0, mat.NumberOfNotes(0) - 1);
+    Message(msgs[0], MU_NOTE_ON, 72, 10 * STEP * SHORT_NOTES + STEP);
+    Message(msgs[1], MU_NOTE_OFF, 72, 10 * STEP * SHORT_NOTES + 2 * STEP);
+    Send(trans, mat, msgs, 2);
+    Message(msgs[0], MU_NOTE_OFF, 36, 10 * STEP * SHORT_NOTES + 3 * STEP);
+    Send(trans, mat, msgs, 1);
+    Check(mat.NumberOfNotes(0) == SHORT_NOTES + 2, "notes after a removal");
+    Check(mat.GetNote(0, SHORT_NOTES).Pitch() == 36, "long note placed after a removal");
+
+    Overlap(trans, mat, 20 * STEP * SHORT_NOTES, mat.NumberOfNotes(0));
+
+    printf("notes: %ld, failures: %d\n", mat.NumberOfNotes(0), failures);
+    return (failures == 0) ? 0 : 1;
+}